@@ -1,4 +1,7 @@
 glslc voxel.comp -o shader.spv
+glslc -DSVO_TRAVERSAL voxel.comp -o svo.spv
+glslc -DDAG_TRAVERSAL voxel.comp -o dag.spv
+glslc -DIMAGE_STORAGE voxel.comp -o image.spv
 
 echo Shaders compiled!
 
@@ -3,8 +3,10 @@
 #include <stdlib.h>
 
 #include "pis/engine.h"
+#include "pis/pisCameraPath.h"
 
 UniformBufferObject ubo = {0};
+bool recordCameraKey = false;
 
 bool processInput(PisEngine* pis)
 {
@@ -18,6 +20,14 @@ bool processInput(PisEngine* pis)
 
         if(event.type == SDL_EVENT_KEY_UP && event.key.scancode == SDL_SCANCODE_RETURN)
             ubo.time = !ubo.time;
+
+        // P adds the current camera to camera.path, bin/pisbench replays it
+        if(event.type == SDL_EVENT_KEY_UP && event.key.scancode == SDL_SCANCODE_P)
+            recordCameraKey = true;
+
+        // H goes from the image to ray stats to the step heatmap and back
+        if(event.type == SDL_EVENT_KEY_UP && event.key.scancode == SDL_SCANCODE_H)
+            pis->debugView = (pis->debugView + 1) % PIS_DEBUG_VIEW_COUNT;
     }
 
     return true;
@@ -42,12 +52,57 @@ int main(void)
     // strcpy(pis->voxelFile, "/Users/nielsbil/Downloads/vox/character/chr_fox.vox");
     // strcpy(pis->voxelFile, "/Users/nielsbil/Downloads/vox/scan/dragon.vox");
     // strcpy(pis->voxelFile, "/Users/nielsbil/Dev/voxel/models/ground.vox");
+    // strcpy(pis->voxelFile, "/Users/nielsbil/Dev/voxel/models/teapot.vox");
+
+    // Upload through a staging buffer on unified memory devices too, to compare both paths
+    // pis->forceStagingUpload = true;
+
+    // Only store the bricks that hold voxels, big worlds switch to this on their own
+    // pis->voxelLayout = PIS_VOXEL_LAYOUT_BRICKMAP;
+    // Trace a sparse voxel octree or dag with their own kernels instead
+    // pis->voxelLayout = PIS_VOXEL_LAYOUT_SVO;
+    // pis->voxelLayout = PIS_VOXEL_LAYOUT_DAG;
+    // Jump over empty space using the distance to the nearest voxel stored next to every voxel
+    // pis->voxelLayout = PIS_VOXEL_LAYOUT_DISTANCE;
+    // Store the dense grid in 4^3 tiles, compare with bin/layoutbench
+    // pis->voxelLayout = PIS_VOXEL_LAYOUT_TILED;
+    // Read the dense grid from a 3D image instead of a buffer (image.spv)
+    // pis->voxelLayout = PIS_VOXEL_LAYOUT_IMAGE;
+
+    // Trace on the CPU and skip Vulkan altogether, happens by itself without a Vulkan loader
+    // pis->cpuRendering = true;
+
+    // Print GPU time per pass every 120 frames, and optionally every frame into a CSV file
+    // pis->printGpuTimings = true;
+    // strcpy(pis->gpuTimingsFile, "gpu_timings.csv");
+
+    // Count traversal steps on the GPU and print them, or show them as a heatmap (H toggles)
+    // pis->debugView = PIS_DEBUG_VIEW_STATS;
+
+    // Render the start view into frame.png without opening a window
+    // pis->headless = true;
 
     PisEngineInitialize(pis);
 
-    const bool* keys = SDL_GetKeyboardState(NULL);
+    // Start in front of the middle of the world
+    glm_vec3((vec3){pis->voxelData.size.x / 2.f, pis->voxelData.size.y / 2.f, -2}, ubo.position);
 
-    glm_vec3((vec3){128, 128, -2}, ubo.position);
+    if(pis->headless)
+    {
+        ubo.fov = 90.f;
+        PisCameraLook(0.f, 0.f, &ubo);
+        UpdateUniformBuffer(pis, ubo);
+
+        PisEngineDraw(pis);
+        int result = PisEngineSaveFrame(pis, "frame.png");
+
+        PisEngineCleanup(pis);
+        free(pis);
+
+        return result;
+    }
+
+    const bool* keys = SDL_GetKeyboardState(NULL);
 
     SDL_SetWindowRelativeMouseMode(pis->window, true);
     float pitch = 0.f, yaw = 0.f;
@@ -64,15 +119,7 @@ int main(void)
 
         pitch = glm_clamp(pitch, -1.5, 1.5);
 
-        ubo.forward[0] = cos(pitch) * sin(yaw);
-        ubo.forward[1] = sin(pitch);
-        ubo.forward[2] = cos(pitch) * cos(yaw);
-        glm_normalize(ubo.forward);
-
-        glm_cross(ubo.forward, (vec3){0, 1, 0}, ubo.right);
-        glm_normalize(ubo.right);
-
-        glm_cross(ubo.right, ubo.forward, ubo.up);
+        PisCameraLook(yaw, pitch, &ubo);
 
         vec3 delta;
         glm_vec3_zero(delta);
@@ -117,11 +164,23 @@ int main(void)
 
         glm_vec3_add(ubo.position, delta, ubo.position);
 
+        if(recordCameraKey)
+        {
+            PisCameraKey key = { .yaw = yaw, .pitch = pitch, .fov = ubo.fov };
+            glm_vec3_copy(ubo.position, key.position);
+            if(PisCameraPathAppend("camera.path", key) == 0)
+                printf("Added camera key to camera.path\n");
+            recordCameraKey = false;
+        }
+
         ubo.time = (float)SDL_GetTicks() / 1000.f;
 
         UpdateUniformBuffer(pis, ubo);
 
         PisEngineDraw(pis);
+
+        if(pis->debugView != PIS_DEBUG_VIEW_OFF && pis->frameNumber % PIS_RAY_STATS_INTERVAL == 0)
+            PisRayStatsPrint(&pis->rayStats);
     }
 
     PisEngineCleanup(pis);
@@ -11,6 +11,15 @@
 #include "vulkan/buffers.h"
 #include "vulkan/descriptors.h"
 #include "pisVoxReader.h"
+#include "voxReader.h"
+#include "pisOccupancy.h"
+#include "pisBrickmap.h"
+#include "pisSvo.h"
+#include "pisDag.h"
+#include "pisDistance.h"
+#include "pisTiled.h"
+#include "pisTime.h"
+#include "pisPng.h"
 #include "vulkan/swapchain.h"
 #include "vulkan/validationlayers.h"
 #include "vulkan/initializers.h"
@@ -18,10 +27,16 @@
 #include "vulkan/descriptors.h"
 #include "vulkan/images.h"
 #include "vulkan/pisdef.h"
+#include "vulkan/command_buffer.h"
 
 #include "vulkan/volk.h"
 #include "vulkan/vulkan_core.h"
 
+// The Makefile passes the shaders directory of the checkout, the kernels are built there
+#ifndef SHADER_DIR
+#define SHADER_DIR "/Users/nielsbil/Dev/voxel/shaders/"
+#endif
+
 /* ===================================Functions==================================== */
 void PisEngineInitialize(PisEngine* pis);
 void PisEngineDraw(PisEngine* pis);
@@ -35,15 +50,36 @@ void InitDrawImage(PisEngine* pis);
 void InitPaletteBuffer(PisEngine* pis);
 void InitUniformBuffers(PisEngine* pis);
 void InitVoxelBuffer(PisEngine* pis);
+void InitInstanceBuffer(PisEngine* pis);
+void InitOccupancyBuffer(PisEngine* pis);
 
 void InitDescriptors(PisEngine* pis);
 void InitCommands(PisEngine* pis);
 void InitSyncStructures(PisEngine* pis);
 void InitBuffers(PisEngine* pis);
 void InitPipeline(PisEngine* pis);
+void InitCpuRenderer(PisEngine* pis);
+void InitReadbackBuffer(PisEngine* pis);
+void InitTimestampQueries(PisEngine* pis);
+void InitRayStatsBuffer(PisEngine* pis);
 
 /* =================================Helper functions================================ */
 void DrawBackground(VkCommandBuffer cmd, PisEngine* pis);
+void DrawCpu(PisEngine* pis);
+void RecordReadback(VkCommandBuffer cmd, PisEngine* pis);
+void CollectTimestamps(PisEngine* pis, FrameData* frame);
+void WriteTimestamp(VkCommandBuffer cmd, PisEngine* pis, FrameData* frame, uint32_t index);
+void CollectRayStats(PisEngine* pis, FrameData* frame);
+float HalfToFloat(uint16_t half);
+void CleanupCpuRenderer(PisEngine* pis);
+void UploadBrickmap(PisEngine* pis, VkDeviceSize maxBufferSize);
+void UploadSvo(PisEngine* pis, VkDeviceSize maxBufferSize);
+void UploadDag(PisEngine* pis, VkDeviceSize maxBufferSize);
+void UploadDistanceField(PisEngine* pis, VkDeviceSize bufferSize);
+void PackDistanceVoxels(PisEngine* pis, uint16_t* dst, uint32_t zBegin, uint32_t zEnd);
+void UploadTiled(PisEngine* pis, VkDeviceSize maxBufferSize);
+void UploadVoxelImage(PisEngine* pis);
+bool VoxelImageSupported(PisEngine* pis, VkPhysicalDeviceProperties* properties);
 /* ================================================================================ */
 
 void PisEngineInitialize(PisEngine* pis)
@@ -52,11 +88,37 @@ void PisEngineInitialize(PisEngine* pis)
     pis->frameNumber = 0;
     pis->stopRendering = false;
 
-    if(pis->windowExtent.width != 0)
-        InitWindow(pis, pis->windowExtent.width, pis->windowExtent.height);
+    // Without a loader SDL can not even create a Vulkan window
+    if(!pis->cpuRendering && volkInitialize() != VK_SUCCESS)
+    {
+        if(pis->headless)
+        {
+            fprintf(stderr, "Headless rendering needs a Vulkan driver, lavapipe will do\n");
+            exit(-1);
+        }
+
+        fprintf(stderr, "Vulkan is not available, rendering on the CPU\n");
+        pis->cpuRendering = true;
+    }
+
+    if(pis->windowExtent.width == 0)
+    {
+        pis->windowExtent.width = 832;
+        pis->windowExtent.height = 624;
+    }
+
+    // Headless frames have the size of the window that is never opened
+    if(pis->headless)
+        pis->cpuRendering = false;
     else
-        InitWindow(pis, 832, 624);
+        InitWindow(pis, pis->windowExtent.width, pis->windowExtent.height);
 
+    if(pis->cpuRendering)
+    {
+        InitVoxelData(pis);
+        InitCpuRenderer(pis);
+        return;
+    }
 
     InitVulkan(pis);
 
@@ -64,28 +126,171 @@ void PisEngineInitialize(PisEngine* pis)
 
     InitDrawImage(pis);
 
-    InitPaletteBuffer(pis);
+    if(pis->headless)
+        InitReadbackBuffer(pis);
 
     InitUniformBuffers(pis);
 
+    InitRayStatsBuffer(pis);
+
     InitCommands(pis);
 
+    InitPaletteBuffer(pis);
+
     InitVoxelBuffer(pis);
 
+    InitInstanceBuffer(pis);
+
+    InitOccupancyBuffer(pis);
+
     InitDescriptors(pis);
 
     InitSyncStructures(pis);
 
+    InitTimestampQueries(pis);
+
     InitPipeline(pis);
+
+#ifdef DEBUG
+    PrintAllocatorStats(&pis->vk.allocator);
+#endif
 }
 
 void UpdateUniformBuffer(PisEngine* pis, UniformBufferObject ubo)
 {
-    memcpy(pis->vk.uboBuffer.ptr, &ubo, sizeof(UniformBufferObject));
+    ubo.instanceCount = pis->voxelScene.instanceCount;
+    ubo.voxelLayout = pis->voxelLayout;
+    ubo.debugView = pis->debugView;
+    ubo.worldSize = pis->voxelData.size;
+    pis->ubo = ubo;
+}
+
+int PisEngineUpdateVoxels(PisEngine* pis, Size min, Size max)
+{
+    // The CPU traces voxelData itself, the next frame already sees the change
+    if(pis->cpuRendering)
+        return 0;
+
+    if(pis->voxelLayout != PIS_VOXEL_LAYOUT_DISTANCE || pis->voxelScene.instanceCount > 0)
+    {
+        fprintf(stderr, "Only a single volume stored with distances can be updated\n");
+        return -1;
+    }
+
+    Size size = pis->voxelData.size;
+    max.x = max.x < size.x ? max.x : size.x;
+    max.y = max.y < size.y ? max.y : size.y;
+    max.z = max.z < size.z ? max.z : size.z;
+    if(min.x >= max.x || min.y >= max.y || min.z >= max.z)
+        return 0;
+
+    double start = PisTimeSeconds();
+
+    Size updatedMin, updatedMax;
+    if(PisDistanceFieldUpdate(&pis->voxelData, &pis->distanceField, min, max, &updatedMin, &updatedMax) != 0)
+        return -1;
+
+    // Whole layers of the changed region are contiguous in the buffer
+    VkDeviceSize layerSize = sizeof(uint16_t) * size.x * size.y;
+    VkDeviceSize offset = layerSize * updatedMin.z;
+    VkDeviceSize uploadSize = layerSize * (updatedMax.z - updatedMin.z);
+
+    // Frames in flight still read the buffer
+    vkDeviceWaitIdle(pis->vk.device);
+
+    if(pis->vk.voxelBuffer.ptr != NULL)
+    {
+        PackDistanceVoxels(pis, (uint16_t*)((uint8_t*)pis->vk.voxelBuffer.ptr + offset), updatedMin.z, updatedMax.z);
+    }
+    else
+    {
+        Buffer staging;
+        if(CreateBuffer(pis->vk.device, &pis->vk.allocator, uploadSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging) != 0)
+        {
+            fprintf(stderr, "Failed to create staging buffer for the voxel update\n");
+            return -1;
+        }
+
+        PackDistanceVoxels(pis, staging.ptr, updatedMin.z, updatedMax.z);
+        CopyBufferRegion(pis->vk.device, pis->vk.frames[0].commandPool, pis->vk.computeQueue,
+                         staging.buffer, pis->vk.voxelBuffer.buffer, offset, uploadSize);
+
+        DestroyBuffer(pis->vk.device, &pis->vk.allocator, &staging);
+    }
+
+#ifdef DEBUG
+    printf("Updated %ux%ux%u voxels, %ux%ux%u distances in %.2f ms\n",
+           max.x - min.x, max.y - min.y, max.z - min.z,
+           updatedMax.x - updatedMin.x, updatedMax.y - updatedMin.y, updatedMax.z - updatedMin.z,
+           (PisTimeSeconds() - start) * 1000.0);
+#else
+    (void)start;
+#endif
+
+    return 0;
+}
+
+void PisEngineWaitFrame(PisEngine* pis)
+{
+    // The CPU renderer is done when PisEngineDraw returns
+    if(pis->cpuRendering || pis->frameNumber == 0)
+        return;
+
+    // Waits for the last frame only, the fence is reset by the next PisEngineDraw
+    FrameData* frame = &pis->vk.frames[(pis->frameNumber - 1) % pis->vk.swapchainImageCount];
+    VK_CHECK(vkWaitForFences(pis->vk.device, 1, &frame->renderFence, true, UINT64_MAX));
+
+    CollectTimestamps(pis, frame);
+    CollectRayStats(pis, frame);
+}
+
+int PisEngineSaveFrame(PisEngine* pis, const char* fileName)
+{
+    if(!pis->headless || pis->frameNumber == 0)
+    {
+        fprintf(stderr, "Only a drawn headless frame can be saved\n");
+        return -1;
+    }
+
+    PisEngineWaitFrame(pis);
+
+    uint32_t width = pis->vk.drawImage.extent.width;
+    uint32_t height = pis->vk.drawImage.extent.height;
+    const uint16_t* halfs = pis->vk.readbackBuffer.ptr;
+
+    uint8_t* rgb = malloc((size_t)width * height * 3 + 1);
+    if(rgb == NULL)
+    {
+        fprintf(stderr, "Failed to allocate\n");
+        return -1;
+    }
+
+    // RGBA16F to 8 bit, clamped like the blit into the UNORM swapchain
+    for(size_t i = 0; i < (size_t)width * height; i++)
+    {
+        for(int c = 0; c < 3; c++)
+        {
+            float value = HalfToFloat(halfs[i * 4 + c]);
+            value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+            rgb[i * 3 + c] = (uint8_t)(value * 255.0f + 0.5f);
+        }
+    }
+
+    int result = PisPngWrite(fileName, width, height, rgb);
+    free(rgb);
+
+    return result;
 }
 
 void PisEngineDraw(PisEngine* pis)
 {
+    if(pis->cpuRendering)
+    {
+        DrawCpu(pis);
+        return;
+    }
+
     int currentFrame = pis->frameNumber % pis->vk.swapchainImageCount;
     FrameData currentFrameData = pis->vk.frames[currentFrame];
 
@@ -93,10 +298,21 @@ void PisEngineDraw(PisEngine* pis)
     VK_CHECK(vkWaitForFences(pis->vk.device, 1, &currentFrameData.renderFence, true, UINT64_MAX));
     VK_CHECK(vkResetFences(pis->vk.device, 1, &currentFrameData.renderFence));
 
+    // The fence has signalled, so the timestamps of this frame's last use are ready without a stall
+    FrameData* frame = &pis->vk.frames[currentFrame];
+    CollectTimestamps(pis, frame);
+    CollectRayStats(pis, frame);
+
+    // The gpu is done with this frame's slice, the other frames in flight keep reading their own
+    memcpy(currentFrameData.ubo, &pis->ubo, sizeof(UniformBufferObject));
+
     // Request image from the swapchain
-    uint32_t swapchainImageIndex;
-    VK_CHECK(vkAcquireNextImageKHR(pis->vk.device, pis->vk.swapchain, UINT64_MAX,
-                                   currentFrameData.swapchainSemaphore, VK_NULL_HANDLE, &swapchainImageIndex));
+    uint32_t swapchainImageIndex = 0;
+    if(!pis->headless)
+    {
+        VK_CHECK(vkAcquireNextImageKHR(pis->vk.device, pis->vk.swapchain, UINT64_MAX,
+                                       currentFrameData.swapchainSemaphore, VK_NULL_HANDLE, &swapchainImageIndex));
+    }
 
     VkCommandBuffer cmd = currentFrameData.mainCommandBuffer;
 
@@ -109,31 +325,74 @@ void PisEngineDraw(PisEngine* pis)
 
     VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
 
+    if(pis->vk.gpuTimings.enabled)
+        vkCmdResetQueryPool(cmd, frame->timestampPool, 0, PIS_GPU_TIMESTAMP_COUNT);
+    WriteTimestamp(cmd, pis, frame, PIS_GPU_PASS_TO_GENERAL);
+
     // Make the swapchain image into writable mode before rendering
     TransitionImage(cmd, pis->vk.drawImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+    WriteTimestamp(cmd, pis, frame, PIS_GPU_PASS_DISPATCH);
 
     // Make the voxel data image writeable
 
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pis->vk.compute.pipeline);
 
+    // In binding order, the ubo at 3 and the ray stats at 7
+    uint32_t dynamicOffsets[2] = { (uint32_t)currentFrameData.uboOffset, (uint32_t)currentFrameData.rayStatsOffset };
+
     vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE,
                             pis->vk.compute.layout, 0, 1,
-                            &pis->vk.descriptor.set, 0, NULL);
+                            &pis->vk.descriptor.set, 2, dynamicOffsets);
 
     // DrawBackground(cmd, pis);
 
     vkCmdDispatch(cmd, pis->vk.drawImage.extent.width / 16, pis->vk.drawImage.extent.height / 16, 1);
+    WriteTimestamp(cmd, pis, frame, PIS_GPU_PASS_TO_TRANSFER);
+
+    // The ubo of this frame decides whether voxel.comp counts, see UpdateUniformBuffer
+    if(pis->ubo.debugView != PIS_DEBUG_VIEW_OFF)
+    {
+        VkBufferMemoryBarrier barrier = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .buffer = pis->vk.rayStatsBuffer.buffer,
+            .offset = frame->rayStatsOffset,
+            .size = sizeof(PisRayStats),
+        };
+
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                             0, NULL, 1, &barrier, 0, NULL);
+        frame->rayStatsPending = true;
+    }
 
-    // Make the image presentable
     TransitionImage(cmd, pis->vk.drawImage.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-    TransitionImage(cmd, pis->vk.swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
-    CopyImageToImage(cmd, pis->vk.drawImage.image, pis->vk.swapchainImages[swapchainImageIndex],
-                     pis->vk.drawExtent, pis->vk.swapchainExtent);
+    if(pis->headless)
+    {
+        WriteTimestamp(cmd, pis, frame, PIS_GPU_PASS_COPY);
+        RecordReadback(cmd, pis);
+        WriteTimestamp(cmd, pis, frame, PIS_GPU_PASS_TO_PRESENT);
+    }
+    else
+    {
+        // Make the image presentable
+        TransitionImage(cmd, pis->vk.swapchainImages[swapchainImageIndex], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        WriteTimestamp(cmd, pis, frame, PIS_GPU_PASS_COPY);
 
-    TransitionImage(cmd, pis->vk.swapchainImages[swapchainImageIndex],
-                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                    VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+        CopyImageToImage(cmd, pis->vk.drawImage.image, pis->vk.swapchainImages[swapchainImageIndex],
+                         pis->vk.drawExtent, pis->vk.swapchainExtent);
+        WriteTimestamp(cmd, pis, frame, PIS_GPU_PASS_TO_PRESENT);
+
+        TransitionImage(cmd, pis->vk.swapchainImages[swapchainImageIndex],
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    }
+
+    WriteTimestamp(cmd, pis, frame, PIS_GPU_PASS_COUNT);
+    frame->timestampsPending = pis->vk.gpuTimings.enabled;
 
     VK_CHECK(vkEndCommandBuffer(cmd));
 
@@ -153,8 +412,21 @@ void PisEngineDraw(PisEngine* pis)
         .pSignalSemaphores = &currentFrameData.renderSemaphore
     };
 
+    // Nothing to acquire or present without a swapchain
+    if(pis->headless)
+    {
+        submit.waitSemaphoreCount = 0;
+        submit.signalSemaphoreCount = 0;
+    }
+
     VK_CHECK(vkQueueSubmit(pis->vk.computeQueue, 1, &submit, currentFrameData.renderFence));
 
+    if(pis->headless)
+    {
+        pis->frameNumber++;
+        return;
+    }
+
     VkPresentInfoKHR presentInfo = {0};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     presentInfo.pNext = NULL;
@@ -166,20 +438,19 @@ void PisEngineDraw(PisEngine* pis)
 
     presentInfo.pImageIndices = &swapchainImageIndex;
 
-    // clock_t begin = clock();
-
     VK_CHECK(vkQueuePresentKHR(pis->vk.computeQueue, &presentInfo));
 
-    // clock_t end = clock();
-    // double timeSpent = (double)(end - begin) / CLOCKS_PER_SEC;
-    // printf("Queue present: %f\n", timeSpent);
-    // begin = clock();
-
     pis->frameNumber++;
 }
 
 void PisEngineCleanup(PisEngine* pis)
 {
+    if(pis->cpuRendering)
+    {
+        CleanupCpuRenderer(pis);
+        return;
+    }
+
     VkDevice device = pis->vk.device;
 
     vkDeviceWaitIdle(device);
@@ -191,18 +462,32 @@ void PisEngineCleanup(PisEngine* pis)
     vkDestroyPipeline(device, pis->vk.compute.pipeline, NULL);
     vkDestroyPipelineLayout(device, pis->vk.compute.layout, NULL);
 
-    vkDestroyBuffer(device, pis->vk.uboBuffer.buffer, NULL);
-    vkFreeMemory(device, pis->vk.uboBuffer.memory, NULL);
+    DestroyBuffer(device, &pis->vk.allocator, &pis->vk.uboBuffer);
+    DestroyBuffer(device, &pis->vk.allocator, &pis->vk.paletteBuffer);
+    DestroyBuffer(device, &pis->vk.allocator, &pis->vk.voxelBuffer);
+    DestroyBuffer(device, &pis->vk.allocator, &pis->vk.instanceBuffer);
+    DestroyBuffer(device, &pis->vk.allocator, &pis->vk.occupancyBuffer);
 
-    vkDestroyBuffer(device, pis->vk.paletteBuffer.buffer, NULL);
-    vkFreeMemory(device, pis->vk.paletteBuffer.memory, NULL);
+    if(pis->vk.voxelImage.image != VK_NULL_HANDLE)
+    {
+        vkDestroyImageView(device, pis->vk.voxelImage.view, NULL);
+        vkDestroyImage(device, pis->vk.voxelImage.image, NULL);
+        FreeMemory(&pis->vk.allocator, &pis->vk.voxelImage.allocation);
+    }
 
-    vkDestroyBuffer(device, pis->vk.voxelBuffer.buffer, NULL);
-    vkFreeMemory(device, pis->vk.voxelBuffer.memory, NULL);
+    DestroyPisVoxScene(pis->voxelScene);
+    DestroyPisDistanceField(pis->distanceField);
 
     vkDestroyImageView(device, pis->vk.drawImage.view, NULL);
     vkDestroyImage(device, pis->vk.drawImage.image, NULL);
-    vkFreeMemory(device, pis->vk.drawImage.memory, NULL);
+    FreeMemory(&pis->vk.allocator, &pis->vk.drawImage.allocation);
+
+    if(pis->headless)
+        DestroyBuffer(device, &pis->vk.allocator, &pis->vk.readbackBuffer);
+    DestroyBuffer(device, &pis->vk.allocator, &pis->vk.rayStatsBuffer);
+
+    // FreeMemory keeps the last block of every memory type around, they go with the allocator
+    DestroyAllocator(&pis->vk.allocator);
 
     for(uint32_t i = 0; i < pis->vk.swapchainImageCount; i++)
     {
@@ -210,22 +495,28 @@ void PisEngineCleanup(PisEngine* pis)
         vkDestroySemaphore(device, pis->vk.frames[i].swapchainSemaphore, NULL);
         vkDestroySemaphore(device, pis->vk.frames[i].renderSemaphore, NULL);
         vkDestroyCommandPool(device, pis->vk.frames[i].commandPool, NULL);
+        vkDestroyQueryPool(device, pis->vk.frames[i].timestampPool, NULL);
     }
 
     free(pis->vk.frames);
+    DestroyPisGpuTimings(&pis->vk.gpuTimings);
 
-    vkDestroySwapchainKHR(device, pis->vk.swapchain, NULL);
-    for(uint32_t i = 0; i < pis->vk.swapchainImageCount; i++)
+    if(!pis->headless)
     {
-        vkDestroyImageView(device, pis->vk.swapchainImageViews[i], NULL);
+        vkDestroySwapchainKHR(device, pis->vk.swapchain, NULL);
+        for(uint32_t i = 0; i < pis->vk.swapchainImageCount; i++)
+        {
+            vkDestroyImageView(device, pis->vk.swapchainImageViews[i], NULL);
+        }
+
+        free(pis->vk.swapchainImages);
+        free(pis->vk.swapchainImageViews);
     }
 
-    free(pis->vk.swapchainImages);
-    free(pis->vk.swapchainImageViews);
-
     vkDestroyDevice(device, NULL);
 
-    vkDestroySurfaceKHR(pis->vk.instance, pis->vk.surface, NULL);
+    if(!pis->headless)
+        vkDestroySurfaceKHR(pis->vk.instance, pis->vk.surface, NULL);
 
 #ifdef DEBUG
     DestroyDebugUtilsMessenger(pis->vk.instance, pis->vk.debugMessenger);
@@ -233,7 +524,8 @@ void PisEngineCleanup(PisEngine* pis)
 
     vkDestroyInstance(pis->vk.instance, NULL);
 
-    SDL_DestroyWindow(pis->window);
+    if(pis->window != NULL)
+        SDL_DestroyWindow(pis->window);
     SDL_Quit();
 }
 
@@ -246,7 +538,7 @@ void InitWindow(PisEngine* pis, uint32_t windowWidth, uint32_t windowHeight)
     // Initialize SDL3 and create a window with it
     SDL_Init(SDL_INIT_VIDEO);
 
-    SDL_WindowFlags windowFlags = (SDL_WindowFlags){SDL_WINDOW_VULKAN};
+    SDL_WindowFlags windowFlags = pis->cpuRendering ? 0 : (SDL_WindowFlags){SDL_WINDOW_VULKAN};
 
     pis->window = SDL_CreateWindow(
         "Voxel",
@@ -258,7 +550,33 @@ void InitWindow(PisEngine* pis, uint32_t windowWidth, uint32_t windowHeight)
 
 void InitVoxelData(PisEngine* pis)
 {
-    pis->voxelData = PisVoxReadFromFile(pis->voxelFile);
+    // MagicaVoxel files are read directly, everything else is expected to be a .pisv file
+    const char* extension = strrchr(pis->voxelFile, '.');
+
+    if(extension == NULL || strcmp(extension, ".vox") != 0)
+    {
+        pis->voxelData = PisVoxReadFromFile(pis->voxelFile);
+        return;
+    }
+
+    PisVoxScene scene = PisVoxSceneReadVoxFile(pis->voxelFile);
+
+    // A single instance is cheaper to trace as a dense grid, the CPU only traces dense grids
+    if(scene.instanceCount == 1 || pis->cpuRendering)
+    {
+        int result = PisVoxSceneFlatten(&scene, &pis->voxelData);
+        DestroyPisVoxScene(scene);
+
+        if(result != 0)
+            exit(-1);
+        return;
+    }
+
+    // The models stay shared, the dense grid only carries the size and the palette
+    pis->voxelScene = scene;
+    pis->voxelData.size = scene.size;
+    pis->voxelData.voxels = NULL;
+    memcpy(pis->voxelData.materials, scene.materials, sizeof(scene.materials));
 }
 
 void InitDrawImage(PisEngine* pis)
@@ -269,139 +587,775 @@ void InitDrawImage(PisEngine* pis)
 
 void InitVoxelBuffer(PisEngine* pis)
 {
-    VkDeviceSize voxelDataSize = 256*256*256;
+    PisVoxScene* scene = &pis->voxelScene;
+
+    if(scene->instanceCount > 0)
+    {
+        // Every model goes into the buffer once, starting on a uint so the shader can address it
+        VkDeviceSize poolSize = 0;
+        for(uint32_t i = 0; i < scene->modelCount; i++)
+            poolSize += ((VkDeviceSize)scene->models[i].size.x * scene->models[i].size.y * scene->models[i].size.z + 3) & ~(VkDeviceSize)3;
+
+        Buffer staging;
+        uint8_t* dst = StartBufferUpload(pis->vk.device, &pis->vk.allocator, poolSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                         !pis->forceStagingUpload, &pis->vk.voxelBuffer, &staging);
+
+        for(uint32_t i = 0; i < scene->modelCount; i++)
+        {
+            size_t modelSize = (size_t)scene->models[i].size.x * scene->models[i].size.y * scene->models[i].size.z;
+            size_t alignedSize = (modelSize + 3) & ~(size_t)3;
+
+            memcpy(dst, scene->models[i].voxels, modelSize);
+            memset(dst + modelSize, 0, alignedSize - modelSize);
+            dst += alignedSize;
+        }
+
+        FinishBufferUpload(pis->vk.device, &pis->vk.allocator, pis->vk.frames[0].commandPool, pis->vk.computeQueue, &pis->vk.voxelBuffer, &staging);
+        return;
+    }
+
+    // The buffer holds exactly the volume, rounded up to the uints the shader reads
+    Size size = pis->voxelData.size;
+    VkDeviceSize voxelDataSize = (VkDeviceSize)size.x * size.y * size.z;
+    VkDeviceSize bufferSize = (voxelDataSize + 3) & ~(VkDeviceSize)3;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(pis->vk.physicalDevice, &properties);
+
+    // The distance layout stores two bytes per voxel, tiles round the volume up to whole tiles
+    if(pis->voxelLayout == PIS_VOXEL_LAYOUT_DISTANCE)
+        bufferSize = (sizeof(uint16_t) * voxelDataSize + 3) & ~(VkDeviceSize)3;
+    else if(pis->voxelLayout == PIS_VOXEL_LAYOUT_TILED)
+        bufferSize = (VkDeviceSize)((size.x + PIS_TILE_SIZE - 1) / PIS_TILE_SIZE) * ((size.y + PIS_TILE_SIZE - 1) / PIS_TILE_SIZE)
+                   * ((size.z + PIS_TILE_SIZE - 1) / PIS_TILE_SIZE) * PIS_TILE_VOXELS;
+
+    if(pis->voxelLayout == PIS_VOXEL_LAYOUT_IMAGE && !VoxelImageSupported(pis, &properties))
+        pis->voxelLayout = PIS_VOXEL_LAYOUT_DENSE;
+
+    if(pis->voxelLayout == PIS_VOXEL_LAYOUT_IMAGE)
+    {
+        UploadVoxelImage(pis);
+        return;
+    }
+
+    if((pis->voxelLayout == PIS_VOXEL_LAYOUT_DENSE || pis->voxelLayout == PIS_VOXEL_LAYOUT_DISTANCE ||
+        pis->voxelLayout == PIS_VOXEL_LAYOUT_TILED) && bufferSize > properties.limits.maxStorageBufferRange)
+    {
+        printf("Voxel data of %ux%ux%u does not fit in a storage buffer of at most %u bytes, storing it as a brickmap\n",
+               size.x, size.y, size.z, properties.limits.maxStorageBufferRange);
+        pis->voxelLayout = PIS_VOXEL_LAYOUT_BRICKMAP;
+    }
+
+    if(pis->voxelLayout == PIS_VOXEL_LAYOUT_BRICKMAP)
+    {
+        UploadBrickmap(pis, properties.limits.maxStorageBufferRange);
+        return;
+    }
+
+    if(pis->voxelLayout == PIS_VOXEL_LAYOUT_SVO)
+    {
+        UploadSvo(pis, properties.limits.maxStorageBufferRange);
+        return;
+    }
+
+    if(pis->voxelLayout == PIS_VOXEL_LAYOUT_DAG)
+    {
+        UploadDag(pis, properties.limits.maxStorageBufferRange);
+        return;
+    }
+
+    if(pis->voxelLayout == PIS_VOXEL_LAYOUT_DISTANCE)
+    {
+        UploadDistanceField(pis, bufferSize);
+        return;
+    }
+
+    if(pis->voxelLayout == PIS_VOXEL_LAYOUT_TILED)
+    {
+        UploadTiled(pis, properties.limits.maxStorageBufferRange);
+        return;
+    }
+
+    // Rays read the voxels all the time, so they live in device local memory
+    Buffer staging;
+    uint8_t* dst = StartBufferUpload(pis->vk.device, &pis->vk.allocator, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                     !pis->forceStagingUpload, &pis->vk.voxelBuffer, &staging);
+
+    memcpy(dst, pis->voxelData.voxels, (size_t)voxelDataSize);
+    memset(dst + voxelDataSize, 0, (size_t)(bufferSize - voxelDataSize));
+
+#ifdef DEBUG
+    printf("Uploaded %llu bytes of voxel data %s\n", (unsigned long long)bufferSize,
+           staging.buffer != VK_NULL_HANDLE ? "through a staging buffer" : "directly into unified memory");
+#endif
+
+    FinishBufferUpload(pis->vk.device, &pis->vk.allocator, pis->vk.frames[0].commandPool, pis->vk.computeQueue, &pis->vk.voxelBuffer, &staging);
+}
+
+void UploadBrickmap(PisEngine* pis, VkDeviceSize maxBufferSize)
+{
+    double start = PisTimeSeconds();
+
+    PisBrickmap brickmap;
+    if(PisBrickmapBuild(&pis->voxelData, &brickmap) != 0)
+    {
+        fprintf(stderr, "Failed to build the brickmap\n");
+        exit(-1);
+    }
+
+    // The grid goes first and the bricks follow it, both as whole uints
+    VkDeviceSize gridSize = sizeof(uint32_t) * brickmap.gridSize.x * brickmap.gridSize.y * brickmap.gridSize.z;
+    VkDeviceSize bricksSize = (VkDeviceSize)brickmap.brickCount * PIS_BRICK_VOXELS;
+    VkDeviceSize bufferSize = gridSize + (bricksSize ? bricksSize : sizeof(uint32_t));
+
+    if(bufferSize > maxBufferSize)
+    {
+        fprintf(stderr, "Brickmap of %u bricks does not fit in a storage buffer of at most %llu bytes\n",
+                brickmap.brickCount, (unsigned long long)maxBufferSize);
+        exit(-1);
+    }
+
+    Buffer staging;
+    uint8_t* dst = StartBufferUpload(pis->vk.device, &pis->vk.allocator, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                     !pis->forceStagingUpload, &pis->vk.voxelBuffer, &staging);
+
+    memcpy(dst, brickmap.grid, (size_t)gridSize);
+    memcpy(dst + gridSize, brickmap.bricks, (size_t)bricksSize);
+
+    FinishBufferUpload(pis->vk.device, &pis->vk.allocator, pis->vk.frames[0].commandPool, pis->vk.computeQueue, &pis->vk.voxelBuffer, &staging);
+
+#ifdef DEBUG
+    Size size = pis->voxelData.size;
+    uint64_t brickTotal = (uint64_t)brickmap.gridSize.x * brickmap.gridSize.y * brickmap.gridSize.z;
+    double denseSize = (double)size.x * size.y * size.z;
+
+    printf("Built a brickmap with %u of %llu bricks (%.1f%%) in %.2f ms: %.2f MB instead of %.2f MB dense\n",
+           brickmap.brickCount, (unsigned long long)brickTotal, brickTotal ? 100.0 * brickmap.brickCount / brickTotal : 0.0,
+           (PisTimeSeconds() - start) * 1000.0, bufferSize / (1024.0 * 1024.0), denseSize / (1024.0 * 1024.0));
+#else
+    (void)start;
+#endif
+
+    DestroyPisBrickmap(brickmap);
+}
+
+void UploadSvo(PisEngine* pis, VkDeviceSize maxBufferSize)
+{
+    double start = PisTimeSeconds();
+
+    PisSvo svo;
+    if(PisSvoBuild(&pis->voxelData, &svo) != 0)
+    {
+        fprintf(stderr, "Failed to build the octree\n");
+        exit(-1);
+    }
+
+    VkDeviceSize bufferSize = sizeof(uint32_t) * svo.wordCount;
+
+    if(bufferSize > maxBufferSize)
+    {
+        fprintf(stderr, "Octree of %zu words does not fit in a storage buffer of at most %llu bytes\n",
+                svo.wordCount, (unsigned long long)maxBufferSize);
+        exit(-1);
+    }
+
+    Buffer staging;
+    void* dst = StartBufferUpload(pis->vk.device, &pis->vk.allocator, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                  !pis->forceStagingUpload, &pis->vk.voxelBuffer, &staging);
+
+    memcpy(dst, svo.nodes, (size_t)bufferSize);
+
+    FinishBufferUpload(pis->vk.device, &pis->vk.allocator, pis->vk.frames[0].commandPool, pis->vk.computeQueue, &pis->vk.voxelBuffer, &staging);
+
+#ifdef DEBUG
+    printf("Built an octree of depth %u in %.2f ms, %.2f MB, nodes per level:", svo.depth,
+           (PisTimeSeconds() - start) * 1000.0, bufferSize / (1024.0 * 1024.0));
+    for(uint32_t level = 0; level < svo.depth; level++)
+        printf(" %u", svo.levelNodeCount[level]);
+    printf("\n");
+#else
+    (void)start;
+#endif
+
+    DestroyPisSvo(svo);
+}
+
+void UploadDag(PisEngine* pis, VkDeviceSize maxBufferSize)
+{
+    double start = PisTimeSeconds();
+
+    PisSvo svo;
+    if(PisSvoBuild(&pis->voxelData, &svo) != 0)
+    {
+        fprintf(stderr, "Failed to build the octree\n");
+        exit(-1);
+    }
+
+    PisDag dag;
+    int result = PisDagBuild(&svo, &dag);
+    size_t svoWords = svo.wordCount;
+    DestroyPisSvo(svo);
+
+    if(result != 0)
+    {
+        fprintf(stderr, "Failed to build the dag\n");
+        exit(-1);
+    }
+
+    VkDeviceSize bufferSize = sizeof(uint32_t) * dag.wordCount;
+
+    if(bufferSize > maxBufferSize)
+    {
+        fprintf(stderr, "Dag of %zu words does not fit in a storage buffer of at most %llu bytes\n",
+                dag.wordCount, (unsigned long long)maxBufferSize);
+        exit(-1);
+    }
+
+    Buffer staging;
+    void* dst = StartBufferUpload(pis->vk.device, &pis->vk.allocator, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                  !pis->forceStagingUpload, &pis->vk.voxelBuffer, &staging);
+
+    memcpy(dst, dag.words, (size_t)bufferSize);
+
+    FinishBufferUpload(pis->vk.device, &pis->vk.allocator, pis->vk.frames[0].commandPool, pis->vk.computeQueue, &pis->vk.voxelBuffer, &staging);
+
+#ifdef DEBUG
+    Size size = pis->voxelData.size;
+    double denseSize = (double)size.x * size.y * size.z;
+
+    printf("Built a dag of depth %u in %.2f ms: %.2f MB (%u material bytes), octree %.2f MB, dense %.2f MB\n",
+           dag.depth, (PisTimeSeconds() - start) * 1000.0, bufferSize / (1024.0 * 1024.0), dag.attributeCount,
+           svoWords * sizeof(uint32_t) / (1024.0 * 1024.0), denseSize / (1024.0 * 1024.0));
+
+    // The 2^3 voxel masks are stored inside their parents, so the last level has no nodes
+    printf("Dag nodes per level (merged/octree):");
+    for(uint32_t level = 0; level + 1 < dag.depth; level++)
+        printf(" %u/%u", dag.levelNodeCount[level], dag.levelTreeNodeCount[level]);
+    printf("\n");
+#else
+    (void)start;
+    (void)svoWords;
+#endif
+
+    DestroyPisDag(dag);
+}
+
+void UploadDistanceField(PisEngine* pis, VkDeviceSize bufferSize)
+{
+    double start = PisTimeSeconds();
+
+    if(PisDistanceFieldBuild(&pis->voxelData, &pis->distanceField) != 0)
+    {
+        fprintf(stderr, "Failed to build the distance field\n");
+        exit(-1);
+    }
+
+    double buildTime = PisTimeSeconds() - start;
+
+    Size size = pis->voxelData.size;
+    size_t voxelCount = (size_t)size.x * size.y * size.z;
+
+    Buffer staging;
+    uint8_t* dst = StartBufferUpload(pis->vk.device, &pis->vk.allocator, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                     !pis->forceStagingUpload, &pis->vk.voxelBuffer, &staging);
+
+    PackDistanceVoxels(pis, (uint16_t*)dst, 0, size.z);
+    memset(dst + sizeof(uint16_t) * voxelCount, 0, (size_t)bufferSize - sizeof(uint16_t) * voxelCount);
+
+    FinishBufferUpload(pis->vk.device, &pis->vk.allocator, pis->vk.frames[0].commandPool, pis->vk.computeQueue, &pis->vk.voxelBuffer, &staging);
+
+#ifdef DEBUG
+    uint64_t distanceSum = 0;
+    for(size_t i = 0; i < voxelCount; i++)
+        distanceSum += pis->distanceField.distance[i];
+
+    printf("Built a distance field in %.2f ms, mean distance %.2f of at most %u, %.2f MB with the materials\n",
+           buildTime * 1000.0, voxelCount ? (double)distanceSum / voxelCount : 0.0, PIS_DISTANCE_MAX,
+           bufferSize / (1024.0 * 1024.0));
+#else
+    (void)buildTime;
+#endif
+}
+
+void UploadTiled(PisEngine* pis, VkDeviceSize maxBufferSize)
+{
+    double start = PisTimeSeconds();
+
+    PisTiled tiled;
+    if(PisTiledBuild(&pis->voxelData, &tiled) != 0)
+    {
+        fprintf(stderr, "Failed to build the voxel tiles\n");
+        exit(-1);
+    }
+
+    // Tiles are 64 bytes, so the size is already whole uints
+    VkDeviceSize bufferSize = tiled.byteCount ? tiled.byteCount : sizeof(uint32_t);
+
+    if(bufferSize > maxBufferSize)
+    {
+        fprintf(stderr, "Voxel tiles of %llu bytes do not fit in a storage buffer of at most %llu bytes\n",
+                (unsigned long long)bufferSize, (unsigned long long)maxBufferSize);
+        exit(-1);
+    }
+
+    Buffer staging;
+    uint8_t* dst = StartBufferUpload(pis->vk.device, &pis->vk.allocator, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                     !pis->forceStagingUpload, &pis->vk.voxelBuffer, &staging);
+
+    memset(dst, 0, (size_t)bufferSize);
+    memcpy(dst, tiled.voxels, tiled.byteCount);
+
+    FinishBufferUpload(pis->vk.device, &pis->vk.allocator, pis->vk.frames[0].commandPool, pis->vk.computeQueue, &pis->vk.voxelBuffer, &staging);
+
+#ifdef DEBUG
+    printf("Stored %ux%ux%u voxel tiles in %.2f ms, %.2f MB\n", tiled.tileCount.x, tiled.tileCount.y, tiled.tileCount.z,
+           (PisTimeSeconds() - start) * 1000.0, bufferSize / (1024.0 * 1024.0));
+#else
+    (void)start;
+#endif
+
+    DestroyPisTiled(tiled);
+}
+
+bool VoxelImageSupported(PisEngine* pis, VkPhysicalDeviceProperties* properties)
+{
+    Size size = pis->voxelData.size;
+    uint32_t maxSize = properties->limits.maxImageDimension3D;
+
+    if(size.x > maxSize || size.y > maxSize || size.z > maxSize)
+    {
+        printf("Voxel data of %ux%ux%u does not fit in a 3D image of at most %u per side, storing it as a buffer\n",
+               size.x, size.y, size.z, maxSize);
+        return false;
+    }
+
+    // R8_UINT storage images are optional
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(pis->vk.physicalDevice, VK_FORMAT_R8_UINT, &formatProperties);
+
+    if(!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT))
+    {
+        printf("The device has no R8_UINT storage images, storing the voxel data as a buffer\n");
+        return false;
+    }
+
+    return true;
+}
+
+void UploadVoxelImage(PisEngine* pis)
+{
+    double start = PisTimeSeconds();
+
+    Size size = pis->voxelData.size;
+    VkExtent3D extent = { size.x, size.y, size.z };
+    VkDeviceSize voxelDataSize = (VkDeviceSize)size.x * size.y * size.z;
+
+    AllocatedImage* image = &pis->vk.voxelImage;
+    image->format = VK_FORMAT_R8_UINT;
+    image->extent = extent;
+
+    CreateImage(pis->vk.device, &pis->vk.allocator, image->format, VK_IMAGE_TYPE_3D,
+                VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, extent,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &image->image, &image->allocation);
+
+    VkImageViewCreateInfo viewInfo = ImageViewCreateInfo(image->format, VK_IMAGE_VIEW_TYPE_3D, image->image, VK_IMAGE_ASPECT_COLOR_BIT);
+    VK_CHECK(vkCreateImageView(pis->vk.device, &viewInfo, NULL, &image->view));
+
+    // Images have a driver chosen layout, so they are always filled through a staging buffer
+    Buffer staging;
+    if(CreateBuffer(pis->vk.device, &pis->vk.allocator, voxelDataSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging) != 0)
+    {
+        fprintf(stderr, "Failed to create staging buffer for the voxel image\n");
+        exit(-1);
+    }
+
+    memcpy(staging.ptr, pis->voxelData.voxels, (size_t)voxelDataSize);
+
+    VkCommandBuffer cmd = BeginSingleTimeCommands(pis->vk.device, pis->vk.frames[0].commandPool);
+
+    TransitionImage(cmd, image->image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
-    VkDeviceSize bufferSize = voxelDataSize;
-    CreateBuffer(pis->vk.device, pis->vk.physicalDevice, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &pis->vk.voxelBuffer);
+    VkBufferImageCopy copyRegion = BufferImageCopyInfo(VK_IMAGE_ASPECT_COLOR_BIT, extent);
+    vkCmdCopyBufferToImage(cmd, staging.buffer, image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
 
-    pis->vk.voxelBuffer.ptr = malloc(bufferSize);
+    TransitionImage(cmd, image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
 
-    VK_CHECK(vkMapMemory(pis->vk.device, pis->vk.voxelBuffer.memory, 0, voxelDataSize, 0, &pis->vk.voxelBuffer.ptr));
-        memcpy(pis->vk.voxelBuffer.ptr, pis->voxelData.voxels, (size_t)bufferSize);
-    vkUnmapMemory(pis->vk.device, pis->vk.voxelBuffer.memory);
+    EndSingleTimeCommands(cmd, pis->vk.device, pis->vk.frames[0].commandPool, pis->vk.computeQueue);
+
+    DestroyBuffer(pis->vk.device, &pis->vk.allocator, &staging);
+
+    // Binding 1 still needs a buffer, image.spv never reads it
+    Buffer placeholderStaging;
+    uint32_t* dst = StartBufferUpload(pis->vk.device, &pis->vk.allocator, sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                      !pis->forceStagingUpload, &pis->vk.voxelBuffer, &placeholderStaging);
+    *dst = 0;
+
+    FinishBufferUpload(pis->vk.device, &pis->vk.allocator, pis->vk.frames[0].commandPool, pis->vk.computeQueue, &pis->vk.voxelBuffer, &placeholderStaging);
+
+#ifdef DEBUG
+    printf("Uploaded %llu bytes of voxel data into a %ux%ux%u image in %.2f ms\n", (unsigned long long)voxelDataSize,
+           size.x, size.y, size.z, (PisTimeSeconds() - start) * 1000.0);
+#else
+    (void)start;
+#endif
+}
+
+// The material in the low byte of every uint16, the distance in the high one
+void PackDistanceVoxels(PisEngine* pis, uint16_t* dst, uint32_t zBegin, uint32_t zEnd)
+{
+    Size size = pis->voxelData.size;
+    size_t begin = (size_t)zBegin * size.x * size.y;
+    size_t end = (size_t)zEnd * size.x * size.y;
+
+    for(size_t i = begin; i < end; i++)
+        dst[i - begin] = (uint16_t)(pis->voxelData.voxels[i] | (pis->distanceField.distance[i] << 8));
+}
+
+void InitInstanceBuffer(PisEngine* pis)
+{
+    PisVoxScene* scene = &pis->voxelScene;
+
+    // The dense grid still needs something bound to the instance binding
+    uint32_t instanceCount = scene->instanceCount > 0 ? scene->instanceCount : 1;
+
+    VkDeviceSize bufferSize = sizeof(VoxelInstance) * instanceCount;
+
+    Buffer staging;
+    VoxelInstance* dst = StartBufferUpload(pis->vk.device, &pis->vk.allocator, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                           !pis->forceStagingUpload, &pis->vk.instanceBuffer, &staging);
+    memset(dst, 0, (size_t)bufferSize);
+
+    // Same layout as InitVoxelBuffer
+    uint32_t* modelOffsets = malloc(sizeof(uint32_t) * (scene->modelCount + 1));
+    if(modelOffsets == NULL)
+    {
+        fprintf(stderr, "Failed to allocate\n");
+        exit(-1);
+    }
+
+    modelOffsets[0] = 0;
+    for(uint32_t i = 0; i < scene->modelCount; i++)
+        modelOffsets[i + 1] = modelOffsets[i] + ((scene->models[i].size.x * scene->models[i].size.y * scene->models[i].size.z + 3) & ~3u);
+
+    for(uint32_t i = 0; i < scene->instanceCount; i++)
+    {
+        PisVoxInstance* instance = &scene->instances[i];
+        Size size = scene->models[instance->model].size;
+
+        // Voxel m covers [m, m + 1), so a mirrored axis also moves the model by one voxel
+        float translation[3];
+        for(uint32_t row = 0; row < 3; row++)
+        {
+            int32_t sum = instance->rotation[row][0] + instance->rotation[row][1] + instance->rotation[row][2];
+            translation[row] = (float)instance->translation[row] + 0.5f * (float)(1 - sum);
+        }
+
+        // The rotation is a signed permutation, so its inverse is its transpose
+        for(uint32_t row = 0; row < 3; row++)
+        {
+            float w = 0.f;
+            for(uint32_t col = 0; col < 3; col++)
+            {
+                dst[i].rotation[row][col] = (float)instance->rotation[col][row];
+                w -= (float)instance->rotation[col][row] * translation[col];
+            }
+
+            dst[i].rotation[row][3] = w;
+        }
+
+        dst[i].model[0] = size.x;
+        dst[i].model[1] = size.y;
+        dst[i].model[2] = size.z;
+        dst[i].model[3] = modelOffsets[instance->model];
+    }
+
+    free(modelOffsets);
+
+    FinishBufferUpload(pis->vk.device, &pis->vk.allocator, pis->vk.frames[0].commandPool, pis->vk.computeQueue, &pis->vk.instanceBuffer, &staging);
+}
+
+void InitOccupancyBuffer(PisEngine* pis)
+{
+    // Only the world grid traversal of voxel.comp skips empty cells, instances are traced voxel
+    // by voxel and the other layouts skip with their own data. They still need something bound.
+    bool usesOccupancy = pis->voxelScene.instanceCount == 0 &&
+        (pis->voxelLayout == PIS_VOXEL_LAYOUT_DENSE || pis->voxelLayout == PIS_VOXEL_LAYOUT_BRICKMAP ||
+         pis->voxelLayout == PIS_VOXEL_LAYOUT_TILED || pis->voxelLayout == PIS_VOXEL_LAYOUT_IMAGE);
+
+    if(!usesOccupancy)
+    {
+        Buffer staging;
+        uint32_t* dst = StartBufferUpload(pis->vk.device, &pis->vk.allocator, sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                          !pis->forceStagingUpload, &pis->vk.occupancyBuffer, &staging);
+        *dst = 0;
+
+        FinishBufferUpload(pis->vk.device, &pis->vk.allocator, pis->vk.frames[0].commandPool, pis->vk.computeQueue, &pis->vk.occupancyBuffer, &staging);
+        return;
+    }
+
+    double start = PisTimeSeconds();
+
+    // Bricks already tell which voxels can be solid, a bit per voxel would bring back the dense grid
+    uint32_t firstLevel = pis->voxelLayout == PIS_VOXEL_LAYOUT_BRICKMAP ? 1 : 0;
+
+    PisOccupancy occupancy;
+    if(PisOccupancyBuild(&pis->voxelData, firstLevel, &occupancy) != 0)
+    {
+        fprintf(stderr, "Failed to build the occupancy pyramid\n");
+        exit(-1);
+    }
+
+    VkDeviceSize bufferSize = sizeof(uint32_t) * occupancy.wordCount;
+
+    // Voxel bits are an eighth of a grid that fit in a storage buffer. The brickmap starts at 4
+    // voxel cells, a 512th of the grid, so only worlds far past 4096^3 get stopped here.
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(pis->vk.physicalDevice, &properties);
+
+    if(bufferSize > properties.limits.maxStorageBufferRange)
+    {
+        fprintf(stderr, "Occupancy of %llu bytes does not fit in a storage buffer of at most %u bytes\n",
+                (unsigned long long)bufferSize, properties.limits.maxStorageBufferRange);
+        exit(-1);
+    }
+
+    Buffer staging;
+    void* dst = StartBufferUpload(pis->vk.device, &pis->vk.allocator, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                  !pis->forceStagingUpload, &pis->vk.occupancyBuffer, &staging);
+
+    memcpy(dst, occupancy.bits, (size_t)bufferSize);
+
+    FinishBufferUpload(pis->vk.device, &pis->vk.allocator, pis->vk.frames[0].commandPool, pis->vk.computeQueue, &pis->vk.occupancyBuffer, &staging);
+
+#ifdef DEBUG
+    printf("Built %u occupancy levels (%llu bytes) in %.2f ms\n", PIS_OCCUPANCY_LEVELS - firstLevel,
+           (unsigned long long)bufferSize, (PisTimeSeconds() - start) * 1000.0);
+#else
+    (void)start;
+#endif
+
+    DestroyPisOccupancy(occupancy);
 }
 
 void InitPaletteBuffer(PisEngine* pis)
 {
     VkDeviceSize bufferSize = sizeof(Material) * 256;
-    CreateBuffer(pis->vk.device, pis->vk.physicalDevice, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &pis->vk.paletteBuffer);
 
-    pis->vk.paletteBuffer.ptr = malloc(bufferSize);
-    
-    VK_CHECK(vkMapMemory(pis->vk.device, pis->vk.paletteBuffer.memory, 0, bufferSize, 0, &pis->vk.paletteBuffer.ptr));
-        memcpy(pis->vk.paletteBuffer.ptr, pis->voxelData.materials, (size_t)bufferSize);
-    vkUnmapMemory(pis->vk.device, pis->vk.paletteBuffer.memory);
+    Buffer staging;
+    void* dst = StartBufferUpload(pis->vk.device, &pis->vk.allocator, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                  !pis->forceStagingUpload, &pis->vk.paletteBuffer, &staging);
+
+    memcpy(dst, pis->voxelData.materials, (size_t)bufferSize);
+
+    FinishBufferUpload(pis->vk.device, &pis->vk.allocator, pis->vk.frames[0].commandPool, pis->vk.computeQueue, &pis->vk.paletteBuffer, &staging);
 }
 
 void InitUniformBuffers(PisEngine* pis)
 {
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-    CreateBuffer(pis->vk.device, pis->vk.physicalDevice, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &pis->vk.uboBuffer);
-
-    pis->vk.uboBuffer.ptr = malloc(sizeof(UniformBufferObject));
-
-    VK_CHECK(vkMapMemory(pis->vk.device, pis->vk.uboBuffer.memory, 0, bufferSize, 0, &pis->vk.uboBuffer.ptr));
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(pis->vk.physicalDevice, &properties);
+
+    // Every frame in flight gets its own slice, dynamic offsets have to be aligned
+    VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+    VkDeviceSize sliceSize = sizeof(UniformBufferObject);
+    if(alignment > 0)
+        sliceSize = (sliceSize + alignment - 1) / alignment * alignment;
+
+    VkDeviceSize bufferSize = sliceSize * pis->vk.swapchainImageCount;
+    if(CreateBuffer(pis->vk.device, &pis->vk.allocator, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &pis->vk.uboBuffer) != 0)
+    {
+        fprintf(stderr, "Failed to create the uniform buffer\n");
+        exit(-1);
+    }
 
     UniformBufferObject ubo = {0};
     UpdateUniformBuffer(pis, ubo);
+
+    for(uint32_t i = 0; i < pis->vk.swapchainImageCount; i++)
+    {
+        pis->vk.frames[i].uboOffset = sliceSize * i;
+        pis->vk.frames[i].ubo = (UniformBufferObject*)((uint8_t*)pis->vk.uboBuffer.ptr + sliceSize * i);
+
+        memcpy(pis->vk.frames[i].ubo, &pis->ubo, sizeof(UniformBufferObject));
+    }
+}
+
+void InitRayStatsBuffer(PisEngine* pis)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(pis->vk.physicalDevice, &properties);
+
+    VkDeviceSize alignment = properties.limits.minStorageBufferOffsetAlignment;
+    VkDeviceSize sliceSize = sizeof(PisRayStats);
+    if(alignment > 0)
+        sliceSize = (sliceSize + alignment - 1) / alignment * alignment;
+
+    VkDeviceSize bufferSize = sliceSize * pis->vk.swapchainImageCount;
+    if(CreateBuffer(pis->vk.device, &pis->vk.allocator, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &pis->vk.rayStatsBuffer) != 0)
+    {
+        fprintf(stderr, "Failed to create the ray stats buffer\n");
+        exit(-1);
+    }
+
+    // The shader only adds, every slice is cleared again once its counts have been read
+    memset(pis->vk.rayStatsBuffer.ptr, 0, bufferSize);
+
+    for(uint32_t i = 0; i < pis->vk.swapchainImageCount; i++)
+    {
+        pis->vk.frames[i].rayStatsOffset = sliceSize * i;
+        pis->vk.frames[i].rayStats = (PisRayStats*)((uint8_t*)pis->vk.rayStatsBuffer.ptr + sliceSize * i);
+        pis->vk.frames[i].rayStatsPending = false;
+    }
 }
 
 void InitDescriptors(PisEngine* pis)
 {
-    VkDescriptorSetLayoutBinding descriptorLayouts[4] = {0};
+    // The voxel image is only part of the layout when there is one, so the buffer kernels match it too
+    bool hasVoxelImage = pis->vk.voxelImage.image != VK_NULL_HANDLE;
 
-    descriptorLayouts[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-    descriptorLayouts[0].binding = 0;
-    descriptorLayouts[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    descriptorLayouts[0].descriptorCount = 1;
+    // Bindings are appended, so leaving one out never moves a binding into another one's slot
+    VkDescriptorSetLayoutBinding descriptorLayouts[8] = {0};
+    uint32_t bindingCount = 0;
 
-    descriptorLayouts[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    descriptorLayouts[1].binding = 1;
-    descriptorLayouts[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    descriptorLayouts[1].descriptorCount = 1;
+    descriptorLayouts[bindingCount++] = (VkDescriptorSetLayoutBinding){
+        .binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    };
+    descriptorLayouts[bindingCount++] = (VkDescriptorSetLayoutBinding){
+        .binding = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    };
+    descriptorLayouts[bindingCount++] = (VkDescriptorSetLayoutBinding){
+        .binding = 2, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    };
+    descriptorLayouts[bindingCount++] = (VkDescriptorSetLayoutBinding){
+        .binding = 3, .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    };
+    descriptorLayouts[bindingCount++] = (VkDescriptorSetLayoutBinding){
+        .binding = 4, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    };
+    descriptorLayouts[bindingCount++] = (VkDescriptorSetLayoutBinding){
+        .binding = 5, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    };
 
-    descriptorLayouts[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    descriptorLayouts[2].binding = 2;
-    descriptorLayouts[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    descriptorLayouts[2].descriptorCount = 1;
+    if(hasVoxelImage)
+    {
+        descriptorLayouts[bindingCount++] = (VkDescriptorSetLayoutBinding){
+            .binding = 6, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        };
+    }
 
-    descriptorLayouts[3].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorLayouts[3].binding = 3;
-    descriptorLayouts[3].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    descriptorLayouts[3].descriptorCount = 1;
+    descriptorLayouts[bindingCount++] = (VkDescriptorSetLayoutBinding){
+        .binding = 7, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    };
 
-    CreateDescriptorSetLayout(pis->vk.device, &pis->vk.descriptor.layout, descriptorLayouts, 4);
+    CreateDescriptorSetLayout(pis->vk.device, &pis->vk.descriptor.layout, descriptorLayouts, bindingCount);
 
     // Pools
-    VkDescriptorPoolSize poolSizes[3];
+    VkDescriptorPoolSize poolSizes[4];
 
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-    poolSizes[0].descriptorCount = 1;
+    poolSizes[0].descriptorCount = hasVoxelImage ? 2 : 1;
 
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    poolSizes[1].descriptorCount = 2;
+    poolSizes[1].descriptorCount = 4;
 
-    poolSizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     poolSizes[2].descriptorCount = 1;
 
-    CreateDescriptorPool(pis->vk.device, &pis->vk.descriptor.pool, poolSizes, 3, 1);
+    poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    poolSizes[3].descriptorCount = 1;
 
-    AllocateDescriptorSets(pis->vk.device, &pis->vk.descriptor);
+    CreateDescriptorPool(pis->vk.device, &pis->vk.descriptor.pool, poolSizes, 4, 1);
 
-    VkWriteDescriptorSet writeSets[4] = {0};
+    AllocateDescriptorSets(pis->vk.device, &pis->vk.descriptor);
 
     VkDescriptorImageInfo drawImgInfo = {0};
     drawImgInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
     drawImgInfo.imageView = pis->vk.drawImage.view;
     drawImgInfo.sampler = VK_NULL_HANDLE;
 
-    writeSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writeSets[0].dstSet = pis->vk.descriptor.set;
-    writeSets[0].dstBinding = 0;
-    writeSets[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-    writeSets[0].pImageInfo = &drawImgInfo;
-    writeSets[0].descriptorCount = 1;
-
     VkDescriptorBufferInfo voxelBufferInfo = {0};
     voxelBufferInfo.buffer = pis->vk.voxelBuffer.buffer;
     voxelBufferInfo.offset = 0;
     voxelBufferInfo.range = pis->vk.voxelBuffer.size;
 
-    writeSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writeSets[1].dstSet = pis->vk.descriptor.set;
-    writeSets[1].dstBinding = 1;
-    writeSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    writeSets[1].pBufferInfo = &voxelBufferInfo;
-    writeSets[1].descriptorCount = 1;
-
     VkDescriptorBufferInfo paletteBufferInfo = {0};
     paletteBufferInfo.buffer = pis->vk.paletteBuffer.buffer;
     paletteBufferInfo.offset = 0;
     paletteBufferInfo.range = pis->vk.paletteBuffer.size;
 
-    writeSets[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writeSets[2].dstSet = pis->vk.descriptor.set;
-    writeSets[2].dstBinding = 2;
-    writeSets[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    writeSets[2].pBufferInfo = &paletteBufferInfo;
-    writeSets[2].descriptorCount = 1;
-
     VkDescriptorBufferInfo uboInfo = {0};
     uboInfo.buffer = pis->vk.uboBuffer.buffer;
+    // Only one slice is visible, the dynamic offset picks which when binding
     uboInfo.offset = 0;
     uboInfo.range = sizeof(UniformBufferObject);
 
-    writeSets[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    writeSets[3].dstSet = pis->vk.descriptor.set;
-    writeSets[3].dstBinding = 3;
-    writeSets[3].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    writeSets[3].pBufferInfo = &uboInfo;
-    writeSets[3].descriptorCount = 1;
+    VkDescriptorBufferInfo instanceBufferInfo = {0};
+    instanceBufferInfo.buffer = pis->vk.instanceBuffer.buffer;
+    instanceBufferInfo.offset = 0;
+    instanceBufferInfo.range = pis->vk.instanceBuffer.size;
+
+    VkDescriptorBufferInfo occupancyBufferInfo = {0};
+    occupancyBufferInfo.buffer = pis->vk.occupancyBuffer.buffer;
+    occupancyBufferInfo.offset = 0;
+    occupancyBufferInfo.range = pis->vk.occupancyBuffer.size;
+
+    VkDescriptorImageInfo voxelImageInfo = {0};
+    voxelImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    voxelImageInfo.imageView = pis->vk.voxelImage.view;
+    voxelImageInfo.sampler = VK_NULL_HANDLE;
+
+    VkDescriptorBufferInfo rayStatsInfo = {0};
+    rayStatsInfo.buffer = pis->vk.rayStatsBuffer.buffer;
+    // One frame's slice, like the ubo
+    rayStatsInfo.offset = 0;
+    rayStatsInfo.range = sizeof(PisRayStats);
+
+    // Written in the same order as the layout
+    VkWriteDescriptorSet writeSets[8] = {0};
+    uint32_t writeCount = 0;
+
+    writeSets[writeCount++] = (VkWriteDescriptorSet){
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = pis->vk.descriptor.set, .dstBinding = 0,
+        .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .pImageInfo = &drawImgInfo,
+    };
+    writeSets[writeCount++] = (VkWriteDescriptorSet){
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = pis->vk.descriptor.set, .dstBinding = 1,
+        .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &voxelBufferInfo,
+    };
+    writeSets[writeCount++] = (VkWriteDescriptorSet){
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = pis->vk.descriptor.set, .dstBinding = 2,
+        .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &paletteBufferInfo,
+    };
+    writeSets[writeCount++] = (VkWriteDescriptorSet){
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = pis->vk.descriptor.set, .dstBinding = 3,
+        .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, .pBufferInfo = &uboInfo,
+    };
+    writeSets[writeCount++] = (VkWriteDescriptorSet){
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = pis->vk.descriptor.set, .dstBinding = 4,
+        .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &instanceBufferInfo,
+    };
+    writeSets[writeCount++] = (VkWriteDescriptorSet){
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = pis->vk.descriptor.set, .dstBinding = 5,
+        .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .pBufferInfo = &occupancyBufferInfo,
+    };
+
+    if(hasVoxelImage)
+    {
+        writeSets[writeCount++] = (VkWriteDescriptorSet){
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = pis->vk.descriptor.set, .dstBinding = 6,
+            .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .pImageInfo = &voxelImageInfo,
+        };
+    }
 
-    vkUpdateDescriptorSets(pis->vk.device, 4, writeSets, 0, NULL);
+    writeSets[writeCount++] = (VkWriteDescriptorSet){
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = pis->vk.descriptor.set, .dstBinding = 7,
+        .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, .pBufferInfo = &rayStatsInfo,
+    };
+
+    vkUpdateDescriptorSets(pis->vk.device, writeCount, writeSets, 0, NULL);
 }
 
 void InitCommands(PisEngine* pis)
@@ -448,10 +1402,44 @@ void InitSyncStructures(PisEngine* pis)
     }
 }
 
+void InitTimestampQueries(PisEngine* pis)
+{
+    const char* csvFile = pis->gpuTimingsFile[0] != '\0' ? pis->gpuTimingsFile : NULL;
+    if(PisGpuTimingsCreate(pis->vk.physicalDevice, pis->vk.indices.computeFamilyIndex, pis->printGpuTimings,
+                           csvFile, &pis->vk.gpuTimings) != 0)
+        return;
+
+    VkQueryPoolCreateInfo queryPoolInfo = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = PIS_GPU_TIMESTAMP_COUNT,
+    };
+
+    for(uint32_t i = 0; i < pis->vk.swapchainImageCount; i++)
+    {
+        VK_CHECK(vkCreateQueryPool(pis->vk.device, &queryPoolInfo, NULL, &pis->vk.frames[i].timestampPool));
+        pis->vk.frames[i].timestampsPending = false;
+    }
+}
+
 void InitPipeline(PisEngine* pis)
 {
     CreateComputePipelineLayout(pis->vk.device, &pis->vk.descriptor.layout, 1, &pis->vk.compute.layout);
-    CreateComputePipeline(pis->vk.device, pis->vk.compute.layout, &pis->vk.compute.pipeline);
+    // The octree and image layouts have their own kernels, everything else goes through the dda one
+    const char* shaderFile = SHADER_DIR "shader.spv";
+    if(pis->voxelLayout == PIS_VOXEL_LAYOUT_SVO && pis->voxelScene.instanceCount == 0)
+        shaderFile = SHADER_DIR "svo.spv";
+    else if(pis->voxelLayout == PIS_VOXEL_LAYOUT_DAG && pis->voxelScene.instanceCount == 0)
+        shaderFile = SHADER_DIR "dag.spv";
+    else if(pis->vk.voxelImage.image != VK_NULL_HANDLE)
+        shaderFile = SHADER_DIR "image.spv";
+
+#ifdef DEBUG
+    printf("Using compute kernel %s\n", shaderFile);
+#endif
+
+    CreateComputePipeline(pis->vk.device, pis->vk.compute.layout, shaderFile, &pis->vk.compute.pipeline);
 }
 
 void DrawBackground(VkCommandBuffer cmd, PisEngine* pis)
@@ -466,3 +1454,157 @@ void DrawBackground(VkCommandBuffer cmd, PisEngine* pis)
     vkCmdClearColorImage(cmd, pis->vk.drawImage.image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &clearRange);
 
 }
+
+void InitCpuRenderer(PisEngine* pis)
+{
+    PisCpuRenderer* cpu = &pis->cpu;
+
+    // The image a GPU frame would be drawn into
+    pis->vk.drawExtent = pis->windowExtent;
+
+    cpu->renderer = SDL_CreateRenderer(pis->window, NULL);
+    if(cpu->renderer == NULL)
+    {
+        fprintf(stderr, "Failed to create SDL renderer: %s\n", SDL_GetError());
+        exit(-1);
+    }
+
+    cpu->texture = SDL_CreateTexture(cpu->renderer, SDL_PIXELFORMAT_XRGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                     (int)pis->vk.drawExtent.width, (int)pis->vk.drawExtent.height);
+    if(cpu->texture == NULL)
+    {
+        fprintf(stderr, "Failed to create SDL texture: %s\n", SDL_GetError());
+        exit(-1);
+    }
+
+    if(PisCpuImageCreate(pis->vk.drawExtent.width, pis->vk.drawExtent.height, true, &cpu->image) != 0)
+        exit(-1);
+
+    if(PisJobPoolCreate(PisGetCoreCount(), &cpu->pool) != 0)
+        exit(-1);
+
+    cpu->isa = PisCpuBestIsa();
+
+    printf("Rendering %ux%u on %u CPU threads with %s\n", pis->vk.drawExtent.width, pis->vk.drawExtent.height,
+           cpu->pool.threadCount, PisCpuIsaName(cpu->isa));
+}
+
+void DrawCpu(PisEngine* pis)
+{
+    PisCpuRenderer* cpu = &pis->cpu;
+
+    PisCpuRenderTiles(&pis->voxelData, &pis->ubo, &cpu->pool, cpu->isa, &cpu->image);
+
+    SDL_UpdateTexture(cpu->texture, NULL, cpu->image.packed, (int)(cpu->image.width * sizeof(uint32_t)));
+    SDL_RenderTexture(cpu->renderer, cpu->texture, NULL, NULL);
+    SDL_RenderPresent(cpu->renderer);
+
+    pis->frameNumber++;
+}
+
+void CleanupCpuRenderer(PisEngine* pis)
+{
+    PisCpuRenderer* cpu = &pis->cpu;
+
+    DestroyPisJobPool(&cpu->pool);
+    DestroyPisCpuImage(cpu->image);
+
+    SDL_DestroyTexture(cpu->texture);
+    SDL_DestroyRenderer(cpu->renderer);
+
+    DestroyPisVoxScene(pis->voxelScene);
+
+    SDL_DestroyWindow(pis->window);
+    SDL_Quit();
+}
+
+void InitReadbackBuffer(PisEngine* pis)
+{
+    VkDeviceSize size = (VkDeviceSize)pis->vk.drawImage.extent.width * pis->vk.drawImage.extent.height * 4 * sizeof(uint16_t);
+
+    if(CreateBuffer(pis->vk.device, &pis->vk.allocator, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &pis->vk.readbackBuffer) != 0)
+    {
+        fprintf(stderr, "Failed to create the readback buffer\n");
+        exit(-1);
+    }
+}
+
+// Copies drawImage into the readback buffer, ready for the host once the frame's fence signals
+void RecordReadback(VkCommandBuffer cmd, PisEngine* pis)
+{
+    VkBufferImageCopy copyRegion = BufferImageCopyInfo(VK_IMAGE_ASPECT_COLOR_BIT, pis->vk.drawImage.extent);
+    vkCmdCopyImageToBuffer(cmd, pis->vk.drawImage.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           pis->vk.readbackBuffer.buffer, 1, &copyRegion);
+
+    VkBufferMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = pis->vk.readbackBuffer.buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE,
+    };
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                         0, NULL, 1, &barrier, 0, NULL);
+}
+
+// Only called once the frame's fence has signalled, so the results are there without waiting
+void CollectTimestamps(PisEngine* pis, FrameData* frame)
+{
+    if(!frame->timestampsPending)
+        return;
+
+    uint64_t timestamps[PIS_GPU_TIMESTAMP_COUNT];
+    VkResult result = vkGetQueryPoolResults(pis->vk.device, frame->timestampPool, 0, PIS_GPU_TIMESTAMP_COUNT,
+                                            sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    frame->timestampsPending = false;
+
+    if(result == VK_SUCCESS)
+        PisGpuTimingsAdd(&pis->vk.gpuTimings, timestamps);
+}
+
+void CollectRayStats(PisEngine* pis, FrameData* frame)
+{
+    if(!frame->rayStatsPending)
+        return;
+
+    memcpy(&pis->rayStats, frame->rayStats, sizeof(PisRayStats));
+    memset(frame->rayStats, 0, sizeof(PisRayStats));
+    frame->rayStatsPending = false;
+}
+
+// Timestamp index ends the pass before it and starts the pass with the same number
+void WriteTimestamp(VkCommandBuffer cmd, PisEngine* pis, FrameData* frame, uint32_t index)
+{
+    if(!pis->vk.gpuTimings.enabled)
+        return;
+
+    VkPipelineStageFlagBits stage = index == 0 ? VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    vkCmdWriteTimestamp(cmd, stage, frame->timestampPool, index);
+}
+
+float HalfToFloat(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half >> 15) << 31;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+
+    float value;
+    if(exponent == 0)
+        value = ldexpf((float)mantissa, -24);
+    else if(exponent == 31)
+        value = mantissa == 0 ? INFINITY : NAN;
+    else
+        value = ldexpf((float)(mantissa | 0x400), (int)exponent - 25);
+
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bits |= sign;
+    memcpy(&value, &bits, sizeof(bits));
+
+    return value;
+}
@@ -14,18 +14,41 @@
 #include "vulkan/buffers.h"
 
 #include "pisVoxReader.h"
+#include "voxReader.h"
+#include "pisOccupancy.h"
+#include "pisDistance.h"
+#include "pisCpuTracer.h"
+#include "pisJobs.h"
+#include "pisGpuTimings.h"
+#include "pisRayStats.h"
+#include "pisUniforms.h"
 
 #include "cglm/cglm.h"
 
-typedef struct UniformBufferObject {
-    vec3 position;  float _pad1;
-    vec3 forward;   float _pad2;
-    vec3 right;     float _pad3;
-    vec3 up;
-
-    float fov;
-    float time;
-} UniformBufferObject;
+// A .vox instance as the shader reads it. The rows map a scene position into the model,
+// w holds the translation. model holds the model size and its byte offset in the voxel buffer.
+typedef struct VoxelInstance {
+    vec4 rotation[3];
+    uint32_t model[4];
+} VoxelInstance;
+
+// How the voxel grid of a single volume is stored in the voxel buffer
+typedef enum PisVoxelLayout {
+    PIS_VOXEL_LAYOUT_DENSE = 0,
+    // A grid of pointers into a pool of 8^3 bricks, empty bricks are not stored
+    PIS_VOXEL_LAYOUT_BRICKMAP = 1,
+    // A sparse voxel octree, traced by its own compute pipeline (svo.spv)
+    PIS_VOXEL_LAYOUT_SVO = 2,
+    // The octree with identical subtrees merged and the materials in their own array (dag.spv)
+    PIS_VOXEL_LAYOUT_DAG = 3,
+    // Dense, with every material byte followed by its PisDistanceField distance, so rays can
+    // jump over the empty voxels around them. The only layout PisEngineUpdateVoxels can edit.
+    PIS_VOXEL_LAYOUT_DISTANCE = 4,
+    // Dense, in 4^3 voxel tiles of a cache line each, so rays along y and z read less memory
+    PIS_VOXEL_LAYOUT_TILED = 5,
+    // Dense, in a 3D R8_UINT storage image read through the texture cache (image.spv)
+    PIS_VOXEL_LAYOUT_IMAGE = 6,
+} PisVoxelLayout;
 
 typedef struct QueueFamilyIndices {
     uint32_t computeFamilyIndex;
@@ -38,6 +61,19 @@ typedef struct FrameData {
 
     VkSemaphore swapchainSemaphore, renderSemaphore;
     VkFence renderFence;
+
+    // This frame's slice of uboBuffer, only written once renderFence has signalled
+    VkDeviceSize uboOffset;
+    UniformBufferObject* ubo;
+
+    // PIS_GPU_TIMESTAMP_COUNT timestamps around the passes, read once renderFence has signalled
+    VkQueryPool timestampPool;
+    bool timestampsPending;
+
+    // This frame's slice of rayStatsBuffer, pending when the frame was drawn with a debug view
+    VkDeviceSize rayStatsOffset;
+    PisRayStats* rayStats;
+    bool rayStatsPending;
 } FrameData;
 
 typedef struct PisVulkanInstance {
@@ -68,14 +104,35 @@ typedef struct PisVulkanInstance {
     Buffer uboBuffer;
     Buffer voxelBuffer;
     Buffer paletteBuffer;
+    Buffer instanceBuffer;
+    Buffer occupancyBuffer;
+    // Only created for PIS_VOXEL_LAYOUT_IMAGE, bound at 6 while voxelBuffer is a placeholder
+    AllocatedImage voxelImage;
+    // Headless only, every frame's drawImage as RGBA16F for PisEngineSaveFrame
+    Buffer readbackBuffer;
+    // One PisRayStats per frame in flight at binding 7, picked with a dynamic offset like the ubo
+    Buffer rayStatsBuffer;
+
+    Allocator allocator;
 
     FrameData* frames;
 
+    PisGpuTimings gpuTimings;
+
     #ifdef DEBUG
     VkDebugUtilsMessengerEXT debugMessenger;
     #endif
 } PisVulkanInstance;
 
+// Everything PisEngineDraw needs when it traces on the CPU instead of Vulkan
+typedef struct PisCpuRenderer {
+    SDL_Renderer* renderer;
+    SDL_Texture* texture;
+    PisCpuImage image;
+    PisJobPool pool;
+    PisCpuIsa isa;
+} PisCpuRenderer;
+
 typedef struct PisEngine {
     SDL_Window* window;
     PisVulkanInstance vk;
@@ -83,7 +140,32 @@ typedef struct PisEngine {
     bool stopRendering;
     VkExtent2D windowExtent;
     char voxelFile[128];
+    // Upload voxel data through a staging buffer even on unified memory devices
+    bool forceStagingUpload;
+    // Grids too big for a dense storage buffer always become a brickmap
+    PisVoxelLayout voxelLayout;
     PisVox voxelData;
+    PisVoxScene voxelScene;
+    // Kept for PisEngineUpdateVoxels with PIS_VOXEL_LAYOUT_DISTANCE
+    PisDistanceField distanceField;
+    // Camera data for the next frame, copied into its uniform buffer slice by PisEngineDraw
+    UniformBufferObject ubo;
+    // Trace the dense grid on the CPU in 16x16 tiles and show it through an SDL texture, for
+    // machines without a usable GPU. No Vulkan object is created. Turned on by itself when
+    // there is no Vulkan loader.
+    bool cpuRendering;
+    PisCpuRenderer cpu;
+    // Render windowExtent sized frames without a window, surface or swapchain, e.g. on lavapipe
+    // on a server without a display. Frames are read back with PisEngineSaveFrame.
+    bool headless;
+    // Print a table of GPU pass times every PIS_GPU_TIMING_WINDOW frames, and write every frame's
+    // times to gpuTimingsFile when it is set
+    bool printGpuTimings;
+    char gpuTimingsFile[128];
+    // Anything but off has voxel.comp count its traversal steps, the counts of the last finished
+    // frame end up in rayStats. Ignored by the CPU renderer.
+    PisDebugView debugView;
+    PisRayStats rayStats;
 } PisEngine;
 
 void PisEngineInitialize(PisEngine* pis);
@@ -92,6 +174,16 @@ void PisEngineDraw(PisEngine* pis);
 
 void PisEngineCleanup(PisEngine* pis);
 
+// Blocks until the GPU has finished the last frame PisEngineDraw submitted
+void PisEngineWaitFrame(PisEngine* pis);
+
+// Waits for the last headless frame and writes it as a PNG, clamped like the swapchain would
+int PisEngineSaveFrame(PisEngine* pis, const char* fileName);
+
 void UpdateUniformBuffer(PisEngine* pis, UniformBufferObject ubo);
 
+// Uploads voxelData.voxels in min..max (exclusive) again after they were changed, along with
+// the distances that changed with them. Waits for the GPU to be idle.
+int PisEngineUpdateVoxels(PisEngine* pis, Size min, Size max);
+
 #endif
@@ -0,0 +1,134 @@
+#include "pisBrickmap.h"
+#include "pisJobs.h"
+#include "pisOccupancy.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct BrickmapBuild {
+    PisVox* pisV;
+    PisBrickmap* brickmap;
+} BrickmapBuild;
+
+/* =================================Helper functions================================ */
+void CopyBricksJob(void* userData, uint32_t jobIndex);
+bool BrickRange(Size size, uint32_t brick, uint32_t axis, uint32_t* start, uint32_t* end);
+/* ================================================================================ */
+
+int PisBrickmapBuild(PisVox* pisV, PisBrickmap* brickmap)
+{
+    memset(brickmap, 0, sizeof(PisBrickmap));
+
+    brickmap->gridSize = (Size){
+        (pisV->size.x + PIS_BRICK_SIZE - 1) / PIS_BRICK_SIZE,
+        (pisV->size.y + PIS_BRICK_SIZE - 1) / PIS_BRICK_SIZE,
+        (pisV->size.z + PIS_BRICK_SIZE - 1) / PIS_BRICK_SIZE,
+    };
+
+    size_t gridCount = (size_t)brickmap->gridSize.x * brickmap->gridSize.y * brickmap->gridSize.z;
+
+    brickmap->grid = calloc(gridCount ? gridCount : 1, sizeof(uint32_t));
+    if(brickmap->grid == NULL)
+    {
+        fprintf(stderr, "Failed to allocate brickmap grid\n");
+        return -1;
+    }
+
+    // First mark the solid bricks, a byte per brick
+    uint8_t* solid = calloc(gridCount ? gridCount : 1, 1);
+    if(solid == NULL)
+    {
+        fprintf(stderr, "Failed to allocate brickmap grid\n");
+        free(brickmap->grid);
+        return -1;
+    }
+
+    PisOccupancyMarkCells(pisV, PIS_BRICK_SIZE, brickmap->gridSize, solid);
+
+    // Then number them in grid order, so the pool keeps neighbouring bricks close together
+    for(size_t i = 0; i < gridCount; i++)
+    {
+        if(solid[i])
+            brickmap->grid[i] = ++brickmap->brickCount;
+    }
+
+    free(solid);
+
+    brickmap->bricks = malloc((size_t)(brickmap->brickCount ? brickmap->brickCount : 1) * PIS_BRICK_VOXELS);
+    if(brickmap->bricks == NULL)
+    {
+        fprintf(stderr, "Failed to allocate %u bricks\n", brickmap->brickCount);
+        free(brickmap->grid);
+        return -1;
+    }
+
+    BrickmapBuild build = {
+        .pisV = pisV,
+        .brickmap = brickmap,
+    };
+
+    PisJobsRun(CopyBricksJob, &build, brickmap->gridSize.z, PisGetCoreCount());
+
+    return 0;
+}
+
+void DestroyPisBrickmap(PisBrickmap brickmap)
+{
+    free(brickmap.grid);
+    free(brickmap.bricks);
+}
+
+void CopyBricksJob(void* userData, uint32_t jobIndex)
+{
+    BrickmapBuild* build = userData;
+    PisVox* pisV = build->pisV;
+    PisBrickmap* brickmap = build->brickmap;
+    Size grid = brickmap->gridSize;
+
+    uint32_t zStart, zEnd;
+    BrickRange(pisV->size, jobIndex, 2, &zStart, &zEnd);
+
+    for(uint32_t by = 0; by < grid.y; by++)
+    {
+        for(uint32_t bx = 0; bx < grid.x; bx++)
+        {
+            uint32_t entry = brickmap->grid[((size_t)jobIndex * grid.y + by) * grid.x + bx];
+            if(entry == 0)
+                continue;
+
+            uint8_t* brick = brickmap->bricks + (size_t)(entry - 1) * PIS_BRICK_VOXELS;
+
+            // Bricks on the far edges of the volume are only partly inside it, the rest stays air
+            uint32_t xStart, xEnd, yStart, yEnd;
+            bool partial = BrickRange(pisV->size, bx, 0, &xStart, &xEnd) | BrickRange(pisV->size, by, 1, &yStart, &yEnd)
+                         | (zEnd - zStart != PIS_BRICK_SIZE);
+
+            if(partial)
+                memset(brick, 0, PIS_BRICK_VOXELS);
+
+            for(uint32_t z = zStart; z < zEnd; z++)
+            {
+                for(uint32_t y = yStart; y < yEnd; y++)
+                {
+                    const uint8_t* src = pisV->voxels + ((size_t)z * pisV->size.y + y) * pisV->size.x + xStart;
+                    uint8_t* dst = brick + ((z - zStart) * PIS_BRICK_SIZE + (y - yStart)) * PIS_BRICK_SIZE;
+
+                    memcpy(dst, src, xEnd - xStart);
+                }
+            }
+        }
+    }
+}
+
+// Voxel range of a brick along axis, returns true when the brick sticks out of the volume
+bool BrickRange(Size size, uint32_t brick, uint32_t axis, uint32_t* start, uint32_t* end)
+{
+    uint32_t extent = axis == 0 ? size.x : (axis == 1 ? size.y : size.z);
+
+    *start = brick * PIS_BRICK_SIZE;
+    *end = *start + PIS_BRICK_SIZE < extent ? *start + PIS_BRICK_SIZE : extent;
+
+    return *end - *start != PIS_BRICK_SIZE;
+}
@@ -0,0 +1,25 @@
+#ifndef PIS_BRICKMAP_H
+#define PIS_BRICKMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pisVoxReader.h"
+
+// Edge of a brick in voxels, voxel.comp has to use the same value
+#define PIS_BRICK_SIZE 8
+#define PIS_BRICK_VOXELS (PIS_BRICK_SIZE * PIS_BRICK_SIZE * PIS_BRICK_SIZE)
+
+// A coarse grid with one entry per brick, 0 for an empty brick or the brick index + 1.
+// Only bricks holding a solid voxel are stored, each as PIS_BRICK_VOXELS bytes running x, y, z.
+typedef struct PisBrickmap {
+    Size gridSize;
+    uint32_t* grid;
+    uint8_t* bricks;
+    uint32_t brickCount;
+} PisBrickmap;
+
+int PisBrickmapBuild(PisVox* pisV, PisBrickmap* brickmap);
+void DestroyPisBrickmap(PisBrickmap brickmap);
+
+#endif
@@ -0,0 +1,199 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pisCameraPath.h"
+
+/* =================================Helper functions================================ */
+float CatmullRom(float p0, float p1, float p2, float p3, float t);
+/* ================================================================================ */
+
+int PisCameraPathLoad(const char* fileName, PisCameraPath* path)
+{
+    FILE* file = fopen(fileName, "r");
+    if(file == NULL)
+    {
+        fprintf(stderr, "Failed to open camera path: %s\n", fileName);
+        return -1;
+    }
+
+    uint32_t capacity = 16;
+    path->keyCount = 0;
+    path->keys = malloc(capacity * sizeof(PisCameraKey));
+    if(path->keys == NULL)
+    {
+        fprintf(stderr, "Failed to allocate\n");
+        fclose(file);
+        return -1;
+    }
+
+    char line[256];
+    uint32_t lineNumber = 0;
+    while(fgets(line, sizeof(line), file) != NULL)
+    {
+        lineNumber++;
+
+        char* text = line;
+        while(*text == ' ' || *text == '\t')
+            text++;
+
+        if(*text == '#' || *text == '\n' || *text == '\r' || *text == '\0')
+            continue;
+
+        PisCameraKey key;
+        if(sscanf(text, "%f %f %f %f %f %f", &key.position[0], &key.position[1], &key.position[2],
+                  &key.yaw, &key.pitch, &key.fov) != 6)
+        {
+            fprintf(stderr, "%s:%u: a key has to look like \"x y z yaw pitch fov\"\n", fileName, lineNumber);
+            DestroyPisCameraPath(*path);
+            fclose(file);
+            return -1;
+        }
+
+        if(path->keyCount == capacity)
+        {
+            capacity *= 2;
+            PisCameraKey* keys = realloc(path->keys, capacity * sizeof(PisCameraKey));
+            if(keys == NULL)
+            {
+                fprintf(stderr, "Failed to allocate\n");
+                DestroyPisCameraPath(*path);
+                fclose(file);
+                return -1;
+            }
+            path->keys = keys;
+        }
+
+        path->keys[path->keyCount++] = key;
+    }
+
+    fclose(file);
+
+    if(path->keyCount < 2)
+    {
+        fprintf(stderr, "A camera path needs at least two keys: %s\n", fileName);
+        DestroyPisCameraPath(*path);
+        return -1;
+    }
+
+    return 0;
+}
+
+int PisCameraPathAppend(const char* fileName, PisCameraKey key)
+{
+    FILE* file = fopen(fileName, "a");
+    if(file == NULL)
+    {
+        fprintf(stderr, "Failed to open camera path: %s\n", fileName);
+        return -1;
+    }
+
+    // %.9g keeps every float exact, a replay sees the same camera that was recorded
+    fprintf(file, "%.9g %.9g %.9g %.9g %.9g %.9g\n", key.position[0], key.position[1], key.position[2],
+            key.yaw, key.pitch, key.fov);
+
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+PisCameraPath PisCameraPathOrbit(Size worldSize, uint32_t keyCount)
+{
+    PisCameraPath path = {0};
+    if(keyCount < 2)
+        keyCount = 2;
+
+    path.keys = malloc(keyCount * sizeof(PisCameraKey));
+    if(path.keys == NULL)
+    {
+        fprintf(stderr, "Failed to allocate\n");
+        return path;
+    }
+    path.keyCount = keyCount;
+
+    vec3 center = { worldSize.x / 2.f, worldSize.y / 2.f, worldSize.z / 2.f };
+    float radius = 0.75f * (float)(worldSize.x > worldSize.z ? worldSize.x : worldSize.z);
+
+    // The last key is the first one again, so the path closes
+    for(uint32_t i = 0; i < keyCount; i++)
+    {
+        float angle = 2.f * GLM_PIf * i / (keyCount - 1);
+
+        PisCameraKey* key = &path.keys[i];
+        key->position[0] = center[0] - sinf(angle) * radius;
+        key->position[1] = center[1] + worldSize.y * 0.25f;
+        key->position[2] = center[2] - cosf(angle) * radius;
+        key->fov = 90.f;
+
+        vec3 toCenter;
+        glm_vec3_sub(center, key->position, toCenter);
+        glm_normalize(toCenter);
+
+        key->yaw = atan2f(toCenter[0], toCenter[2]);
+        key->pitch = asinf(toCenter[1]);
+
+        // Keep the yaw continuous, otherwise the spline turns the long way round at +-pi
+        if(i > 0)
+        {
+            float previous = path.keys[i - 1].yaw;
+            while(key->yaw - previous > GLM_PIf)
+                key->yaw -= 2.f * GLM_PIf;
+            while(key->yaw - previous < -GLM_PIf)
+                key->yaw += 2.f * GLM_PIf;
+        }
+    }
+
+    return path;
+}
+
+void PisCameraPathSample(PisCameraPath* path, float t, UniformBufferObject* ubo)
+{
+    uint32_t segmentCount = path->keyCount - 1;
+
+    t = glm_clamp(t, 0.f, 1.f) * segmentCount;
+    uint32_t segment = (uint32_t)t;
+    if(segment >= segmentCount)
+        segment = segmentCount - 1;
+    float local = t - segment;
+
+    // The end keys are repeated, the spline still starts and ends on them
+    PisCameraKey* k0 = &path->keys[segment > 0 ? segment - 1 : 0];
+    PisCameraKey* k1 = &path->keys[segment];
+    PisCameraKey* k2 = &path->keys[segment + 1];
+    PisCameraKey* k3 = &path->keys[segment + 2 < path->keyCount ? segment + 2 : segment + 1];
+
+    for(int i = 0; i < 3; i++)
+        ubo->position[i] = CatmullRom(k0->position[i], k1->position[i], k2->position[i], k3->position[i], local);
+
+    float yaw = CatmullRom(k0->yaw, k1->yaw, k2->yaw, k3->yaw, local);
+    float pitch = CatmullRom(k0->pitch, k1->pitch, k2->pitch, k3->pitch, local);
+    ubo->fov = CatmullRom(k0->fov, k1->fov, k2->fov, k3->fov, local);
+
+    PisCameraLook(yaw, pitch, ubo);
+}
+
+void PisCameraLook(float yaw, float pitch, UniformBufferObject* ubo)
+{
+    ubo->forward[0] = cos(pitch) * sin(yaw);
+    ubo->forward[1] = sin(pitch);
+    ubo->forward[2] = cos(pitch) * cos(yaw);
+    glm_normalize(ubo->forward);
+
+    glm_cross(ubo->forward, (vec3){0, 1, 0}, ubo->right);
+    glm_normalize(ubo->right);
+
+    glm_cross(ubo->right, ubo->forward, ubo->up);
+}
+
+void DestroyPisCameraPath(PisCameraPath path)
+{
+    free(path.keys);
+}
+
+float CatmullRom(float p0, float p1, float p2, float p3, float t)
+{
+    float t2 = t * t;
+    float t3 = t2 * t;
+
+    return 0.5f * (2.f * p1 + (p2 - p0) * t + (2.f * p0 - 5.f * p1 + 4.f * p2 - p3) * t2
+                 + (3.f * p1 - p0 - 3.f * p2 + p3) * t3);
+}
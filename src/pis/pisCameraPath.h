@@ -0,0 +1,41 @@
+#ifndef PIS_CAMERA_PATH_H
+#define PIS_CAMERA_PATH_H
+
+#include <stdint.h>
+
+#include "pisUniforms.h"
+
+// A camera the way main.c steers it, yaw and pitch in radians and fov in degrees
+typedef struct PisCameraKey {
+    vec3 position;
+    float yaw;
+    float pitch;
+    float fov;
+} PisCameraKey;
+
+// A Catmull-Rom spline through the keys, which it passes through in order
+typedef struct PisCameraPath {
+    PisCameraKey* keys;
+    uint32_t keyCount;
+} PisCameraPath;
+
+// One key per line as "x y z yaw pitch fov", lines starting with # are skipped.
+// Returns 0 on success, a path needs at least two keys.
+int PisCameraPathLoad(const char* fileName, PisCameraPath* path);
+
+// Adds one key to the end of a path file, main.c records keys this way
+int PisCameraPathAppend(const char* fileName, PisCameraKey key);
+
+// The default path, keyCount keys on a circle around the middle of the world looking inwards
+PisCameraPath PisCameraPathOrbit(Size worldSize, uint32_t keyCount);
+
+// Writes the camera at t, 0 is the first key and 1 the last, into position, forward, right,
+// up and fov of the ubo. Nothing else in the ubo changes.
+void PisCameraPathSample(PisCameraPath* path, float t, UniformBufferObject* ubo);
+
+// The forward, right and up vectors main.c builds from the mouse angles
+void PisCameraLook(float yaw, float pitch, UniformBufferObject* ubo);
+
+void DestroyPisCameraPath(PisCameraPath path);
+
+#endif
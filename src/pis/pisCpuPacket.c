@@ -0,0 +1,418 @@
+#include "pisCpuPacket.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define PIS_CPU_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define PIS_CPU_NEON
+#include <arm_neon.h>
+#endif
+
+// Same value as voxel.comp
+#define CPU_MAX_STEPS 512
+
+// Lanes as plain arrays, what the kernels load from and store to
+typedef struct PacketLanes {
+    int32_t index[PIS_CPU_PACKET_MAX];
+    int32_t indexStep[3][PIS_CPU_PACKET_MAX];
+    uint32_t fetched[PIS_CPU_PACKET_MAX];
+    uint32_t material[PIS_CPU_PACKET_MAX];
+    uint32_t mask[3][PIS_CPU_PACKET_MAX];
+} PacketLanes;
+
+/* =================================Helper functions================================ */
+void LoadPacketLanes(PisVox* pisV, PisCpuPacket* packet, PacketLanes* lanes);
+void StorePacketLanes(PisCpuPacket* packet, PacketLanes* lanes);
+void FetchPacketLanes(PisVox* pisV, PacketLanes* lanes, uint32_t activeBits);
+
+#ifdef PIS_CPU_X86
+void TracePacketSse2(PisVox* pisV, PisCpuPacket* packet);
+__attribute__((target("avx2"))) void TracePacketAvx2(PisVox* pisV, PisCpuPacket* packet);
+#endif
+
+#ifdef PIS_CPU_NEON
+void TracePacketNeon(PisVox* pisV, PisCpuPacket* packet);
+#endif
+/* ================================================================================ */
+
+bool PisCpuIsaSupported(PisCpuIsa isa)
+{
+    switch(isa)
+    {
+        case PIS_CPU_ISA_SCALAR:
+            return true;
+#ifdef PIS_CPU_X86
+        // Part of x86-64 itself
+        case PIS_CPU_ISA_SSE2:
+            return true;
+        case PIS_CPU_ISA_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+#ifdef PIS_CPU_NEON
+        // Part of aarch64 itself
+        case PIS_CPU_ISA_NEON:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+PisCpuIsa PisCpuBestIsa(void)
+{
+    PisCpuIsa best = PIS_CPU_ISA_SCALAR;
+    for(uint32_t isa = 0; isa < PIS_CPU_ISA_COUNT; isa++)
+    {
+        if(PisCpuIsaSupported((PisCpuIsa)isa) && PisCpuIsaWidth((PisCpuIsa)isa) > PisCpuIsaWidth(best))
+            best = (PisCpuIsa)isa;
+    }
+
+    return best;
+}
+
+const char* PisCpuIsaName(PisCpuIsa isa)
+{
+    switch(isa)
+    {
+        case PIS_CPU_ISA_SCALAR: return "scalar";
+        case PIS_CPU_ISA_SSE2: return "sse2";
+        case PIS_CPU_ISA_AVX2: return "avx2";
+        case PIS_CPU_ISA_NEON: return "neon";
+        default: return "unknown";
+    }
+}
+
+uint32_t PisCpuIsaWidth(PisCpuIsa isa)
+{
+    switch(isa)
+    {
+        case PIS_CPU_ISA_SSE2: return 4;
+        case PIS_CPU_ISA_AVX2: return 8;
+        case PIS_CPU_ISA_NEON: return 4;
+        default: return 1;
+    }
+}
+
+PisCpuPacketTrace PisCpuPacketTraceFor(PisCpuIsa isa)
+{
+    if(!PisCpuIsaSupported(isa))
+        return NULL;
+
+    switch(isa)
+    {
+#ifdef PIS_CPU_X86
+        case PIS_CPU_ISA_SSE2: return TracePacketSse2;
+        case PIS_CPU_ISA_AVX2: return TracePacketAvx2;
+#endif
+#ifdef PIS_CPU_NEON
+        case PIS_CPU_ISA_NEON: return TracePacketNeon;
+#endif
+        default: return NULL;
+    }
+}
+
+// The voxel index is stepped along with the voxel, so a fetch needs no multiplies. Callers keep
+// the volume below 2^31 voxels for it to fit.
+void LoadPacketLanes(PisVox* pisV, PisCpuPacket* packet, PacketLanes* lanes)
+{
+    int32_t strides[3] = { 1, (int32_t)pisV->size.x, (int32_t)(pisV->size.x * pisV->size.y) };
+
+    memset(lanes, 0, sizeof(PacketLanes));
+    for(uint32_t l = 0; l < packet->count; l++)
+    {
+        for(int a = 0; a < 3; a++)
+        {
+            lanes->index[l] += packet->voxel[a][l] * strides[a];
+            lanes->indexStep[a][l] = packet->step[a][l] * strides[a];
+        }
+    }
+}
+
+void StorePacketLanes(PisCpuPacket* packet, PacketLanes* lanes)
+{
+    for(uint32_t l = 0; l < packet->count; l++)
+    {
+        packet->material[l] = lanes->material[l];
+        for(int a = 0; a < 3; a++)
+            packet->mask[a][l] = lanes->mask[a][l] != 0;
+    }
+}
+
+// None of the instruction sets gathers bytes, so the lanes still inside are fetched one by one
+void FetchPacketLanes(PisVox* pisV, PacketLanes* lanes, uint32_t activeBits)
+{
+    for(uint32_t l = 0; l < PIS_CPU_PACKET_MAX; l++)
+        lanes->fetched[l] = (activeBits >> l) & 1 ? pisV->voxels[lanes->index[l]] : 0;
+}
+
+#ifdef PIS_CPU_X86
+
+void TracePacketSse2(PisVox* pisV, PisCpuPacket* packet)
+{
+    PacketLanes lanes;
+    LoadPacketLanes(pisV, packet, &lanes);
+
+    __m128i voxelX = _mm_loadu_si128((const __m128i*)packet->voxel[0]);
+    __m128i voxelY = _mm_loadu_si128((const __m128i*)packet->voxel[1]);
+    __m128i voxelZ = _mm_loadu_si128((const __m128i*)packet->voxel[2]);
+    __m128i stepX = _mm_loadu_si128((const __m128i*)packet->step[0]);
+    __m128i stepY = _mm_loadu_si128((const __m128i*)packet->step[1]);
+    __m128i stepZ = _mm_loadu_si128((const __m128i*)packet->step[2]);
+    __m128 sideX = _mm_loadu_ps(packet->sideDist[0]);
+    __m128 sideY = _mm_loadu_ps(packet->sideDist[1]);
+    __m128 sideZ = _mm_loadu_ps(packet->sideDist[2]);
+    __m128 deltaX = _mm_loadu_ps(packet->tDelta[0]);
+    __m128 deltaY = _mm_loadu_ps(packet->tDelta[1]);
+    __m128 deltaZ = _mm_loadu_ps(packet->tDelta[2]);
+    __m128i index = _mm_loadu_si128((const __m128i*)lanes.index);
+    __m128i indexStepX = _mm_loadu_si128((const __m128i*)lanes.indexStep[0]);
+    __m128i indexStepY = _mm_loadu_si128((const __m128i*)lanes.indexStep[1]);
+    __m128i indexStepZ = _mm_loadu_si128((const __m128i*)lanes.indexStep[2]);
+
+    __m128i sizeX = _mm_set1_epi32((int32_t)pisV->size.x);
+    __m128i sizeY = _mm_set1_epi32((int32_t)pisV->size.y);
+    __m128i sizeZ = _mm_set1_epi32((int32_t)pisV->size.z);
+    __m128i minusOne = _mm_set1_epi32(-1);
+    __m128i zero = _mm_setzero_si128();
+
+    __m128i active = _mm_cmplt_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32((int32_t)packet->count));
+    __m128i material = zero;
+    __m128i maskX = zero, maskY = zero, maskZ = zero;
+
+    for(uint32_t i = 0; i < CPU_MAX_STEPS; i++)
+    {
+        __m128i inside = _mm_and_si128(_mm_cmpgt_epi32(voxelX, minusOne), _mm_cmplt_epi32(voxelX, sizeX));
+        inside = _mm_and_si128(inside, _mm_and_si128(_mm_cmpgt_epi32(voxelY, minusOne), _mm_cmplt_epi32(voxelY, sizeY)));
+        inside = _mm_and_si128(inside, _mm_and_si128(_mm_cmpgt_epi32(voxelZ, minusOne), _mm_cmplt_epi32(voxelZ, sizeZ)));
+
+        active = _mm_and_si128(active, inside);
+        uint32_t activeBits = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(active));
+        if(activeBits == 0)
+            break;
+
+        _mm_storeu_si128((__m128i*)lanes.index, index);
+        FetchPacketLanes(pisV, &lanes, activeBits);
+        __m128i fetched = _mm_loadu_si128((const __m128i*)lanes.fetched);
+
+        // A lane only hits once, after that it is no longer active
+        __m128i hit = _mm_andnot_si128(_mm_cmpeq_epi32(fetched, zero), active);
+        material = _mm_or_si128(material, _mm_and_si128(hit, fetched));
+        active = _mm_andnot_si128(hit, active);
+        if(_mm_movemask_ps(_mm_castsi128_ps(active)) == 0)
+            break;
+
+        // lessThanEqual(sideDist.xyz, min(sideDist.yzx, sideDist.zxy))
+        __m128i stepMaskX = _mm_and_si128(active, _mm_castps_si128(_mm_cmple_ps(sideX, _mm_min_ps(sideY, sideZ))));
+        __m128i stepMaskY = _mm_and_si128(active, _mm_castps_si128(_mm_cmple_ps(sideY, _mm_min_ps(sideZ, sideX))));
+        __m128i stepMaskZ = _mm_and_si128(active, _mm_castps_si128(_mm_cmple_ps(sideZ, _mm_min_ps(sideX, sideY))));
+
+        // Stopped lanes keep the mask of their last step for resolveHit
+        maskX = _mm_or_si128(_mm_andnot_si128(active, maskX), stepMaskX);
+        maskY = _mm_or_si128(_mm_andnot_si128(active, maskY), stepMaskY);
+        maskZ = _mm_or_si128(_mm_andnot_si128(active, maskZ), stepMaskZ);
+
+        sideX = _mm_add_ps(sideX, _mm_and_ps(_mm_castsi128_ps(stepMaskX), deltaX));
+        sideY = _mm_add_ps(sideY, _mm_and_ps(_mm_castsi128_ps(stepMaskY), deltaY));
+        sideZ = _mm_add_ps(sideZ, _mm_and_ps(_mm_castsi128_ps(stepMaskZ), deltaZ));
+
+        voxelX = _mm_add_epi32(voxelX, _mm_and_si128(stepMaskX, stepX));
+        voxelY = _mm_add_epi32(voxelY, _mm_and_si128(stepMaskY, stepY));
+        voxelZ = _mm_add_epi32(voxelZ, _mm_and_si128(stepMaskZ, stepZ));
+
+        index = _mm_add_epi32(index, _mm_and_si128(stepMaskX, indexStepX));
+        index = _mm_add_epi32(index, _mm_and_si128(stepMaskY, indexStepY));
+        index = _mm_add_epi32(index, _mm_and_si128(stepMaskZ, indexStepZ));
+    }
+
+    _mm_storeu_ps(packet->sideDist[0], sideX);
+    _mm_storeu_ps(packet->sideDist[1], sideY);
+    _mm_storeu_ps(packet->sideDist[2], sideZ);
+    _mm_storeu_si128((__m128i*)lanes.material, material);
+    _mm_storeu_si128((__m128i*)lanes.mask[0], maskX);
+    _mm_storeu_si128((__m128i*)lanes.mask[1], maskY);
+    _mm_storeu_si128((__m128i*)lanes.mask[2], maskZ);
+
+    StorePacketLanes(packet, &lanes);
+}
+
+__attribute__((target("avx2"))) void TracePacketAvx2(PisVox* pisV, PisCpuPacket* packet)
+{
+    PacketLanes lanes;
+    LoadPacketLanes(pisV, packet, &lanes);
+
+    __m256i voxelX = _mm256_loadu_si256((const __m256i*)packet->voxel[0]);
+    __m256i voxelY = _mm256_loadu_si256((const __m256i*)packet->voxel[1]);
+    __m256i voxelZ = _mm256_loadu_si256((const __m256i*)packet->voxel[2]);
+    __m256i stepX = _mm256_loadu_si256((const __m256i*)packet->step[0]);
+    __m256i stepY = _mm256_loadu_si256((const __m256i*)packet->step[1]);
+    __m256i stepZ = _mm256_loadu_si256((const __m256i*)packet->step[2]);
+    __m256 sideX = _mm256_loadu_ps(packet->sideDist[0]);
+    __m256 sideY = _mm256_loadu_ps(packet->sideDist[1]);
+    __m256 sideZ = _mm256_loadu_ps(packet->sideDist[2]);
+    __m256 deltaX = _mm256_loadu_ps(packet->tDelta[0]);
+    __m256 deltaY = _mm256_loadu_ps(packet->tDelta[1]);
+    __m256 deltaZ = _mm256_loadu_ps(packet->tDelta[2]);
+    __m256i index = _mm256_loadu_si256((const __m256i*)lanes.index);
+    __m256i indexStepX = _mm256_loadu_si256((const __m256i*)lanes.indexStep[0]);
+    __m256i indexStepY = _mm256_loadu_si256((const __m256i*)lanes.indexStep[1]);
+    __m256i indexStepZ = _mm256_loadu_si256((const __m256i*)lanes.indexStep[2]);
+
+    __m256i sizeX = _mm256_set1_epi32((int32_t)pisV->size.x);
+    __m256i sizeY = _mm256_set1_epi32((int32_t)pisV->size.y);
+    __m256i sizeZ = _mm256_set1_epi32((int32_t)pisV->size.z);
+    __m256i minusOne = _mm256_set1_epi32(-1);
+    __m256i zero = _mm256_setzero_si256();
+
+    __m256i active = _mm256_cmpgt_epi32(_mm256_set1_epi32((int32_t)packet->count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256i material = zero;
+    __m256i maskX = zero, maskY = zero, maskZ = zero;
+
+    for(uint32_t i = 0; i < CPU_MAX_STEPS; i++)
+    {
+        __m256i inside = _mm256_and_si256(_mm256_cmpgt_epi32(voxelX, minusOne), _mm256_cmpgt_epi32(sizeX, voxelX));
+        inside = _mm256_and_si256(inside, _mm256_and_si256(_mm256_cmpgt_epi32(voxelY, minusOne), _mm256_cmpgt_epi32(sizeY, voxelY)));
+        inside = _mm256_and_si256(inside, _mm256_and_si256(_mm256_cmpgt_epi32(voxelZ, minusOne), _mm256_cmpgt_epi32(sizeZ, voxelZ)));
+
+        active = _mm256_and_si256(active, inside);
+        uint32_t activeBits = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(active));
+        if(activeBits == 0)
+            break;
+
+        _mm256_storeu_si256((__m256i*)lanes.index, index);
+        FetchPacketLanes(pisV, &lanes, activeBits);
+        __m256i fetched = _mm256_loadu_si256((const __m256i*)lanes.fetched);
+
+        __m256i hit = _mm256_andnot_si256(_mm256_cmpeq_epi32(fetched, zero), active);
+        material = _mm256_or_si256(material, _mm256_and_si256(hit, fetched));
+        active = _mm256_andnot_si256(hit, active);
+        if(_mm256_movemask_ps(_mm256_castsi256_ps(active)) == 0)
+            break;
+
+        __m256i stepMaskX = _mm256_and_si256(active, _mm256_castps_si256(_mm256_cmp_ps(sideX, _mm256_min_ps(sideY, sideZ), _CMP_LE_OQ)));
+        __m256i stepMaskY = _mm256_and_si256(active, _mm256_castps_si256(_mm256_cmp_ps(sideY, _mm256_min_ps(sideZ, sideX), _CMP_LE_OQ)));
+        __m256i stepMaskZ = _mm256_and_si256(active, _mm256_castps_si256(_mm256_cmp_ps(sideZ, _mm256_min_ps(sideX, sideY), _CMP_LE_OQ)));
+
+        maskX = _mm256_or_si256(_mm256_andnot_si256(active, maskX), stepMaskX);
+        maskY = _mm256_or_si256(_mm256_andnot_si256(active, maskY), stepMaskY);
+        maskZ = _mm256_or_si256(_mm256_andnot_si256(active, maskZ), stepMaskZ);
+
+        sideX = _mm256_add_ps(sideX, _mm256_and_ps(_mm256_castsi256_ps(stepMaskX), deltaX));
+        sideY = _mm256_add_ps(sideY, _mm256_and_ps(_mm256_castsi256_ps(stepMaskY), deltaY));
+        sideZ = _mm256_add_ps(sideZ, _mm256_and_ps(_mm256_castsi256_ps(stepMaskZ), deltaZ));
+
+        voxelX = _mm256_add_epi32(voxelX, _mm256_and_si256(stepMaskX, stepX));
+        voxelY = _mm256_add_epi32(voxelY, _mm256_and_si256(stepMaskY, stepY));
+        voxelZ = _mm256_add_epi32(voxelZ, _mm256_and_si256(stepMaskZ, stepZ));
+
+        index = _mm256_add_epi32(index, _mm256_and_si256(stepMaskX, indexStepX));
+        index = _mm256_add_epi32(index, _mm256_and_si256(stepMaskY, indexStepY));
+        index = _mm256_add_epi32(index, _mm256_and_si256(stepMaskZ, indexStepZ));
+    }
+
+    _mm256_storeu_ps(packet->sideDist[0], sideX);
+    _mm256_storeu_ps(packet->sideDist[1], sideY);
+    _mm256_storeu_ps(packet->sideDist[2], sideZ);
+    _mm256_storeu_si256((__m256i*)lanes.material, material);
+    _mm256_storeu_si256((__m256i*)lanes.mask[0], maskX);
+    _mm256_storeu_si256((__m256i*)lanes.mask[1], maskY);
+    _mm256_storeu_si256((__m256i*)lanes.mask[2], maskZ);
+
+    StorePacketLanes(packet, &lanes);
+}
+
+#endif
+
+#ifdef PIS_CPU_NEON
+
+void TracePacketNeon(PisVox* pisV, PisCpuPacket* packet)
+{
+    PacketLanes lanes;
+    LoadPacketLanes(pisV, packet, &lanes);
+
+    int32x4_t voxelX = vld1q_s32(packet->voxel[0]);
+    int32x4_t voxelY = vld1q_s32(packet->voxel[1]);
+    int32x4_t voxelZ = vld1q_s32(packet->voxel[2]);
+    int32x4_t stepX = vld1q_s32(packet->step[0]);
+    int32x4_t stepY = vld1q_s32(packet->step[1]);
+    int32x4_t stepZ = vld1q_s32(packet->step[2]);
+    float32x4_t sideX = vld1q_f32(packet->sideDist[0]);
+    float32x4_t sideY = vld1q_f32(packet->sideDist[1]);
+    float32x4_t sideZ = vld1q_f32(packet->sideDist[2]);
+    float32x4_t deltaX = vld1q_f32(packet->tDelta[0]);
+    float32x4_t deltaY = vld1q_f32(packet->tDelta[1]);
+    float32x4_t deltaZ = vld1q_f32(packet->tDelta[2]);
+    int32x4_t index = vld1q_s32(lanes.index);
+    int32x4_t indexStepX = vld1q_s32(lanes.indexStep[0]);
+    int32x4_t indexStepY = vld1q_s32(lanes.indexStep[1]);
+    int32x4_t indexStepZ = vld1q_s32(lanes.indexStep[2]);
+
+    int32x4_t sizeX = vdupq_n_s32((int32_t)pisV->size.x);
+    int32x4_t sizeY = vdupq_n_s32((int32_t)pisV->size.y);
+    int32x4_t sizeZ = vdupq_n_s32((int32_t)pisV->size.z);
+    int32x4_t zero = vdupq_n_s32(0);
+
+    const uint32_t laneIds[4] = { 0, 1, 2, 3 };
+    const uint32_t laneBits[4] = { 1, 2, 4, 8 };
+    uint32x4_t bits = vld1q_u32(laneBits);
+
+    uint32x4_t active = vcltq_u32(vld1q_u32(laneIds), vdupq_n_u32(packet->count));
+    uint32x4_t material = vdupq_n_u32(0);
+    uint32x4_t maskX = material, maskY = material, maskZ = material;
+
+    for(uint32_t i = 0; i < CPU_MAX_STEPS; i++)
+    {
+        uint32x4_t inside = vandq_u32(vcgeq_s32(voxelX, zero), vcltq_s32(voxelX, sizeX));
+        inside = vandq_u32(inside, vandq_u32(vcgeq_s32(voxelY, zero), vcltq_s32(voxelY, sizeY)));
+        inside = vandq_u32(inside, vandq_u32(vcgeq_s32(voxelZ, zero), vcltq_s32(voxelZ, sizeZ)));
+
+        active = vandq_u32(active, inside);
+        uint32_t activeBits = vaddvq_u32(vandq_u32(active, bits));
+        if(activeBits == 0)
+            break;
+
+        vst1q_s32(lanes.index, index);
+        FetchPacketLanes(pisV, &lanes, activeBits);
+        uint32x4_t fetched = vld1q_u32(lanes.fetched);
+
+        uint32x4_t hit = vandq_u32(vtstq_u32(fetched, fetched), active);
+        material = vorrq_u32(material, vandq_u32(hit, fetched));
+        active = vbicq_u32(active, hit);
+        if(vmaxvq_u32(active) == 0)
+            break;
+
+        uint32x4_t stepMaskX = vandq_u32(active, vcleq_f32(sideX, vminq_f32(sideY, sideZ)));
+        uint32x4_t stepMaskY = vandq_u32(active, vcleq_f32(sideY, vminq_f32(sideZ, sideX)));
+        uint32x4_t stepMaskZ = vandq_u32(active, vcleq_f32(sideZ, vminq_f32(sideX, sideY)));
+
+        maskX = vorrq_u32(vbicq_u32(maskX, active), stepMaskX);
+        maskY = vorrq_u32(vbicq_u32(maskY, active), stepMaskY);
+        maskZ = vorrq_u32(vbicq_u32(maskZ, active), stepMaskZ);
+
+        sideX = vaddq_f32(sideX, vreinterpretq_f32_u32(vandq_u32(stepMaskX, vreinterpretq_u32_f32(deltaX))));
+        sideY = vaddq_f32(sideY, vreinterpretq_f32_u32(vandq_u32(stepMaskY, vreinterpretq_u32_f32(deltaY))));
+        sideZ = vaddq_f32(sideZ, vreinterpretq_f32_u32(vandq_u32(stepMaskZ, vreinterpretq_u32_f32(deltaZ))));
+
+        voxelX = vaddq_s32(voxelX, vandq_s32(vreinterpretq_s32_u32(stepMaskX), stepX));
+        voxelY = vaddq_s32(voxelY, vandq_s32(vreinterpretq_s32_u32(stepMaskY), stepY));
+        voxelZ = vaddq_s32(voxelZ, vandq_s32(vreinterpretq_s32_u32(stepMaskZ), stepZ));
+
+        index = vaddq_s32(index, vandq_s32(vreinterpretq_s32_u32(stepMaskX), indexStepX));
+        index = vaddq_s32(index, vandq_s32(vreinterpretq_s32_u32(stepMaskY), indexStepY));
+        index = vaddq_s32(index, vandq_s32(vreinterpretq_s32_u32(stepMaskZ), indexStepZ));
+    }
+
+    vst1q_f32(packet->sideDist[0], sideX);
+    vst1q_f32(packet->sideDist[1], sideY);
+    vst1q_f32(packet->sideDist[2], sideZ);
+    vst1q_u32(lanes.material, material);
+    vst1q_u32(lanes.mask[0], maskX);
+    vst1q_u32(lanes.mask[1], maskY);
+    vst1q_u32(lanes.mask[2], maskZ);
+
+    StorePacketLanes(packet, &lanes);
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef PIS_CPU_PACKET_H
+#define PIS_CPU_PACKET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pisVoxReader.h"
+
+// Widest packet of any instruction set, AVX2 runs 8 rays at once
+#define PIS_CPU_PACKET_MAX 8
+
+typedef enum PisCpuIsa {
+    PIS_CPU_ISA_SCALAR = 0,
+    PIS_CPU_ISA_SSE2 = 1,
+    PIS_CPU_ISA_AVX2 = 2,
+    PIS_CPU_ISA_NEON = 3,
+    PIS_CPU_ISA_COUNT,
+} PisCpuIsa;
+
+// One ray per lane, the state traceRayInternal has after its setup. Lanes past count are ignored.
+typedef struct PisCpuPacket {
+    int32_t voxel[3][PIS_CPU_PACKET_MAX];
+    int32_t step[3][PIS_CPU_PACKET_MAX];
+    float sideDist[3][PIS_CPU_PACKET_MAX];
+    float tDelta[3][PIS_CPU_PACKET_MAX];
+    uint32_t count;
+
+    // Written by the trace, sideDist is left where the ray stopped like the scalar dda
+    uint32_t material[PIS_CPU_PACKET_MAX];
+    bool mask[3][PIS_CPU_PACKET_MAX];
+} PisCpuPacket;
+
+typedef void (*PisCpuPacketTrace)(PisVox* pisV, PisCpuPacket* packet);
+
+bool PisCpuIsaSupported(PisCpuIsa isa);
+
+// Widest instruction set this cpu runs, checked at runtime
+PisCpuIsa PisCpuBestIsa(void);
+
+const char* PisCpuIsaName(PisCpuIsa isa);
+
+// Rays per packet, 1 for scalar
+uint32_t PisCpuIsaWidth(PisCpuIsa isa);
+
+// The dda of traceRayInternal for a whole packet, NULL for scalar or an unsupported isa
+PisCpuPacketTrace PisCpuPacketTraceFor(PisCpuIsa isa);
+
+#endif
@@ -0,0 +1,566 @@
+#include "pisCpuTracer.h"
+#include "pisUniforms.h"
+#include "pisJobs.h"
+#include "pisPng.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Same values as voxel.comp
+#define CPU_EPSILON 1e-3f
+#define CPU_MAX_STEPS 512
+#define CPU_PI 3.14159265358979f
+
+typedef struct CpuRay {
+    vec3 origin;
+    vec3 direction;
+} CpuRay;
+
+typedef struct CpuRayHitInternal {
+    vec3 pos;
+    vec3 sideDist;
+    vec3 tDelta;
+    int32_t step[3];
+    uint32_t material;
+    bool mask[3];
+} CpuRayHitInternal;
+
+typedef struct CpuRayHit {
+    uint32_t material;
+    vec3 pos;
+    vec3 normal;
+} CpuRayHit;
+
+typedef struct CpuRender {
+    PisVox* pisV;
+    UniformBufferObject* ubo;
+    PisCpuImage* image;
+    vec3 lightDir;
+    PisCpuIsa isa;
+    PisCpuPacketTrace trace;
+} CpuRender;
+
+/* =================================Helper functions================================ */
+void CpuStartRender(PisVox* pisV, UniformBufferObject* ubo, PisCpuIsa isa, PisCpuImage* image, CpuRender* render);
+void RenderRowJob(void* userData, uint32_t jobIndex);
+void RenderTileJob(void* userData, uint32_t jobIndex);
+void CpuRenderSpan(CpuRender* render, uint32_t y, uint32_t xBegin, uint32_t xEnd);
+void CpuRenderSpanPackets(CpuRender* render, uint32_t y, uint32_t xBegin, uint32_t xEnd);
+uint32_t CpuPackPixel(float* pixel);
+uint8_t* CpuImageBytes(PisCpuImage* image);
+void CpuInitCamera(CpuRender* render, uint32_t x, uint32_t y, CpuRay* ray);
+void CpuBoxIntersection(CpuRay* ray, Size size, vec3 pos);
+void CpuStartRay(CpuRay* ray, Size size, CpuRayHitInternal* result, int32_t voxel[3]);
+void CpuTraceRayInternal(PisVox* pisV, CpuRay* ray, CpuRayHitInternal* result);
+CpuRayHit CpuResolveHit(CpuRay* ray, CpuRayHitInternal* internal);
+void CpuShadowRay(CpuRender* render, CpuRayHit* hit, CpuRay* ray);
+void CpuPacketSetLane(PisCpuPacket* packet, uint32_t lane, CpuRayHitInternal* internal, int32_t voxel[3]);
+void CpuPacketGetLane(PisCpuPacket* packet, uint32_t lane, CpuRayHitInternal* internal);
+void CpuColorHit(CpuRender* render, CpuRayHit* hit, bool shadowed, vec3 color);
+void CpuSkyHit(CpuRender* render, CpuRay* ray, vec3 color);
+float CpuSign(float value);
+void CpuMix(vec3 a, vec3 b, float t, vec3 dest);
+/* ================================================================================ */
+
+int PisCpuRender(PisVox* pisV, struct UniformBufferObject* ubo, uint32_t width, uint32_t height,
+                 uint32_t threadCount, PisCpuIsa isa, PisCpuImage* image)
+{
+    if(PisCpuImageCreate(width, height, false, image) != 0)
+        return -1;
+
+    CpuRender render;
+    CpuStartRender(pisV, ubo, isa, image, &render);
+
+    // Rows are independent, a job each
+    PisJobsRun(RenderRowJob, &render, height, threadCount);
+
+    return 0;
+}
+
+void PisCpuRenderTiles(PisVox* pisV, struct UniformBufferObject* ubo, PisJobPool* pool, PisCpuIsa isa, PisCpuImage* image)
+{
+    CpuRender render;
+    CpuStartRender(pisV, ubo, isa, image, &render);
+
+    uint32_t tilesX = (image->width + PIS_CPU_TILE_SIZE - 1) / PIS_CPU_TILE_SIZE;
+    uint32_t tilesY = (image->height + PIS_CPU_TILE_SIZE - 1) / PIS_CPU_TILE_SIZE;
+
+    PisJobPoolRun(pool, RenderTileJob, &render, tilesX * tilesY);
+}
+
+int PisCpuImageCreate(uint32_t width, uint32_t height, bool packed, PisCpuImage* image)
+{
+    image->width = width;
+    image->height = height;
+    image->rayCount = 0;
+    image->pixels = malloc(sizeof(float) * 3 * width * height + 1);
+    image->packed = packed ? malloc(sizeof(uint32_t) * width * height + 1) : NULL;
+
+    if(image->pixels == NULL || (packed && image->packed == NULL))
+    {
+        fprintf(stderr, "Failed to allocate a %ux%u image\n", width, height);
+        free(image->pixels);
+        free(image->packed);
+        image->pixels = NULL;
+        image->packed = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+int PisCpuImageWritePpm(PisCpuImage* image, const char* fileName)
+{
+    FILE* fptr = fopen(fileName, "wb");
+    if(fptr == NULL)
+    {
+        fprintf(stderr, "Failed to write file: %s\n", fileName);
+        return -1;
+    }
+
+    size_t byteCount = (size_t)image->width * image->height * 3;
+    uint8_t* bytes = CpuImageBytes(image);
+    if(bytes == NULL)
+    {
+        fclose(fptr);
+        return -1;
+    }
+
+    fprintf(fptr, "P6\n%u %u\n255\n", image->width, image->height);
+    size_t written = fwrite(bytes, 1, byteCount, fptr);
+
+    free(bytes);
+    fclose(fptr);
+
+    if(written != byteCount)
+    {
+        fprintf(stderr, "Failed to write file: %s\n", fileName);
+        return -1;
+    }
+
+    return 0;
+}
+
+int PisCpuImageWritePng(PisCpuImage* image, const char* fileName)
+{
+    uint8_t* bytes = CpuImageBytes(image);
+    if(bytes == NULL)
+        return -1;
+
+    int result = PisPngWrite(fileName, image->width, image->height, bytes);
+
+    free(bytes);
+
+    return result;
+}
+
+uint8_t* CpuImageBytes(PisCpuImage* image)
+{
+    size_t byteCount = (size_t)image->width * image->height * 3;
+    uint8_t* bytes = malloc(byteCount + 1);
+    if(bytes == NULL)
+    {
+        fprintf(stderr, "Failed to allocate\n");
+        return NULL;
+    }
+
+    for(size_t i = 0; i < byteCount; i++)
+    {
+        float value = image->pixels[i] < 0.0f ? 0.0f : (image->pixels[i] > 1.0f ? 1.0f : image->pixels[i]);
+        bytes[i] = (uint8_t)(value * 255.0f + 0.5f);
+    }
+
+    return bytes;
+}
+
+void DestroyPisCpuImage(PisCpuImage image)
+{
+    free(image.pixels);
+    free(image.packed);
+}
+
+void CpuStartRender(PisVox* pisV, UniformBufferObject* ubo, PisCpuIsa isa, PisCpuImage* image, CpuRender* render)
+{
+    *render = (CpuRender){
+        .pisV = pisV,
+        .ubo = ubo,
+        .image = image,
+        .lightDir = { -5.0f, 5.0f, -3.0f },
+        .isa = isa,
+        .trace = PisCpuPacketTraceFor(isa),
+    };
+    glm_vec3_normalize(render->lightDir);
+
+    // Packets step a 32 bit voxel index
+    if((uint64_t)pisV->size.x * pisV->size.y * pisV->size.z > INT32_MAX)
+        render->trace = NULL;
+
+    image->rayCount = 0;
+}
+
+void RenderRowJob(void* userData, uint32_t jobIndex)
+{
+    CpuRender* render = userData;
+
+    if(render->trace != NULL)
+        CpuRenderSpanPackets(render, jobIndex, 0, render->image->width);
+    else
+        CpuRenderSpan(render, jobIndex, 0, render->image->width);
+}
+
+// A workgroup of voxel.comp, packed for the screen right away while the tile is still in cache
+void RenderTileJob(void* userData, uint32_t jobIndex)
+{
+    CpuRender* render = userData;
+    PisCpuImage* image = render->image;
+
+    uint32_t tilesX = (image->width + PIS_CPU_TILE_SIZE - 1) / PIS_CPU_TILE_SIZE;
+    uint32_t xBegin = jobIndex % tilesX * PIS_CPU_TILE_SIZE;
+    uint32_t yBegin = jobIndex / tilesX * PIS_CPU_TILE_SIZE;
+    uint32_t xEnd = xBegin + PIS_CPU_TILE_SIZE < image->width ? xBegin + PIS_CPU_TILE_SIZE : image->width;
+    uint32_t yEnd = yBegin + PIS_CPU_TILE_SIZE < image->height ? yBegin + PIS_CPU_TILE_SIZE : image->height;
+
+    for(uint32_t y = yBegin; y < yEnd; y++)
+    {
+        if(render->trace != NULL)
+            CpuRenderSpanPackets(render, y, xBegin, xEnd);
+        else
+            CpuRenderSpan(render, y, xBegin, xEnd);
+
+        if(image->packed == NULL)
+            continue;
+
+        for(uint32_t x = xBegin; x < xEnd; x++)
+        {
+            size_t index = (size_t)y * image->width + x;
+            image->packed[index] = CpuPackPixel(image->pixels + index * 3);
+        }
+    }
+}
+
+// main() of voxel.comp for the pixels xBegin..xEnd of a row
+void CpuRenderSpan(CpuRender* render, uint32_t y, uint32_t xBegin, uint32_t xEnd)
+{
+    PisCpuImage* image = render->image;
+
+    uint64_t rayCount = 0;
+
+    for(uint32_t x = xBegin; x < xEnd; x++)
+    {
+        float* pixel = image->pixels + ((size_t)y * image->width + x) * 3;
+
+        CpuRay camera;
+        CpuInitCamera(render, x, y, &camera);
+
+        CpuRayHitInternal internal;
+        CpuTraceRayInternal(render->pisV, &camera, &internal);
+        CpuRayHit hit = CpuResolveHit(&camera, &internal);
+        rayCount++;
+
+        if(hit.material == 0)
+        {
+            CpuSkyHit(render, &camera, pixel);
+            continue;
+        }
+
+        // isShadowed
+        CpuRay shadowRay;
+        CpuRayHitInternal shadow;
+        CpuShadowRay(render, &hit, &shadowRay);
+        CpuTraceRayInternal(render->pisV, &shadowRay, &shadow);
+        rayCount++;
+
+        CpuColorHit(render, &hit, shadow.material != 0, pixel);
+    }
+
+    __atomic_fetch_add(&image->rayCount, rayCount, __ATOMIC_RELAXED);
+}
+
+// The same span a packet at a time, primary rays first and then the shadow rays of the hits
+void CpuRenderSpanPackets(CpuRender* render, uint32_t y, uint32_t xBegin, uint32_t xEnd)
+{
+    PisCpuImage* image = render->image;
+    uint32_t width = PisCpuIsaWidth(render->isa);
+
+    uint64_t rayCount = 0;
+
+    for(uint32_t first = xBegin; first < xEnd; first += width)
+    {
+        uint32_t count = xEnd - first < width ? xEnd - first : width;
+
+        CpuRay cameras[PIS_CPU_PACKET_MAX];
+        CpuRayHitInternal internals[PIS_CPU_PACKET_MAX];
+        PisCpuPacket packet = { .count = count };
+
+        for(uint32_t l = 0; l < count; l++)
+        {
+            int32_t voxel[3];
+            CpuInitCamera(render, first + l, y, &cameras[l]);
+            CpuStartRay(&cameras[l], render->pisV->size, &internals[l], voxel);
+            CpuPacketSetLane(&packet, l, &internals[l], voxel);
+        }
+
+        render->trace(render->pisV, &packet);
+        rayCount += count;
+
+        CpuRayHit hits[PIS_CPU_PACKET_MAX];
+        uint32_t shadowLanes[PIS_CPU_PACKET_MAX];
+        PisCpuPacket shadowPacket = { .count = 0 };
+
+        for(uint32_t l = 0; l < count; l++)
+        {
+            CpuPacketGetLane(&packet, l, &internals[l]);
+            hits[l] = CpuResolveHit(&cameras[l], &internals[l]);
+
+            if(hits[l].material == 0)
+                continue;
+
+            // Every shadow ray goes towards the light, so the packet stays coherent
+            int32_t voxel[3];
+            CpuRay shadowRay;
+            CpuRayHitInternal shadow;
+            CpuShadowRay(render, &hits[l], &shadowRay);
+            CpuStartRay(&shadowRay, render->pisV->size, &shadow, voxel);
+
+            shadowLanes[l] = shadowPacket.count;
+            CpuPacketSetLane(&shadowPacket, shadowPacket.count++, &shadow, voxel);
+        }
+
+        if(shadowPacket.count > 0)
+        {
+            render->trace(render->pisV, &shadowPacket);
+            rayCount += shadowPacket.count;
+        }
+
+        for(uint32_t l = 0; l < count; l++)
+        {
+            float* pixel = image->pixels + ((size_t)y * image->width + first + l) * 3;
+
+            if(hits[l].material != 0)
+                CpuColorHit(render, &hits[l], shadowPacket.material[shadowLanes[l]] != 0, pixel);
+            else
+                CpuSkyHit(render, &cameras[l], pixel);
+        }
+    }
+
+    __atomic_fetch_add(&image->rayCount, rayCount, __ATOMIC_RELAXED);
+}
+
+void CpuInitCamera(CpuRender* render, uint32_t x, uint32_t y, CpuRay* ray)
+{
+    UniformBufferObject* ubo = render->ubo;
+
+    float aspectRatio = (float)render->image->width / (float)render->image->height;
+
+    float u = ((float)x + 0.5f) / (float)render->image->width * 2.0f - 1.0f;
+    float v = ((float)y + 0.5f) / (float)render->image->height * 2.0f - 1.0f;
+    u *= aspectRatio;
+
+    float scale = tanf(ubo->fov * CPU_PI / 180.0f * 0.5f);
+
+    for(int a = 0; a < 3; a++)
+        ray->direction[a] = ubo->forward[a] + u * scale * ubo->right[a] + v * scale * -ubo->up[a];
+
+    glm_vec3_normalize(ray->direction);
+    glm_vec3_copy(ubo->position, ray->origin);
+}
+
+// Just inside the volume when the ray starts outside of it, otherwise the origin
+void CpuBoxIntersection(CpuRay* ray, Size size, vec3 pos)
+{
+    float extent[3] = { (float)size.x, (float)size.y, (float)size.z };
+    float tmin = -INFINITY, tmax = INFINITY;
+
+    for(int a = 0; a < 3; a++)
+    {
+        float invDir = 1.0f / ray->direction[a];
+        float t1 = -ray->origin[a] * invDir;
+        float t2 = (extent[a] - ray->origin[a]) * invDir;
+
+        tmin = fmaxf(tmin, fminf(t1, t2));
+        tmax = fminf(tmax, fmaxf(t1, t2));
+    }
+
+    for(int a = 0; a < 3; a++)
+        pos[a] = (tmin >= 0.0f && tmax >= tmin) ? ray->origin[a] + (tmin + 0.1f) * ray->direction[a] : ray->origin[a];
+}
+
+// The top of traceRayInternal, shared by the scalar and packet traversal
+void CpuStartRay(CpuRay* ray, Size size, CpuRayHitInternal* result, int32_t voxel[3])
+{
+    result->material = 0;
+    CpuBoxIntersection(ray, size, result->pos);
+
+    for(int a = 0; a < 3; a++)
+    {
+        float sign = CpuSign(ray->direction[a]);
+
+        voxel[a] = (int32_t)floorf(result->pos[a]);
+        result->mask[a] = false;
+        result->step[a] = (int32_t)sign;
+        result->tDelta[a] = fabsf(1.0f / ray->direction[a]);
+        result->sideDist[a] = (sign * ((float)voxel[a] - result->pos[a]) + (sign * 0.5f) + 0.5f) * result->tDelta[a];
+    }
+}
+
+// The dense world path of traceRayInternal without any empty space skipping, which only
+// changes how fast the same voxel is found
+void CpuTraceRayInternal(PisVox* pisV, CpuRay* ray, CpuRayHitInternal* result)
+{
+    Size size = pisV->size;
+    int32_t voxel[3];
+
+    CpuStartRay(ray, size, result, voxel);
+
+    for(uint32_t i = 0; i < CPU_MAX_STEPS; i++)
+    {
+        if(voxel[0] < 0 || voxel[0] >= (int32_t)size.x
+        || voxel[1] < 0 || voxel[1] >= (int32_t)size.y
+        || voxel[2] < 0 || voxel[2] >= (int32_t)size.z)
+        {
+            break;
+        }
+
+        result->material = pisV->voxels[(size_t)voxel[0] + (size_t)voxel[1] * size.x + (size_t)voxel[2] * size.x * size.y];
+        if(result->material != 0)
+            break;
+
+        float* sideDist = result->sideDist;
+        result->mask[0] = sideDist[0] <= fminf(sideDist[1], sideDist[2]);
+        result->mask[1] = sideDist[1] <= fminf(sideDist[2], sideDist[0]);
+        result->mask[2] = sideDist[2] <= fminf(sideDist[0], sideDist[1]);
+
+        // Added only on the masked axes, an axis the ray does not move along keeps its infinity
+        for(int a = 0; a < 3; a++)
+        {
+            if(result->mask[a])
+            {
+                sideDist[a] += result->tDelta[a];
+                voxel[a] += result->step[a];
+            }
+        }
+    }
+}
+
+// resolveHit of voxel.comp
+CpuRayHit CpuResolveHit(CpuRay* ray, CpuRayHitInternal* internal)
+{
+    CpuRayHit hit = { .material = internal->material };
+    if(hit.material == 0)
+        return hit;
+
+    float distance = 0.0f;
+    for(int a = 0; a < 3; a++)
+    {
+        hit.normal[a] = internal->mask[a] ? (float)-internal->step[a] : 0.0f;
+
+        float along = internal->mask[a] ? internal->sideDist[a] - internal->tDelta[a] : 0.0f;
+        distance += along * along;
+    }
+
+    glm_vec3_normalize(hit.normal);
+    distance = sqrtf(distance);
+
+    for(int a = 0; a < 3; a++)
+        hit.pos[a] = internal->pos[a] + distance * ray->direction[a];
+
+    return hit;
+}
+
+// The ray isShadowed traces
+void CpuShadowRay(CpuRender* render, CpuRayHit* hit, CpuRay* ray)
+{
+    for(int a = 0; a < 3; a++)
+        ray->origin[a] = hit->pos[a] + hit->normal[a] * CPU_EPSILON;
+    glm_vec3_copy(render->lightDir, ray->direction);
+}
+
+void CpuPacketSetLane(PisCpuPacket* packet, uint32_t lane, CpuRayHitInternal* internal, int32_t voxel[3])
+{
+    for(int a = 0; a < 3; a++)
+    {
+        packet->voxel[a][lane] = voxel[a];
+        packet->step[a][lane] = internal->step[a];
+        packet->sideDist[a][lane] = internal->sideDist[a];
+        packet->tDelta[a][lane] = internal->tDelta[a];
+    }
+}
+
+void CpuPacketGetLane(PisCpuPacket* packet, uint32_t lane, CpuRayHitInternal* internal)
+{
+    internal->material = packet->material[lane];
+    for(int a = 0; a < 3; a++)
+    {
+        internal->sideDist[a] = packet->sideDist[a][lane];
+        internal->mask[a] = packet->mask[a][lane];
+    }
+}
+
+// colorHit, for hits only
+void CpuColorHit(CpuRender* render, CpuRayHit* hit, bool shadowed, vec3 color)
+{
+    Color packed = render->pisV->materials[hit->material - 1].color;
+    vec3 albedo = { packed.r / 255.0f, packed.g / 255.0f, packed.b / 255.0f };
+
+    float ambient = 0.3f;
+    float diffuse = 0.0f;
+    if(!shadowed)
+        diffuse = fmaxf(glm_vec3_dot(hit->normal, render->lightDir), 0.0f);
+
+    for(int a = 0; a < 3; a++)
+        color[a] = (diffuse + ambient) * albedo[a];
+}
+
+void CpuSkyHit(CpuRender* render, CpuRay* ray, vec3 color)
+{
+    float* direction = ray->direction;
+
+    float sundot = glm_vec3_dot(direction, render->lightDir);
+    sundot = sundot < 0.0f ? 0.0f : (sundot > 1.0f ? 1.0f : sundot);
+
+    vec3 skyCol = { 0.3f, 0.5f, 0.85f };
+    for(int a = 0; a < 3; a++)
+        skyCol[a] -= direction[1] * direction[1] * 0.5f;
+
+    float up = 1.0f - fmaxf(direction[1], 0.0f);
+
+    vec3 haze = { 0.85f * 0.7f, 0.85f * 0.75f, 0.85f * 0.85f };
+    CpuMix(skyCol, haze, powf(up, 4.0f), skyCol);
+
+    // sun
+    vec3 sunA = { 1.0f, 0.7f, 0.4f };
+    vec3 sunB = { 1.0f, 0.8f, 0.6f };
+    for(int a = 0; a < 3; a++)
+        skyCol[a] += 0.25f * sunA[a] * powf(sundot, 5.0f) + 0.25f * sunB[a] * powf(sundot, 64.0f) + 0.2f * sunB[a] * powf(sundot, 512.0f);
+
+    // horizon
+    vec3 horizon = { 0.68f * 0.418f, 0.68f * 0.394f, 0.68f * 0.372f };
+    CpuMix(skyCol, horizon, powf(up, 16.0f), color);
+}
+
+// The same rounding as PisCpuImageWritePpm, as 0xXXRRGGBB
+uint32_t CpuPackPixel(float* pixel)
+{
+    uint32_t packed = 0xFF000000u;
+    for(int a = 0; a < 3; a++)
+    {
+        float value = pixel[a] < 0.0f ? 0.0f : (pixel[a] > 1.0f ? 1.0f : pixel[a]);
+        packed |= (uint32_t)(value * 255.0f + 0.5f) << (16 - 8 * a);
+    }
+
+    return packed;
+}
+
+float CpuSign(float value)
+{
+    return value > 0.0f ? 1.0f : (value < 0.0f ? -1.0f : 0.0f);
+}
+
+// GLSL mix
+void CpuMix(vec3 a, vec3 b, float t, vec3 dest)
+{
+    for(int i = 0; i < 3; i++)
+        dest[i] = a[i] * (1.0f - t) + b[i] * t;
+}
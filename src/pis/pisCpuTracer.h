@@ -0,0 +1,47 @@
+#ifndef PIS_CPU_TRACER_H
+#define PIS_CPU_TRACER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pisCpuPacket.h"
+#include "pisJobs.h"
+#include "pisVoxReader.h"
+
+// Pixels per side of a tile, the local_size of voxel.comp
+#define PIS_CPU_TILE_SIZE 16
+
+// From engine.h, which holds a PisCpuImage itself
+struct UniformBufferObject;
+
+// Linear rgb, three floats per pixel, rows from the top like the draw image
+typedef struct PisCpuImage {
+    uint32_t width;
+    uint32_t height;
+    float* pixels;
+    // The same pixels as 0xXXRRGGBB for an SDL texture, only written by PisCpuRenderTiles when set
+    uint32_t* packed;
+    // Primary and shadow rays traced for the image
+    uint64_t rayCount;
+} PisCpuImage;
+
+// Renders the volume the way voxel.comp renders a dense world: the same camera, plain dda
+// traversal, shadows and sky, in float. Meant as the reference the GPU image is checked against.
+// Any isa other than scalar traces rays in packets and gives the same image.
+int PisCpuRender(PisVox* pisV, struct UniformBufferObject* ubo, uint32_t width, uint32_t height,
+                 uint32_t threadCount, PisCpuIsa isa, PisCpuImage* image);
+
+// The same image into one made by PisCpuImageCreate, as 16x16 tiles spread over the pool.
+// For rendering every frame, the image and the threads are reused.
+void PisCpuRenderTiles(PisVox* pisV, struct UniformBufferObject* ubo, PisJobPool* pool, PisCpuIsa isa, PisCpuImage* image);
+
+int PisCpuImageCreate(uint32_t width, uint32_t height, bool packed, PisCpuImage* image);
+
+// Binary PPM, clamped to 0..1 like the copy into the UNORM swapchain
+int PisCpuImageWritePpm(PisCpuImage* image, const char* fileName);
+// The same bytes as an uncompressed PNG through PisPngWrite
+int PisCpuImageWritePng(PisCpuImage* image, const char* fileName);
+
+void DestroyPisCpuImage(PisCpuImage image);
+
+#endif
@@ -0,0 +1,294 @@
+#include "pisDag.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+typedef struct DagBuild {
+    PisSvo* svo;
+    PisDag* dag;
+    size_t capacity;
+
+    // Open addressing over the node start indices, 0 is free since nodes start after the header
+    uint32_t* table;
+    size_t tableSize;
+    size_t tableCount;
+
+    uint8_t* attributes;
+    size_t attributeCapacity;
+
+    bool failed;
+} DagBuild;
+
+typedef struct DagChild {
+    uint32_t node;
+    uint32_t voxelCount;
+} DagChild;
+
+/* =================================Helper functions================================ */
+DagChild BuildDagNode(DagBuild* build, uint32_t svoNode, uint32_t level);
+DagChild BuildDagLeaf(DagBuild* build, uint32_t svoNode);
+uint32_t InsertDagNode(DagBuild* build, const uint32_t* words, uint32_t wordCount, uint32_t level);
+int GrowDagTable(DagBuild* build);
+uint32_t HashDagWords(const uint32_t* words, uint32_t wordCount);
+/* ================================================================================ */
+
+uint32_t PisDagDepth(Size size)
+{
+    uint32_t depth = PisSvoDepth(size);
+    return depth < 2 ? 2 : depth;
+}
+
+int PisDagBuild(PisSvo* svo, PisDag* dag)
+{
+    memset(dag, 0, sizeof(PisDag));
+
+    DagBuild build = {
+        .svo = svo,
+        .dag = dag,
+        .capacity = 1024,
+        .tableSize = 1024,
+    };
+
+    dag->depth = svo->depth < 2 ? 2 : svo->depth;
+    dag->words = malloc(sizeof(uint32_t) * build.capacity);
+    build.table = calloc(build.tableSize, sizeof(uint32_t));
+
+    if(dag->words == NULL || build.table == NULL)
+    {
+        fprintf(stderr, "Failed to allocate dag\n");
+        free(dag->words);
+        free(build.table);
+        dag->words = NULL;
+        return -1;
+    }
+
+    dag->wordCount = PIS_DAG_HEADER_WORDS;
+
+    for(uint32_t level = 0; level < svo->depth && level < PIS_SVO_MAX_DEPTH; level++)
+        dag->levelTreeNodeCount[level + dag->depth - svo->depth] = svo->levelNodeCount[level];
+
+    uint32_t root;
+    if(svo->depth < 2)
+    {
+        // Tiny volumes are a single 2^3 voxel node, they get a root above it
+        DagChild leaf = BuildDagLeaf(&build, svo->nodes[0]);
+        uint32_t words[3] = { leaf.node != 0, leaf.node, 0 };
+
+        dag->levelTreeNodeCount[0] = 1;
+        root = InsertDagNode(&build, words, leaf.node != 0 ? 3 : 1, 0);
+    }
+    else
+    {
+        root = BuildDagNode(&build, svo->nodes[0], svo->depth).node;
+    }
+
+    // The attributes follow the nodes as whole uints
+    size_t attributeWords = (dag->attributeCount + 3) / 4;
+    if(!build.failed && dag->wordCount + attributeWords > dag->wordCount)
+    {
+        uint32_t* words = realloc(dag->words, sizeof(uint32_t) * (dag->wordCount + attributeWords));
+        if(words == NULL)
+            build.failed = true;
+        else
+            dag->words = words;
+    }
+
+    if(!build.failed)
+    {
+        dag->words[0] = (uint32_t)dag->wordCount;
+        dag->words[1] = root;
+
+        memset(dag->words + dag->wordCount, 0, sizeof(uint32_t) * attributeWords);
+        memcpy(dag->words + dag->wordCount, build.attributes, dag->attributeCount);
+        dag->wordCount += attributeWords;
+    }
+
+    free(build.table);
+    free(build.attributes);
+
+    if(build.failed)
+    {
+        fprintf(stderr, "Failed to build dag\n");
+        free(dag->words);
+        dag->words = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+void DestroyPisDag(PisDag dag)
+{
+    free(dag.words);
+}
+
+// Returns the merged node for an svo node covering 2^level voxels
+DagChild BuildDagNode(DagBuild* build, uint32_t svoNode, uint32_t level)
+{
+    if(level == 1)
+        return BuildDagLeaf(build, svoNode);
+
+    uint32_t mask = svoNode & 0xFF;
+    uint32_t firstChild = svoNode >> 8;
+
+    uint32_t words[1 + 8 * 2];
+    uint32_t wordCount = 1;
+    uint32_t voxelCount = 0;
+
+    words[0] = mask;
+
+    uint32_t slot = 0;
+    for(uint32_t child = 0; child < 8 && !build->failed; child++)
+    {
+        if(!(mask & (1u << child)))
+            continue;
+
+        // Depth first, so the attributes of a subtree follow each other
+        DagChild result = BuildDagNode(build, build->svo->nodes[firstChild + slot++], level - 1);
+
+        words[wordCount++] = result.node;
+        words[wordCount++] = voxelCount;
+        voxelCount += result.voxelCount;
+    }
+
+    if(build->failed)
+        return (DagChild){ 0, 0 };
+
+    uint32_t depthLevel = build->dag->depth - level;
+    return (DagChild){ InsertDagNode(build, words, wordCount, depthLevel), voxelCount };
+}
+
+// The lowest svo nodes become their child mask, their materials go to the attributes
+DagChild BuildDagLeaf(DagBuild* build, uint32_t svoNode)
+{
+    uint32_t mask = svoNode & 0xFF;
+    uint32_t firstChild = svoNode >> 8;
+
+    uint32_t voxelCount = (uint32_t)__builtin_popcount(mask);
+
+    if(build->dag->attributeCount + voxelCount > build->attributeCapacity)
+    {
+        size_t capacity = build->attributeCapacity ? build->attributeCapacity * 2 : 4096;
+        uint8_t* attributes = realloc(build->attributes, capacity);
+        if(attributes == NULL)
+        {
+            build->failed = true;
+            return (DagChild){ 0, 0 };
+        }
+
+        build->attributes = attributes;
+        build->attributeCapacity = capacity;
+    }
+
+    for(uint32_t child = 0; child < 8; child++)
+    {
+        if(mask & (1u << child))
+            build->attributes[build->dag->attributeCount++] = (uint8_t)(build->svo->nodes[firstChild + child / 4] >> ((child % 4) * 8));
+    }
+
+    return (DagChild){ mask, voxelCount };
+}
+
+// Returns the index of an identical node, or appends words as a new one
+uint32_t InsertDagNode(DagBuild* build, const uint32_t* words, uint32_t wordCount, uint32_t level)
+{
+    PisDag* dag = build->dag;
+
+    if((build->tableCount + 1) * 2 > build->tableSize && GrowDagTable(build) != 0)
+        return 0;
+
+    size_t slot = HashDagWords(words, wordCount) & (build->tableSize - 1);
+    while(build->table[slot] != 0)
+    {
+        uint32_t existing = build->table[slot];
+        uint32_t existingCount = 1 + 2 * (uint32_t)__builtin_popcount(dag->words[existing] & 0xFF);
+
+        if(existingCount == wordCount && memcmp(dag->words + existing, words, sizeof(uint32_t) * wordCount) == 0)
+            return existing;
+
+        slot = (slot + 1) & (build->tableSize - 1);
+    }
+
+    if(dag->wordCount + wordCount > UINT32_MAX)
+    {
+        build->failed = true;
+        return 0;
+    }
+
+    if(dag->wordCount + wordCount > build->capacity)
+    {
+        size_t capacity = build->capacity * 2;
+        uint32_t* grown = realloc(dag->words, sizeof(uint32_t) * capacity);
+        if(grown == NULL)
+        {
+            build->failed = true;
+            return 0;
+        }
+
+        dag->words = grown;
+        build->capacity = capacity;
+    }
+
+    uint32_t node = (uint32_t)dag->wordCount;
+    memcpy(dag->words + node, words, sizeof(uint32_t) * wordCount);
+    dag->wordCount += wordCount;
+
+    build->table[slot] = node;
+    build->tableCount++;
+
+    if(level < PIS_SVO_MAX_DEPTH)
+        dag->levelNodeCount[level]++;
+
+    return node;
+}
+
+int GrowDagTable(DagBuild* build)
+{
+    size_t tableSize = build->tableSize * 2;
+    uint32_t* table = calloc(tableSize, sizeof(uint32_t));
+    if(table == NULL)
+    {
+        build->failed = true;
+        return -1;
+    }
+
+    for(size_t i = 0; i < build->tableSize; i++)
+    {
+        uint32_t node = build->table[i];
+        if(node == 0)
+            continue;
+
+        uint32_t wordCount = 1 + 2 * (uint32_t)__builtin_popcount(build->dag->words[node] & 0xFF);
+
+        size_t slot = HashDagWords(build->dag->words + node, wordCount) & (tableSize - 1);
+        while(table[slot] != 0)
+            slot = (slot + 1) & (tableSize - 1);
+
+        table[slot] = node;
+    }
+
+    free(build->table);
+    build->table = table;
+    build->tableSize = tableSize;
+
+    return 0;
+}
+
+uint32_t HashDagWords(const uint32_t* words, uint32_t wordCount)
+{
+    uint32_t hash = FNV_OFFSET;
+    const uint8_t* bytes = (const uint8_t*)words;
+
+    for(size_t i = 0; i < sizeof(uint32_t) * wordCount; i++)
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
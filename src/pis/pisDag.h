@@ -0,0 +1,35 @@
+#ifndef PIS_DAG_H
+#define PIS_DAG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pisSvo.h"
+
+// words[0] and words[1] of a PisDag
+#define PIS_DAG_HEADER_WORDS 2
+
+// A sparse voxel octree with identical subtrees merged, so only the geometry is shared.
+// words[0] is the uint32 index where the attributes start, words[1] the index of the root.
+// A node is a word with the child mask in the low 8 bits, followed by two words per existing
+// child: the child node index and the number of voxels in the children before it. Children of
+// nodes of 4^3 voxels are not nodes but the child mask of their 2^3 voxels directly.
+// The attributes are the voxel materials as bytes, in depth first child order, so a voxel's
+// material is found by adding up the voxel counts on the way down.
+typedef struct PisDag {
+    uint32_t depth;
+    uint32_t* words;
+    size_t wordCount;
+    uint32_t attributeCount;
+    // Merged nodes per level next to the nodes of the tree it came from, level 0 is the root
+    uint32_t levelNodeCount[PIS_SVO_MAX_DEPTH];
+    uint32_t levelTreeNodeCount[PIS_SVO_MAX_DEPTH];
+} PisDag;
+
+// Same as PisSvoDepth, but a dag always has a level of nodes above the 2^3 voxel masks
+uint32_t PisDagDepth(Size size);
+
+int PisDagBuild(PisSvo* svo, PisDag* dag);
+void DestroyPisDag(PisDag dag);
+
+#endif
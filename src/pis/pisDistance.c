@@ -0,0 +1,273 @@
+#include "pisDistance.h"
+#include "pisJobs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Larger than any distance inside a volume
+#define DISTANCE_INFINITY 0xFFFF
+
+typedef struct DistanceWindow {
+    PisVox* pisV;
+    PisDistanceField* field;
+
+    // The voxels the distances are computed from, and the part of them that gets written
+    Size min, max;
+    Size writeMin, writeMax;
+    Size size;
+
+    uint16_t* work;
+    int failed;
+} DistanceWindow;
+
+/* =================================Helper functions================================ */
+int ComputeDistanceWindow(PisVox* pisV, PisDistanceField* field, Size min, Size max, Size writeMin, Size writeMax);
+void DistancePassXJob(void* userData, uint32_t jobIndex);
+void DistancePassYJob(void* userData, uint32_t jobIndex);
+void DistancePassZJob(void* userData, uint32_t jobIndex);
+void ChebyshevLine(const uint16_t* g, uint32_t count, int32_t* s, int32_t* t, uint16_t* out);
+Size GrowBox(Size value, int32_t amount, Size limit);
+/* ================================================================================ */
+
+int PisDistanceFieldBuild(PisVox* pisV, PisDistanceField* field)
+{
+    field->size = pisV->size;
+    field->distance = malloc((size_t)pisV->size.x * pisV->size.y * pisV->size.z + 1);
+    if(field->distance == NULL)
+    {
+        fprintf(stderr, "Failed to allocate distance field\n");
+        return -1;
+    }
+
+    Size zero = { 0, 0, 0 };
+    if(ComputeDistanceWindow(pisV, field, zero, pisV->size, zero, pisV->size) != 0)
+    {
+        free(field->distance);
+        field->distance = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+int PisDistanceFieldUpdate(PisVox* pisV, PisDistanceField* field, Size editMin, Size editMax,
+                           Size* updatedMin, Size* updatedMax)
+{
+    // A voxel further than the maximum from the edit could only see it past the clamp. The new
+    // distances of the voxels that do see it come from solid voxels at most that far again.
+    *updatedMin = GrowBox(editMin, -PIS_DISTANCE_MAX, pisV->size);
+    *updatedMax = GrowBox(editMax, PIS_DISTANCE_MAX, pisV->size);
+
+    Size min = GrowBox(editMin, -2 * PIS_DISTANCE_MAX, pisV->size);
+    Size max = GrowBox(editMax, 2 * PIS_DISTANCE_MAX, pisV->size);
+
+    return ComputeDistanceWindow(pisV, field, min, max, *updatedMin, *updatedMax);
+}
+
+void DestroyPisDistanceField(PisDistanceField field)
+{
+    free(field.distance);
+}
+
+// Three separable passes: the distance along x, then along y and z the smallest Chebyshev
+// distance over that line (Meijster et al. 2000). Every pass splits into independent lines.
+int ComputeDistanceWindow(PisVox* pisV, PisDistanceField* field, Size min, Size max, Size writeMin, Size writeMax)
+{
+    if(min.x >= max.x || min.y >= max.y || min.z >= max.z)
+        return 0;
+
+    DistanceWindow window = {
+        .pisV = pisV,
+        .field = field,
+        .min = min,
+        .max = max,
+        .writeMin = writeMin,
+        .writeMax = writeMax,
+        .size = { max.x - min.x, max.y - min.y, max.z - min.z },
+    };
+
+    window.work = malloc(sizeof(uint16_t) * window.size.x * window.size.y * window.size.z);
+    if(window.work == NULL)
+    {
+        fprintf(stderr, "Failed to allocate distance field work buffer\n");
+        return -1;
+    }
+
+    uint32_t threadCount = PisGetCoreCount();
+
+    PisJobsRun(DistancePassXJob, &window, window.size.z, threadCount);
+    PisJobsRun(DistancePassYJob, &window, window.size.z, threadCount);
+    PisJobsRun(DistancePassZJob, &window, window.size.y, threadCount);
+
+    free(window.work);
+
+    if(window.failed)
+    {
+        fprintf(stderr, "Failed to compute distance field\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+void DistancePassXJob(void* userData, uint32_t jobIndex)
+{
+    DistanceWindow* window = userData;
+    PisVox* pisV = window->pisV;
+    Size size = window->size;
+
+    for(uint32_t y = 0; y < size.y; y++)
+    {
+        const uint8_t* voxels = pisV->voxels + ((size_t)(window->min.z + jobIndex) * pisV->size.y + window->min.y + y) * pisV->size.x + window->min.x;
+        uint16_t* line = window->work + ((size_t)jobIndex * size.y + y) * size.x;
+
+        uint32_t distance = DISTANCE_INFINITY;
+        for(uint32_t x = 0; x < size.x; x++)
+        {
+            distance = voxels[x] != 0 ? 0 : (distance < DISTANCE_INFINITY ? distance + 1 : DISTANCE_INFINITY);
+            line[x] = (uint16_t)distance;
+        }
+
+        distance = DISTANCE_INFINITY;
+        for(uint32_t x = size.x; x-- > 0;)
+        {
+            distance = line[x] == 0 ? 0 : (distance < DISTANCE_INFINITY ? distance + 1 : DISTANCE_INFINITY);
+            if(distance < line[x])
+                line[x] = (uint16_t)distance;
+        }
+    }
+}
+
+void DistancePassYJob(void* userData, uint32_t jobIndex)
+{
+    DistanceWindow* window = userData;
+    Size size = window->size;
+
+    uint16_t* g = malloc(sizeof(uint16_t) * size.y * 2);
+    int32_t* stack = malloc(sizeof(int32_t) * size.y * 2);
+    if(g == NULL || stack == NULL)
+    {
+        window->failed = 1;
+        free(g);
+        free(stack);
+        return;
+    }
+
+    uint16_t* slice = window->work + (size_t)jobIndex * size.y * size.x;
+
+    for(uint32_t x = 0; x < size.x; x++)
+    {
+        for(uint32_t y = 0; y < size.y; y++)
+            g[y] = slice[(size_t)y * size.x + x];
+
+        ChebyshevLine(g, size.y, stack, stack + size.y, g + size.y);
+
+        for(uint32_t y = 0; y < size.y; y++)
+            slice[(size_t)y * size.x + x] = g[size.y + y];
+    }
+
+    free(g);
+    free(stack);
+}
+
+void DistancePassZJob(void* userData, uint32_t jobIndex)
+{
+    DistanceWindow* window = userData;
+    PisDistanceField* field = window->field;
+    Size size = window->size;
+
+    uint32_t y = window->min.y + jobIndex;
+    if(y < window->writeMin.y || y >= window->writeMax.y)
+        return;
+
+    uint16_t* g = malloc(sizeof(uint16_t) * size.z * 2);
+    int32_t* stack = malloc(sizeof(int32_t) * size.z * 2);
+    if(g == NULL || stack == NULL)
+    {
+        window->failed = 1;
+        free(g);
+        free(stack);
+        return;
+    }
+
+    size_t sliceSize = (size_t)size.x * size.y;
+
+    for(uint32_t x = window->writeMin.x; x < window->writeMax.x; x++)
+    {
+        size_t column = (size_t)jobIndex * size.x + (x - window->min.x);
+
+        for(uint32_t z = 0; z < size.z; z++)
+            g[z] = window->work[z * sliceSize + column];
+
+        ChebyshevLine(g, size.z, stack, stack + size.z, g + size.z);
+
+        for(uint32_t z = window->writeMin.z; z < window->writeMax.z; z++)
+        {
+            uint16_t distance = g[size.z + z - window->min.z];
+            field->distance[((size_t)z * field->size.y + y) * field->size.x + x] = (uint8_t)(distance < PIS_DISTANCE_MAX ? distance : PIS_DISTANCE_MAX);
+        }
+    }
+
+    free(g);
+    free(stack);
+}
+
+// out[u] = min over i of max(|u - i|, g[i]), from the lower envelope of those functions
+void ChebyshevLine(const uint16_t* g, uint32_t count, int32_t* s, int32_t* t, uint16_t* out)
+{
+    #define F(u, i) ((int32_t)g[i] > abs((int32_t)(u) - (int32_t)(i)) ? (int32_t)g[i] : abs((int32_t)(u) - (int32_t)(i)))
+
+    int32_t q = 0;
+    s[0] = 0;
+    t[0] = 0;
+
+    for(int32_t u = 1; u < (int32_t)count; u++)
+    {
+        while(q >= 0 && F(t[q], s[q]) > F(t[q], u))
+            q--;
+
+        if(q < 0)
+        {
+            q = 0;
+            s[0] = u;
+            continue;
+        }
+
+        // First position where u is at least as close as s[q]
+        int32_t i = s[q];
+        int32_t middle = (i + u) / 2;
+        int32_t separator = g[i] <= g[u] ? (i + g[u] > middle ? i + g[u] : middle)
+                                         : (u - g[i] < middle ? u - g[i] : middle);
+
+        int32_t w = separator + 1;
+        if(w < (int32_t)count)
+        {
+            q++;
+            s[q] = u;
+            t[q] = w;
+        }
+    }
+
+    for(int32_t u = (int32_t)count - 1; u >= 0; u--)
+    {
+        int32_t distance = F(u, s[q]);
+        out[u] = (uint16_t)(distance < DISTANCE_INFINITY ? distance : DISTANCE_INFINITY);
+
+        if(u == t[q])
+            q--;
+    }
+
+    #undef F
+}
+
+Size GrowBox(Size value, int32_t amount, Size limit)
+{
+    int64_t grown[3] = { (int64_t)value.x + amount, (int64_t)value.y + amount, (int64_t)value.z + amount };
+    uint32_t limits[3] = { limit.x, limit.y, limit.z };
+
+    for(uint32_t axis = 0; axis < 3; axis++)
+        grown[axis] = grown[axis] < 0 ? 0 : (grown[axis] > limits[axis] ? limits[axis] : grown[axis]);
+
+    return (Size){ (uint32_t)grown[0], (uint32_t)grown[1], (uint32_t)grown[2] };
+}
@@ -0,0 +1,28 @@
+#ifndef PIS_DISTANCE_H
+#define PIS_DISTANCE_H
+
+#include <stdint.h>
+
+#include "pisVoxReader.h"
+
+// Distances are clamped to this, so an edit only changes the distances within this many voxels.
+// voxel.comp does not depend on the value.
+#define PIS_DISTANCE_MAX 16
+
+// Chebyshev distance from every voxel to the nearest solid voxel, 0 for solid voxels. All voxels
+// less than the distance away from a voxel are air. Laid out like PisVox.voxels.
+typedef struct PisDistanceField {
+    Size size;
+    uint8_t* distance;
+} PisDistanceField;
+
+int PisDistanceFieldBuild(PisVox* pisV, PisDistanceField* field);
+
+// Recomputes the distances an edit of the voxels in editMin..editMax (exclusive) can change,
+// which is the edit grown by PIS_DISTANCE_MAX. That region is returned in updatedMin..updatedMax.
+int PisDistanceFieldUpdate(PisVox* pisV, PisDistanceField* field, Size editMin, Size editMax,
+                           Size* updatedMin, Size* updatedMax);
+
+void DestroyPisDistanceField(PisDistanceField field);
+
+#endif
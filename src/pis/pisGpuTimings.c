@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "pisGpuTimings.h"
+
+/* =================================Helper functions================================ */
+double TicksToMs(PisGpuTimings* timings, uint64_t begin, uint64_t end);
+uint32_t WindowCount(PisGpuTimings* timings);
+/* ================================================================================ */
+
+int PisGpuTimingsCreate(VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, bool print,
+                        const char* csvFile, PisGpuTimings* timings)
+{
+    memset(timings, 0, sizeof(PisGpuTimings));
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, NULL);
+
+    VkQueueFamilyProperties families[familyCount + 1];
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families);
+
+    uint32_t validBits = queueFamilyIndex < familyCount ? families[queueFamilyIndex].timestampValidBits : 0;
+    if(validBits == 0 || properties.limits.timestampPeriod == 0.0f)
+    {
+        fprintf(stderr, "The compute queue has no timestamps, GPU timings are off\n");
+        return -1;
+    }
+
+    timings->enabled = true;
+    timings->period = properties.limits.timestampPeriod;
+    timings->mask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+    timings->print = print;
+
+    if(csvFile != NULL)
+    {
+        // The table still works without the file
+        timings->csv = fopen(csvFile, "w");
+        if(timings->csv == NULL)
+        {
+            fprintf(stderr, "Failed to open %s\n", csvFile);
+            return 0;
+        }
+
+        fprintf(timings->csv, "frame");
+        for(uint32_t pass = 0; pass < PIS_GPU_PASS_COUNT; pass++)
+            fprintf(timings->csv, ",%s", PisGpuPassName((PisGpuPass)pass));
+        fprintf(timings->csv, ",total\n");
+    }
+
+    return 0;
+}
+
+void PisGpuTimingsAdd(PisGpuTimings* timings, const uint64_t* timestamps)
+{
+    uint32_t slot = timings->frameCount % PIS_GPU_TIMING_WINDOW;
+
+    for(uint32_t pass = 0; pass < PIS_GPU_PASS_COUNT; pass++)
+        timings->passMs[slot][pass] = TicksToMs(timings, timestamps[pass], timestamps[pass + 1]);
+    timings->frameMs[slot] = TicksToMs(timings, timestamps[0], timestamps[PIS_GPU_PASS_COUNT]);
+
+    if(timings->csv != NULL)
+    {
+        fprintf(timings->csv, "%llu", (unsigned long long)timings->frameCount);
+        for(uint32_t pass = 0; pass < PIS_GPU_PASS_COUNT; pass++)
+            fprintf(timings->csv, ",%.4f", timings->passMs[slot][pass]);
+        fprintf(timings->csv, ",%.4f\n", timings->frameMs[slot]);
+    }
+
+    timings->frameCount++;
+
+    if(timings->print && timings->frameCount % PIS_GPU_TIMING_WINDOW == 0)
+        PisGpuTimingsPrint(timings);
+}
+
+void PisGpuTimingsMean(PisGpuTimings* timings, double* passMs, double* frameMs)
+{
+    uint32_t count = WindowCount(timings);
+
+    double frameSum = 0.0;
+    for(uint32_t pass = 0; pass < PIS_GPU_PASS_COUNT; pass++)
+        passMs[pass] = 0.0;
+
+    for(uint32_t i = 0; i < count; i++)
+    {
+        for(uint32_t pass = 0; pass < PIS_GPU_PASS_COUNT; pass++)
+            passMs[pass] += timings->passMs[i][pass];
+        frameSum += timings->frameMs[i];
+    }
+
+    for(uint32_t pass = 0; pass < PIS_GPU_PASS_COUNT && count > 0; pass++)
+        passMs[pass] /= count;
+
+    if(frameMs != NULL)
+        *frameMs = count > 0 ? frameSum / count : 0.0;
+}
+
+void PisGpuTimingsPrint(PisGpuTimings* timings)
+{
+    uint32_t count = WindowCount(timings);
+    if(count == 0)
+        return;
+
+    double mean[PIS_GPU_PASS_COUNT], frameMean;
+    PisGpuTimingsMean(timings, mean, &frameMean);
+
+    printf("GPU ms over the last %u frames    mean      max\n", count);
+    for(uint32_t pass = 0; pass <= PIS_GPU_PASS_COUNT; pass++)
+    {
+        double max = 0.0;
+        for(uint32_t i = 0; i < count; i++)
+        {
+            double ms = pass < PIS_GPU_PASS_COUNT ? timings->passMs[i][pass] : timings->frameMs[i];
+            max = ms > max ? ms : max;
+        }
+
+        printf("  %-28s %8.3f %8.3f\n", pass < PIS_GPU_PASS_COUNT ? PisGpuPassName((PisGpuPass)pass) : "total",
+               pass < PIS_GPU_PASS_COUNT ? mean[pass] : frameMean, max);
+    }
+}
+
+const char* PisGpuPassName(PisGpuPass pass)
+{
+    switch(pass)
+    {
+        case PIS_GPU_PASS_TO_GENERAL:  return "to general";
+        case PIS_GPU_PASS_DISPATCH:    return "dispatch";
+        case PIS_GPU_PASS_TO_TRANSFER: return "to transfer";
+        case PIS_GPU_PASS_COPY:        return "copy";
+        case PIS_GPU_PASS_TO_PRESENT:  return "to present";
+        case PIS_GPU_PASS_COUNT:       break;
+    }
+
+    return "unknown";
+}
+
+void DestroyPisGpuTimings(PisGpuTimings* timings)
+{
+    if(timings->csv != NULL)
+        fclose(timings->csv);
+    timings->csv = NULL;
+}
+
+double TicksToMs(PisGpuTimings* timings, uint64_t begin, uint64_t end)
+{
+    return (double)((end - begin) & timings->mask) * timings->period / 1e6;
+}
+
+uint32_t WindowCount(PisGpuTimings* timings)
+{
+    return timings->frameCount < PIS_GPU_TIMING_WINDOW ? (uint32_t)timings->frameCount : PIS_GPU_TIMING_WINDOW;
+}
@@ -0,0 +1,68 @@
+#ifndef PIS_GPU_TIMINGS_H
+#define PIS_GPU_TIMINGS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "vulkan/volk.h"
+#include "vulkan/vulkan_core.h"
+
+// Frames the rolling table covers, it is printed once every this many frames
+#define PIS_GPU_TIMING_WINDOW 120
+
+// The parts of PisEngineDraw between two timestamps, in recording order
+typedef enum PisGpuPass {
+    // drawImage to GENERAL
+    PIS_GPU_PASS_TO_GENERAL = 0,
+    PIS_GPU_PASS_DISPATCH = 1,
+    // drawImage to TRANSFER_SRC, the swapchain image to TRANSFER_DST
+    PIS_GPU_PASS_TO_TRANSFER = 2,
+    // CopyImageToImage, or the copy into the readback buffer when headless
+    PIS_GPU_PASS_COPY = 3,
+    // The swapchain image to PRESENT_SRC, or the readback barrier when headless
+    PIS_GPU_PASS_TO_PRESENT = 4,
+    PIS_GPU_PASS_COUNT,
+} PisGpuPass;
+
+// One more timestamp than passes, every pass ends where the next one starts
+#define PIS_GPU_TIMESTAMP_COUNT (PIS_GPU_PASS_COUNT + 1)
+
+// Pass times of the last PIS_GPU_TIMING_WINDOW frames in milliseconds
+typedef struct PisGpuTimings {
+    // False when the compute queue has no timestamps
+    bool enabled;
+    // Nanoseconds per tick
+    float period;
+    // Timestamps only have this many valid bits, ticks wrap around at the top
+    uint64_t mask;
+
+    double passMs[PIS_GPU_TIMING_WINDOW][PIS_GPU_PASS_COUNT];
+    // First to last timestamp
+    double frameMs[PIS_GPU_TIMING_WINDOW];
+    // Frames added in total, the newest one is at (frameCount - 1) % PIS_GPU_TIMING_WINDOW
+    uint64_t frameCount;
+
+    bool print;
+    FILE* csv;
+} PisGpuTimings;
+
+// Timings for the queue family PisEngineDraw submits to. The table is printed to stdout when
+// print is set and every frame is added to csvFile when it is not NULL. Returns -1 and leaves
+// the timings disabled when the queue family has no timestamps.
+int PisGpuTimingsCreate(VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex, bool print,
+                        const char* csvFile, PisGpuTimings* timings);
+
+// Adds one frame's PIS_GPU_TIMESTAMP_COUNT raw timestamps
+void PisGpuTimingsAdd(PisGpuTimings* timings, const uint64_t* timestamps);
+
+// Means of the frames in the window, frameMs may be NULL
+void PisGpuTimingsMean(PisGpuTimings* timings, double* passMs, double* frameMs);
+
+void PisGpuTimingsPrint(PisGpuTimings* timings);
+
+const char* PisGpuPassName(PisGpuPass pass);
+
+void DestroyPisGpuTimings(PisGpuTimings* timings);
+
+#endif
@@ -0,0 +1,288 @@
+// posix_memalign is not part of C99, glibc only declares it with _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+
+#include "pisJobs.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct JobBatch {
+    PisJobFunction function;
+    void* userData;
+    uint32_t jobCount;
+    uint32_t nextJob;
+} JobBatch;
+
+/* =================================Helper functions================================ */
+void* JobWorker(void* data);
+void* PoolWorkerThread(void* data);
+void RunPoolJobs(PisJobPool* pool, uint32_t index);
+bool TakeJob(PisJobWorker* worker, uint32_t* job);
+bool StealJobs(PisJobWorker* victim, PisJobWorker* thief);
+uint64_t PackJobRange(uint32_t begin, uint32_t end);
+/* ================================================================================ */
+
+uint32_t PisGetCoreCount(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint32_t)count : 1;
+}
+
+void PisJobsRun(PisJobFunction function, void* userData, uint32_t jobCount, uint32_t threadCount)
+{
+    if(threadCount > jobCount)
+        threadCount = jobCount;
+
+    JobBatch batch = {
+        .function = function,
+        .userData = userData,
+        .jobCount = jobCount,
+        .nextJob = 0,
+    };
+
+    // Nothing to gain from threads, run everything right here
+    if(threadCount <= 1)
+    {
+        JobWorker(&batch);
+        return;
+    }
+
+    pthread_t* threads = malloc(sizeof(pthread_t) * (threadCount - 1));
+    uint32_t started = 0;
+
+    for(uint32_t i = 0; threads != NULL && i < threadCount - 1; i++)
+    {
+        if(pthread_create(&threads[i], NULL, JobWorker, &batch) != 0)
+        {
+            fprintf(stderr, "Failed to start job thread, continuing with %u\n", started + 1);
+            break;
+        }
+
+        started++;
+    }
+
+    JobWorker(&batch);
+
+    for(uint32_t i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+}
+
+// Jobs are handed out one at a time from a shared counter, so uneven jobs balance themselves
+void* JobWorker(void* data)
+{
+    JobBatch* batch = data;
+
+    for(;;)
+    {
+        uint32_t job = __atomic_fetch_add(&batch->nextJob, 1, __ATOMIC_RELAXED);
+        if(job >= batch->jobCount)
+            break;
+
+        batch->function(batch->userData, job);
+    }
+
+    return NULL;
+}
+
+int PisJobPoolCreate(uint32_t threadCount, PisJobPool* pool)
+{
+    memset(pool, 0, sizeof(PisJobPool));
+    pool->threadCount = threadCount > 0 ? threadCount : 1;
+
+    // The padding only keeps workers on their own cache lines when the array starts on one
+    void* workers = NULL;
+    if(posix_memalign(&workers, 64, sizeof(PisJobWorker) * pool->threadCount) == 0)
+    {
+        pool->workers = workers;
+        memset(pool->workers, 0, sizeof(PisJobWorker) * pool->threadCount);
+    }
+    pool->threads = malloc(sizeof(pthread_t) * pool->threadCount);
+
+    if(pool->workers == NULL || pool->threads == NULL)
+    {
+        fprintf(stderr, "Failed to allocate a job pool of %u threads\n", pool->threadCount);
+        free(pool->workers);
+        free(pool->threads);
+        pool->threads = NULL;
+        return -1;
+    }
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for(uint32_t i = 0; i < pool->threadCount; i++)
+    {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+    }
+
+    // Worker 0 is the thread calling PisJobPoolRun
+    uint32_t started = 1;
+    for(uint32_t i = 1; i < pool->threadCount; i++)
+    {
+        if(pthread_create(&pool->threads[i], NULL, PoolWorkerThread, &pool->workers[i]) != 0)
+        {
+            fprintf(stderr, "Failed to start job thread, continuing with %u\n", started);
+            break;
+        }
+
+        started++;
+    }
+
+    pool->threadCount = started;
+
+    return 0;
+}
+
+void PisJobPoolRun(PisJobPool* pool, PisJobFunction function, void* userData, uint32_t jobCount)
+{
+    pool->function = function;
+    pool->userData = userData;
+
+    // Contiguous blocks, so jobs next to each other in the image start on the same thread
+    for(uint32_t i = 0; i < pool->threadCount; i++)
+    {
+        uint32_t begin = (uint32_t)((uint64_t)jobCount * i / pool->threadCount);
+        uint32_t end = (uint32_t)((uint64_t)jobCount * (i + 1) / pool->threadCount);
+        __atomic_store_n(&pool->workers[i].range, PackJobRange(begin, end), __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->running = pool->threadCount - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    RunPoolJobs(pool, 0);
+
+    pthread_mutex_lock(&pool->mutex);
+    while(pool->running > 0)
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void DestroyPisJobPool(PisJobPool* pool)
+{
+    if(pool->threads == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for(uint32_t i = 1; i < pool->threadCount; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+
+    free(pool->threads);
+    free(pool->workers);
+    pool->threads = NULL;
+}
+
+void* PoolWorkerThread(void* data)
+{
+    PisJobWorker* worker = data;
+    PisJobPool* pool = worker->pool;
+    uint32_t seen = 0;
+
+    for(;;)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        while(pool->generation == seen && !pool->stop)
+            pthread_cond_wait(&pool->start, &pool->mutex);
+
+        seen = pool->generation;
+        bool stop = pool->stop;
+        pthread_mutex_unlock(&pool->mutex);
+
+        if(stop)
+            break;
+
+        RunPoolJobs(pool, worker->index);
+
+        pthread_mutex_lock(&pool->mutex);
+        if(--pool->running == 0)
+            pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    return NULL;
+}
+
+// Own jobs first, then half of whatever the next thread with jobs left still has
+void RunPoolJobs(PisJobPool* pool, uint32_t index)
+{
+    PisJobWorker* own = &pool->workers[index];
+
+    for(;;)
+    {
+        uint32_t job;
+        while(TakeJob(own, &job))
+            pool->function(pool->userData, job);
+
+        bool stole = false;
+        for(uint32_t i = 1; i < pool->threadCount && !stole; i++)
+            stole = StealJobs(&pool->workers[(index + i) % pool->threadCount], own);
+
+        if(!stole)
+            break;
+    }
+}
+
+// The owner takes from the front
+bool TakeJob(PisJobWorker* worker, uint32_t* job)
+{
+    uint64_t current = __atomic_load_n(&worker->range, __ATOMIC_RELAXED);
+
+    for(;;)
+    {
+        uint32_t begin = (uint32_t)current, end = (uint32_t)(current >> 32);
+        if(begin >= end)
+            return false;
+
+        if(__atomic_compare_exchange_n(&worker->range, &current, PackJobRange(begin + 1, end), true,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            *job = begin;
+            return true;
+        }
+    }
+}
+
+// Thieves take the back half. The thief's own range is empty by now and nobody steals from an
+// empty range, so it can simply be overwritten.
+bool StealJobs(PisJobWorker* victim, PisJobWorker* thief)
+{
+    uint64_t current = __atomic_load_n(&victim->range, __ATOMIC_RELAXED);
+
+    for(;;)
+    {
+        uint32_t begin = (uint32_t)current, end = (uint32_t)(current >> 32);
+        if(begin >= end)
+            return false;
+
+        uint32_t middle = begin + (end - begin) / 2;
+        if(__atomic_compare_exchange_n(&victim->range, &current, PackJobRange(begin, middle), true,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            __atomic_store_n(&thief->range, PackJobRange(middle, end), __ATOMIC_RELAXED);
+            return true;
+        }
+    }
+}
+
+uint64_t PackJobRange(uint32_t begin, uint32_t end)
+{
+    return (uint64_t)begin | ((uint64_t)end << 32);
+}
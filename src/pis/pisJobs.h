@@ -0,0 +1,54 @@
+#ifndef PIS_JOBS_H
+#define PIS_JOBS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef void (*PisJobFunction)(void* userData, uint32_t jobIndex);
+
+// One thread of a pool, padded to a cache line so threads taking jobs from their own range do
+// not slow each other down
+typedef struct PisJobWorker {
+    // Jobs this thread still has to run, begin in the low and end in the high 32 bits
+    uint64_t range;
+    struct PisJobPool* pool;
+    uint32_t index;
+    uint8_t _pad[44];
+} PisJobWorker;
+
+// Threads that stay around between runs, for work that is handed out every frame
+typedef struct PisJobPool {
+    pthread_t* threads;
+    // Including the thread that calls PisJobPoolRun
+    uint32_t threadCount;
+    PisJobWorker* workers;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    uint32_t generation;
+    uint32_t running;
+    bool stop;
+
+    PisJobFunction function;
+    void* userData;
+} PisJobPool;
+
+// Number of logical cores, at least 1
+uint32_t PisGetCoreCount(void);
+
+// Runs function for every job index in [0, jobCount) on up to threadCount threads.
+// The calling thread works along and the call returns once every job has finished.
+void PisJobsRun(PisJobFunction function, void* userData, uint32_t jobCount, uint32_t threadCount);
+
+// Starts threadCount - 1 threads, the caller of PisJobPoolRun is the last one
+int PisJobPoolCreate(uint32_t threadCount, PisJobPool* pool);
+
+// Like PisJobsRun, but every thread starts on its own contiguous block of jobs and steals half
+// of the jobs another thread has left once its own run out. Neighbouring jobs stay on one thread.
+void PisJobPoolRun(PisJobPool* pool, PisJobFunction function, void* userData, uint32_t jobCount);
+
+void DestroyPisJobPool(PisJobPool* pool);
+
+#endif
@@ -0,0 +1,156 @@
+#include "pisOccupancy.h"
+#include "pisJobs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct OccupancyBuild {
+    PisVox* pisV;
+    Size cells;
+    uint32_t cellSize;
+    uint8_t* occupied;
+} OccupancyBuild;
+
+/* =================================Helper functions================================ */
+void MarkCellsJob(void* userData, uint32_t jobIndex);
+void BuildNextLevel(const uint8_t* fine, Size fineSize, uint8_t* coarse, Size coarseSize);
+/* ================================================================================ */
+
+int PisOccupancyBuild(PisVox* pisV, uint32_t firstLevel, PisOccupancy* occupancy)
+{
+    memset(occupancy, 0, sizeof(PisOccupancy));
+
+    if(firstLevel >= PIS_OCCUPANCY_LEVELS)
+    {
+        fprintf(stderr, "Occupancy has no level %u\n", firstLevel);
+        return -1;
+    }
+
+    uint8_t* occupied[PIS_OCCUPANCY_LEVELS] = {0};
+    uint32_t cellSize = PIS_OCCUPANCY_BASE;
+
+    for(uint32_t level = 0; level < firstLevel; level++)
+        cellSize *= PIS_OCCUPANCY_FACTOR;
+
+    uint32_t firstCellSize = cellSize;
+
+    for(uint32_t level = firstLevel; level < PIS_OCCUPANCY_LEVELS; level++)
+    {
+        Size size = {
+            (pisV->size.x + cellSize - 1) / cellSize,
+            (pisV->size.y + cellSize - 1) / cellSize,
+            (pisV->size.z + cellSize - 1) / cellSize,
+        };
+        size_t cellCount = (size_t)size.x * size.y * size.z;
+
+        occupancy->levelSize[level] = size;
+        occupancy->levelOffset[level] = occupancy->wordCount;
+        occupancy->wordCount += (cellCount + 31) / 32;
+
+        // One byte per cell while building, so workers never share a word
+        occupied[level] = calloc(cellCount ? cellCount : 1, 1);
+        if(occupied[level] == NULL)
+        {
+            fprintf(stderr, "Failed to allocate occupancy level %u\n", level);
+            for(uint32_t i = firstLevel; i < level; i++)
+                free(occupied[i]);
+            return -1;
+        }
+
+        cellSize *= PIS_OCCUPANCY_FACTOR;
+    }
+
+    occupancy->bits = calloc(occupancy->wordCount ? occupancy->wordCount : 1, sizeof(uint32_t));
+    if(occupancy->bits == NULL)
+    {
+        fprintf(stderr, "Failed to allocate occupancy bits\n");
+        for(uint32_t i = firstLevel; i < PIS_OCCUPANCY_LEVELS; i++)
+            free(occupied[i]);
+        return -1;
+    }
+
+    // Only the first level touches the voxels
+    PisOccupancyMarkCells(pisV, firstCellSize, occupancy->levelSize[firstLevel], occupied[firstLevel]);
+
+    for(uint32_t level = firstLevel + 1; level < PIS_OCCUPANCY_LEVELS; level++)
+        BuildNextLevel(occupied[level - 1], occupancy->levelSize[level - 1], occupied[level], occupancy->levelSize[level]);
+
+    for(uint32_t level = firstLevel; level < PIS_OCCUPANCY_LEVELS; level++)
+    {
+        Size size = occupancy->levelSize[level];
+        size_t cellCount = (size_t)size.x * size.y * size.z;
+        uint32_t* bits = occupancy->bits + occupancy->levelOffset[level];
+
+        for(size_t i = 0; i < cellCount; i++)
+        {
+            if(occupied[level][i])
+                bits[i / 32] |= 1u << (i % 32);
+        }
+
+        free(occupied[level]);
+    }
+
+    return 0;
+}
+
+void DestroyPisOccupancy(PisOccupancy occupancy)
+{
+    free(occupancy.bits);
+}
+
+void PisOccupancyMarkCells(PisVox* pisV, uint32_t cellSize, Size cells, uint8_t* occupied)
+{
+    OccupancyBuild build = {
+        .pisV = pisV,
+        .cells = cells,
+        .cellSize = cellSize,
+        .occupied = occupied,
+    };
+
+    PisJobsRun(MarkCellsJob, &build, cells.z, PisGetCoreCount());
+}
+
+void MarkCellsJob(void* userData, uint32_t jobIndex)
+{
+    OccupancyBuild* build = userData;
+    Size size = build->pisV->size;
+
+    uint32_t zStart = jobIndex * build->cellSize;
+    uint32_t zEnd = zStart + build->cellSize < size.z ? zStart + build->cellSize : size.z;
+
+    uint8_t* cells = build->occupied + (size_t)jobIndex * build->cells.x * build->cells.y;
+
+    for(uint32_t z = zStart; z < zEnd; z++)
+    {
+        for(uint32_t y = 0; y < size.y; y++)
+        {
+            const uint8_t* row = build->pisV->voxels + ((size_t)z * size.y + y) * size.x;
+            uint8_t* cellRow = cells + (size_t)(y / build->cellSize) * build->cells.x;
+
+            for(uint32_t x = 0; x < size.x; x++)
+            {
+                if(row[x] != 0)
+                    cellRow[x / build->cellSize] = 1;
+            }
+        }
+    }
+}
+
+void BuildNextLevel(const uint8_t* fine, Size fineSize, uint8_t* coarse, Size coarseSize)
+{
+    for(uint32_t z = 0; z < fineSize.z; z++)
+    {
+        for(uint32_t y = 0; y < fineSize.y; y++)
+        {
+            const uint8_t* row = fine + ((size_t)z * fineSize.y + y) * fineSize.x;
+            uint8_t* coarseRow = coarse + ((size_t)(z / PIS_OCCUPANCY_FACTOR) * coarseSize.y + y / PIS_OCCUPANCY_FACTOR) * coarseSize.x;
+
+            for(uint32_t x = 0; x < fineSize.x; x++)
+            {
+                if(row[x])
+                    coarseRow[x / PIS_OCCUPANCY_FACTOR] = 1;
+            }
+        }
+    }
+}
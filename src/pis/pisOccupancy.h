@@ -0,0 +1,35 @@
+#ifndef PIS_OCCUPANCY_H
+#define PIS_OCCUPANCY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pisVoxReader.h"
+
+// Cells of the first level are PIS_OCCUPANCY_BASE voxels wide, every next level is
+// PIS_OCCUPANCY_FACTOR times wider (1, 4, 16 voxels). voxel.comp has to use the same values.
+// The first level is a bit per voxel, so rays only fetch the materials of solid voxels.
+#define PIS_OCCUPANCY_LEVELS 3
+#define PIS_OCCUPANCY_BASE 1
+#define PIS_OCCUPANCY_FACTOR 4
+
+// One bit per cell, set when any voxel in the cell is solid. Bits run x, then y, then z, and
+// every level starts on a new uint32 right after the previous one. Levels below firstLevel
+// are left out, they have no cells and take no words.
+typedef struct PisOccupancy {
+    Size levelSize[PIS_OCCUPANCY_LEVELS];
+    size_t levelOffset[PIS_OCCUPANCY_LEVELS];
+    uint32_t* bits;
+    size_t wordCount;
+} PisOccupancy;
+
+// The brickmap starts at level 1, a bit per voxel would grow with the volume instead of the bricks
+int PisOccupancyBuild(PisVox* pisV, uint32_t firstLevel, PisOccupancy* occupancy);
+void DestroyPisOccupancy(PisOccupancy occupancy);
+
+// Sets the byte of every cell of cellSize^3 voxels that holds a solid voxel, cells are the cell
+// counts rounded up and occupied has to start zeroed. The brickmap and the octree mark their
+// first level with this too. Runs a job per layer of cells.
+void PisOccupancyMarkCells(PisVox* pisV, uint32_t cellSize, Size cells, uint8_t* occupied);
+
+#endif
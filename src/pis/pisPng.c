@@ -0,0 +1,157 @@
+#include "pisPng.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Longest block deflate can store without compressing it
+#define PNG_STORED_BLOCK 65535
+
+/* =================================Helper functions================================ */
+int WritePngChunk(FILE* fptr, const char* type, const uint8_t* data, uint32_t size);
+uint32_t PngCrc(uint32_t crc, const uint8_t* data, size_t size);
+void PutBigEndian(uint8_t* dst, uint32_t value);
+/* ================================================================================ */
+
+int PisPngWrite(const char* fileName, uint32_t width, uint32_t height, const uint8_t* rgb)
+{
+    // Every row starts with its filter type, 0 for none
+    size_t rowSize = (size_t)width * 3 + 1;
+    size_t rawSize = rowSize * height;
+    size_t blockCount = (rawSize + PNG_STORED_BLOCK - 1) / PNG_STORED_BLOCK;
+
+    // zlib header, a 5 byte header per stored block and the adler32 at the end
+    size_t dataSize = 2 + blockCount * 5 + rawSize + 4;
+    if(dataSize > UINT32_MAX)
+    {
+        fprintf(stderr, "Image too large for one PNG chunk: %ux%u\n", width, height);
+        return -1;
+    }
+
+    uint8_t* data = malloc(dataSize);
+    uint8_t* raw = malloc(rawSize + 1);
+    if(data == NULL || raw == NULL)
+    {
+        fprintf(stderr, "Failed to allocate\n");
+        free(data);
+        free(raw);
+        return -1;
+    }
+
+    for(uint32_t y = 0; y < height; y++)
+    {
+        raw[y * rowSize] = 0;
+        memcpy(raw + y * rowSize + 1, rgb + (size_t)y * width * 3, (size_t)width * 3);
+    }
+
+    uint8_t* dst = data;
+    *dst++ = 0x78;
+    *dst++ = 0x01;
+
+    uint32_t a = 1, b = 0;
+    for(size_t offset = 0; offset < rawSize; offset += PNG_STORED_BLOCK)
+    {
+        uint32_t length = rawSize - offset < PNG_STORED_BLOCK ? (uint32_t)(rawSize - offset) : PNG_STORED_BLOCK;
+
+        *dst++ = offset + length == rawSize ? 1 : 0;
+        *dst++ = length & 0xFF;
+        *dst++ = length >> 8;
+        *dst++ = ~length & 0xFF;
+        *dst++ = (~length >> 8) & 0xFF;
+
+        memcpy(dst, raw + offset, length);
+        dst += length;
+
+        for(uint32_t i = 0; i < length; i++)
+        {
+            a = (a + raw[offset + i]) % 65521;
+            b = (b + a) % 65521;
+        }
+    }
+
+    PutBigEndian(dst, (b << 16) | a);
+
+    uint8_t header[13];
+    PutBigEndian(header, width);
+    PutBigEndian(header + 4, height);
+    header[8] = 8;   // bits per channel
+    header[9] = 2;   // rgb
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+
+    FILE* fptr = fopen(fileName, "wb");
+    if(fptr == NULL)
+    {
+        fprintf(stderr, "Failed to write file: %s\n", fileName);
+        free(data);
+        free(raw);
+        return -1;
+    }
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    int result = fwrite(signature, 1, sizeof(signature), fptr) == sizeof(signature) ? 0 : -1;
+    result |= WritePngChunk(fptr, "IHDR", header, sizeof(header));
+    result |= WritePngChunk(fptr, "IDAT", data, (uint32_t)dataSize);
+    result |= WritePngChunk(fptr, "IEND", NULL, 0);
+
+    fclose(fptr);
+    free(data);
+    free(raw);
+
+    if(result != 0)
+        fprintf(stderr, "Failed to write file: %s\n", fileName);
+
+    return result;
+}
+
+int WritePngChunk(FILE* fptr, const char* type, const uint8_t* data, uint32_t size)
+{
+    uint8_t bytes[4];
+
+    PutBigEndian(bytes, size);
+    if(fwrite(bytes, 1, 4, fptr) != 4 || fwrite(type, 1, 4, fptr) != 4)
+        return -1;
+
+    if(size > 0 && fwrite(data, 1, size, fptr) != size)
+        return -1;
+
+    // The crc covers the type and the data
+    uint32_t crc = PngCrc(0xFFFFFFFFu, (const uint8_t*)type, 4);
+    crc = PngCrc(crc, data, size) ^ 0xFFFFFFFFu;
+
+    PutBigEndian(bytes, crc);
+    return fwrite(bytes, 1, 4, fptr) == 4 ? 0 : -1;
+}
+
+uint32_t PngCrc(uint32_t crc, const uint8_t* data, size_t size)
+{
+    static uint32_t table[256];
+    static int tableReady = 0;
+
+    if(!tableReady)
+    {
+        for(uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for(int k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        tableReady = 1;
+    }
+
+    for(size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+    return crc;
+}
+
+void PutBigEndian(uint8_t* dst, uint32_t value)
+{
+    dst[0] = value >> 24;
+    dst[1] = (value >> 16) & 0xFF;
+    dst[2] = (value >> 8) & 0xFF;
+    dst[3] = value & 0xFF;
+}
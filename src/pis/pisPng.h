@@ -0,0 +1,10 @@
+#ifndef PIS_PNG_H
+#define PIS_PNG_H
+
+#include <stdint.h>
+
+// Writes 8 bit rgb rows from the top as an uncompressed PNG, which every viewer opens without
+// pulling in zlib. Returns 0 on success.
+int PisPngWrite(const char* fileName, uint32_t width, uint32_t height, const uint8_t* rgb);
+
+#endif
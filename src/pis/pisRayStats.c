@@ -0,0 +1,45 @@
+#include <stdio.h>
+
+#include "pisRayStats.h"
+
+/* =================================Helper functions================================ */
+double Percent(uint32_t part, uint32_t whole);
+/* ================================================================================ */
+
+void PisRayStatsPrint(const PisRayStats* stats)
+{
+    uint32_t hits = stats->primaryRays - stats->cappedRays - stats->skyExits;
+
+    printf("Rays %u: %.1f%% hit, %.1f%% sky, %.2f%% capped at %u steps, %.1f steps on average\n",
+           stats->primaryRays, Percent(hits, stats->primaryRays), Percent(stats->skyExits, stats->primaryRays),
+           Percent(stats->cappedRays, stats->primaryRays), PIS_RAY_STATS_MAX_STEPS,
+           stats->primaryRays > 0 ? (double)stats->primarySteps / stats->primaryRays : 0.0);
+
+    printf("Shadow rays %u: %.1f steps on average, %.2f%% capped\n", stats->shadowRays,
+           stats->shadowRays > 0 ? (double)stats->shadowSteps / stats->shadowRays : 0.0,
+           Percent(stats->shadowCapped, stats->shadowRays));
+
+    // Only the buckets that hold rays, the percentile where the rays run out is the useful part
+    uint32_t bucketSteps = PIS_RAY_STATS_MAX_STEPS / PIS_RAY_STATS_BUCKETS;
+    uint32_t counted = 0;
+    for(uint32_t i = 0; i < PIS_RAY_STATS_BUCKETS; i++)
+    {
+        if(stats->stepHistogram[i] == 0)
+            continue;
+
+        // The last bucket also holds the capped rays
+        counted += stats->stepHistogram[i];
+        if(i + 1 < PIS_RAY_STATS_BUCKETS)
+            printf("  %3u-%3u steps", i * bucketSteps, (i + 1) * bucketSteps - 1);
+        else
+            printf("  %3u+    steps", i * bucketSteps);
+
+        printf(" %6.2f%%  %6.2f%% up to here\n", Percent(stats->stepHistogram[i], stats->primaryRays),
+               Percent(counted, stats->primaryRays));
+    }
+}
+
+double Percent(uint32_t part, uint32_t whole)
+{
+    return whole > 0 ? 100.0 * part / whole : 0.0;
+}
@@ -0,0 +1,40 @@
+#ifndef PIS_RAY_STATS_H
+#define PIS_RAY_STATS_H
+
+#include <stdint.h>
+
+// Buckets of the primary ray step histogram, MAX_STEPS / PIS_RAY_STATS_BUCKETS steps each.
+// voxel.comp has to use the same values.
+#define PIS_RAY_STATS_BUCKETS 64
+#define PIS_RAY_STATS_MAX_STEPS 512
+
+// Frames between two printed summaries
+#define PIS_RAY_STATS_INTERVAL 120
+
+typedef enum PisDebugView {
+    PIS_DEBUG_VIEW_OFF = 0,
+    // Normal image, traceRayInternal fills PisRayStats
+    PIS_DEBUG_VIEW_STATS = 1,
+    // The steps of every pixel as a heatmap instead of the image, stats are filled too
+    PIS_DEBUG_VIEW_HEATMAP = 2,
+    PIS_DEBUG_VIEW_COUNT,
+} PisDebugView;
+
+// One frame's traversal counts as voxel.comp adds them up, binding 7. A step is one iteration
+// of the traversal loop, a skip over empty space counts as one step too.
+typedef struct PisRayStats {
+    uint32_t stepHistogram[PIS_RAY_STATS_BUCKETS];
+    uint32_t primaryRays;
+    uint32_t primarySteps;
+    // Stopped by MAX_STEPS before hitting anything or leaving the world, drawn as sky
+    uint32_t cappedRays;
+    // Left the world without hitting anything
+    uint32_t skyExits;
+    uint32_t shadowRays;
+    uint32_t shadowSteps;
+    uint32_t shadowCapped;
+} PisRayStats;
+
+void PisRayStatsPrint(const PisRayStats* stats);
+
+#endif
@@ -0,0 +1,273 @@
+#include "pisSvo.h"
+#include "pisOccupancy.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct SvoLevel {
+    Size size;
+    uint8_t* occupied;
+} SvoLevel;
+
+typedef struct SvoNodeList {
+    uint32_t* word;
+    Size* cell;
+    size_t count;
+} SvoNodeList;
+
+/* =================================Helper functions================================ */
+void BuildSvoParentLevel(const SvoLevel* fine, SvoLevel* coarse);
+bool SvoCellOccupied(PisVox* pisV, SvoLevel* levels, uint32_t level, uint32_t x, uint32_t y, uint32_t z);
+int EmitSvoNodes(PisVox* pisV, SvoLevel* levels, PisSvo* svo);
+int ReserveSvoWords(PisSvo* svo, size_t* capacity, size_t count, size_t* first);
+/* ================================================================================ */
+
+uint32_t PisSvoDepth(Size size)
+{
+    uint32_t largest = size.x > size.y ? size.x : size.y;
+    largest = largest > size.z ? largest : size.z;
+
+    uint32_t depth = 1;
+    while(depth < PIS_SVO_MAX_DEPTH && (1u << depth) < largest)
+        depth++;
+
+    return depth;
+}
+
+int PisSvoBuild(PisVox* pisV, PisSvo* svo)
+{
+    memset(svo, 0, sizeof(PisSvo));
+
+    svo->depth = PisSvoDepth(pisV->size);
+    if((1u << svo->depth) < pisV->size.x || (1u << svo->depth) < pisV->size.y || (1u << svo->depth) < pisV->size.z)
+    {
+        fprintf(stderr, "Volume of %ux%ux%u is too big for an octree\n", pisV->size.x, pisV->size.y, pisV->size.z);
+        return -1;
+    }
+
+    // levels[l] says which cells of 2^l voxels hold anything, level 0 are the voxels themselves
+    SvoLevel levels[PIS_SVO_MAX_DEPTH + 1] = {0};
+
+    int result = 0;
+    for(uint32_t level = 1; level <= svo->depth && result == 0; level++)
+    {
+        uint32_t cellSize = 1u << level;
+        levels[level].size = (Size){
+            (pisV->size.x + cellSize - 1) / cellSize,
+            (pisV->size.y + cellSize - 1) / cellSize,
+            (pisV->size.z + cellSize - 1) / cellSize,
+        };
+
+        size_t cellCount = (size_t)levels[level].size.x * levels[level].size.y * levels[level].size.z;
+        levels[level].occupied = calloc(cellCount ? cellCount : 1, 1);
+        if(levels[level].occupied == NULL)
+        {
+            fprintf(stderr, "Failed to allocate octree level %u\n", level);
+            result = -1;
+        }
+    }
+
+    if(result == 0)
+    {
+        // The first level reads every voxel, so it is split over layers of cells
+        PisOccupancyMarkCells(pisV, 2, levels[1].size, levels[1].occupied);
+
+        for(uint32_t level = 2; level <= svo->depth; level++)
+            BuildSvoParentLevel(&levels[level - 1], &levels[level]);
+
+        result = EmitSvoNodes(pisV, levels, svo);
+    }
+
+    for(uint32_t level = 1; level <= svo->depth; level++)
+        free(levels[level].occupied);
+
+    if(result != 0)
+    {
+        free(svo->nodes);
+        svo->nodes = NULL;
+    }
+
+    return result;
+}
+
+void DestroyPisSvo(PisSvo svo)
+{
+    free(svo.nodes);
+}
+
+void BuildSvoParentLevel(const SvoLevel* fine, SvoLevel* coarse)
+{
+    for(uint32_t z = 0; z < fine->size.z; z++)
+    {
+        for(uint32_t y = 0; y < fine->size.y; y++)
+        {
+            const uint8_t* row = fine->occupied + ((size_t)z * fine->size.y + y) * fine->size.x;
+            uint8_t* coarseRow = coarse->occupied + ((size_t)(z / 2) * coarse->size.y + y / 2) * coarse->size.x;
+
+            for(uint32_t x = 0; x < fine->size.x; x++)
+            {
+                if(row[x])
+                    coarseRow[x / 2] = 1;
+            }
+        }
+    }
+}
+
+bool SvoCellOccupied(PisVox* pisV, SvoLevel* levels, uint32_t level, uint32_t x, uint32_t y, uint32_t z)
+{
+    Size size = level == 0 ? pisV->size : levels[level].size;
+    if(x >= size.x || y >= size.y || z >= size.z)
+        return false;
+
+    if(level == 0)
+        return pisV->voxels[((size_t)z * size.y + y) * size.x + x] != 0;
+
+    return levels[level].occupied[((size_t)z * size.y + y) * size.x + x] != 0;
+}
+
+// Writes the tree breadth first, so the children of a node always follow each other
+int EmitSvoNodes(PisVox* pisV, SvoLevel* levels, PisSvo* svo)
+{
+    size_t capacity = 0;
+    size_t root;
+    if(ReserveSvoWords(svo, &capacity, 1, &root) != 0)
+        return -1;
+
+    SvoNodeList current = {
+        .word = malloc(sizeof(uint32_t)),
+        .cell = malloc(sizeof(Size)),
+        .count = 1,
+    };
+
+    if(current.word == NULL || current.cell == NULL)
+    {
+        free(current.word);
+        free(current.cell);
+        return -1;
+    }
+
+    current.word[0] = (uint32_t)root;
+    current.cell[0] = (Size){ 0, 0, 0 };
+
+    int result = 0;
+
+    for(uint32_t level = svo->depth; level >= 1 && result == 0; level--)
+    {
+        svo->levelNodeCount[svo->depth - level] = (uint32_t)current.count;
+
+        // Every child of this level that holds anything becomes a node of the next one
+        SvoNodeList next = {0};
+        if(level > 1)
+        {
+            size_t childCount = 0;
+            for(size_t i = 0; i < current.count; i++)
+            {
+                Size cell = current.cell[i];
+                for(uint32_t child = 0; child < 8; child++)
+                    childCount += SvoCellOccupied(pisV, levels, level - 1, cell.x * 2 + (child & 1), cell.y * 2 + ((child >> 1) & 1), cell.z * 2 + (child >> 2));
+            }
+
+            next.word = malloc(sizeof(uint32_t) * (childCount ? childCount : 1));
+            next.cell = malloc(sizeof(Size) * (childCount ? childCount : 1));
+            if(next.word == NULL || next.cell == NULL)
+            {
+                fprintf(stderr, "Failed to allocate %zu octree nodes\n", childCount);
+                free(next.word);
+                free(next.cell);
+                result = -1;
+                break;
+            }
+        }
+
+        for(size_t i = 0; i < current.count && result == 0; i++)
+        {
+            Size cell = current.cell[i];
+
+            uint32_t mask = 0;
+            for(uint32_t child = 0; child < 8; child++)
+            {
+                if(SvoCellOccupied(pisV, levels, level - 1, cell.x * 2 + (child & 1), cell.y * 2 + ((child >> 1) & 1), cell.z * 2 + (child >> 2)))
+                    mask |= 1u << child;
+            }
+
+            size_t first = 0;
+            if(mask != 0)
+            {
+                // The lowest nodes store their 8 voxels, all others their existing children
+                uint32_t childWords = level == 1 ? 2 : (uint32_t)__builtin_popcount(mask);
+
+                if(ReserveSvoWords(svo, &capacity, childWords, &first) != 0)
+                {
+                    result = -1;
+                    break;
+                }
+
+                uint32_t stored = 0;
+                for(uint32_t child = 0; child < 8; child++)
+                {
+                    Size childCell = { cell.x * 2 + (child & 1), cell.y * 2 + ((child >> 1) & 1), cell.z * 2 + (child >> 2) };
+
+                    if(level == 1)
+                    {
+                        if(mask & (1u << child))
+                        {
+                            uint8_t material = pisV->voxels[((size_t)childCell.z * pisV->size.y + childCell.y) * pisV->size.x + childCell.x];
+                            svo->nodes[first + child / 4] |= (uint32_t)material << ((child % 4) * 8);
+                        }
+                    }
+                    else if(mask & (1u << child))
+                    {
+                        next.word[next.count] = (uint32_t)(first + stored++);
+                        next.cell[next.count] = childCell;
+                        next.count++;
+                    }
+                }
+            }
+
+            svo->nodes[current.word[i]] = (uint32_t)(first << 8) | mask;
+        }
+
+        free(current.word);
+        free(current.cell);
+        current = next;
+    }
+
+    free(current.word);
+    free(current.cell);
+
+    return result;
+}
+
+int ReserveSvoWords(PisSvo* svo, size_t* capacity, size_t count, size_t* first)
+{
+    if(svo->wordCount + count > PIS_SVO_MAX_WORDS)
+    {
+        fprintf(stderr, "Octree needs more than %u words, child pointers would not fit\n", PIS_SVO_MAX_WORDS);
+        return -1;
+    }
+
+    if(svo->wordCount + count > *capacity)
+    {
+        size_t newCapacity = *capacity ? *capacity * 2 : 1024;
+        while(newCapacity < svo->wordCount + count)
+            newCapacity *= 2;
+
+        uint32_t* nodes = realloc(svo->nodes, sizeof(uint32_t) * newCapacity);
+        if(nodes == NULL)
+        {
+            fprintf(stderr, "Failed to allocate octree nodes\n");
+            return -1;
+        }
+
+        svo->nodes = nodes;
+        *capacity = newCapacity;
+    }
+
+    *first = svo->wordCount;
+    memset(svo->nodes + svo->wordCount, 0, sizeof(uint32_t) * count);
+    svo->wordCount += count;
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef PIS_SVO_H
+#define PIS_SVO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pisVoxReader.h"
+
+#define PIS_SVO_MAX_DEPTH 16
+
+// Child pointers are 24 bits, so the whole tree has to fit in this many uint32s
+#define PIS_SVO_MAX_WORDS (1u << 24)
+
+// A sparse voxel octree over a cube of 2^depth voxels. Every node is one uint32 with the child
+// mask in the low 8 bits and the index of its first child in the high 24 bits. Only the children
+// in the mask are stored, next to each other in child order (x, then y, then z bit). Nodes of
+// 2^3 voxels point at two uint32s holding the 8 voxel materials instead. nodes[0] is the root.
+typedef struct PisSvo {
+    uint32_t depth;
+    uint32_t* nodes;
+    size_t wordCount;
+    // Nodes per level, level 0 is the root
+    uint32_t levelNodeCount[PIS_SVO_MAX_DEPTH];
+} PisSvo;
+
+// Smallest depth with 2^depth >= the largest side of size, at least 1
+uint32_t PisSvoDepth(Size size);
+
+int PisSvoBuild(PisVox* pisV, PisSvo* svo);
+void DestroyPisSvo(PisSvo svo);
+
+#endif
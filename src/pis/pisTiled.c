@@ -0,0 +1,73 @@
+#include "pisTiled.h"
+#include "pisJobs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct TiledBuild {
+    PisVox* pisV;
+    PisTiled* tiled;
+} TiledBuild;
+
+/* =================================Helper functions================================ */
+void BuildTileLayerJob(void* userData, uint32_t jobIndex);
+/* ================================================================================ */
+
+int PisTiledBuild(PisVox* pisV, PisTiled* tiled)
+{
+    tiled->tileCount = (Size){
+        (pisV->size.x + PIS_TILE_SIZE - 1) / PIS_TILE_SIZE,
+        (pisV->size.y + PIS_TILE_SIZE - 1) / PIS_TILE_SIZE,
+        (pisV->size.z + PIS_TILE_SIZE - 1) / PIS_TILE_SIZE,
+    };
+    tiled->byteCount = (size_t)tiled->tileCount.x * tiled->tileCount.y * tiled->tileCount.z * PIS_TILE_VOXELS;
+
+    // Zeroed, so the padding of tiles on the edges is air
+    tiled->voxels = calloc(tiled->byteCount ? tiled->byteCount : 1, 1);
+    if(tiled->voxels == NULL)
+    {
+        fprintf(stderr, "Failed to allocate %zu bytes of tiles\n", tiled->byteCount);
+        return -1;
+    }
+
+    TiledBuild build = {
+        .pisV = pisV,
+        .tiled = tiled,
+    };
+
+    // Every layer of tiles is written by one job
+    PisJobsRun(BuildTileLayerJob, &build, tiled->tileCount.z, PisGetCoreCount());
+
+    return 0;
+}
+
+void DestroyPisTiled(PisTiled tiled)
+{
+    free(tiled.voxels);
+}
+
+void BuildTileLayerJob(void* userData, uint32_t jobIndex)
+{
+    TiledBuild* build = userData;
+    PisVox* pisV = build->pisV;
+    PisTiled* tiled = build->tiled;
+
+    uint32_t zStart = jobIndex * PIS_TILE_SIZE;
+    uint32_t zEnd = zStart + PIS_TILE_SIZE < pisV->size.z ? zStart + PIS_TILE_SIZE : pisV->size.z;
+
+    for(uint32_t z = zStart; z < zEnd; z++)
+    {
+        for(uint32_t y = 0; y < pisV->size.y; y++)
+        {
+            const uint8_t* row = pisV->voxels + ((size_t)z * pisV->size.y + y) * pisV->size.x;
+
+            // A row of a tile is PIS_TILE_SIZE voxels that stay next to each other
+            for(uint32_t x = 0; x < pisV->size.x; x += PIS_TILE_SIZE)
+            {
+                uint32_t count = pisV->size.x - x < PIS_TILE_SIZE ? pisV->size.x - x : PIS_TILE_SIZE;
+                memcpy(tiled->voxels + PisTiledIndex(tiled->tileCount, x, y, z), row + x, count);
+            }
+        }
+    }
+}
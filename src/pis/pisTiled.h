@@ -0,0 +1,34 @@
+#ifndef PIS_TILED_H
+#define PIS_TILED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pisVoxReader.h"
+
+// A tile of 4^3 voxels is 64 bytes, so a step along any axis stays in the same cache line for
+// a few voxels. voxel.comp has to use the same value.
+#define PIS_TILE_SIZE 4
+#define PIS_TILE_VOXELS (PIS_TILE_SIZE * PIS_TILE_SIZE * PIS_TILE_SIZE)
+
+// The volume as whole tiles that run x, then y, then z. The voxels within a tile run the same
+// way, voxels past the edge of the volume are air.
+typedef struct PisTiled {
+    Size tileCount;
+    uint8_t* voxels;
+    size_t byteCount;
+} PisTiled;
+
+static inline size_t PisTiledIndex(Size tileCount, uint32_t x, uint32_t y, uint32_t z)
+{
+    size_t tile = (x / PIS_TILE_SIZE) + (size_t)(y / PIS_TILE_SIZE) * tileCount.x
+                + (size_t)(z / PIS_TILE_SIZE) * tileCount.x * tileCount.y;
+
+    return tile * PIS_TILE_VOXELS + (x % PIS_TILE_SIZE) + (y % PIS_TILE_SIZE) * PIS_TILE_SIZE
+         + (z % PIS_TILE_SIZE) * PIS_TILE_SIZE * PIS_TILE_SIZE;
+}
+
+int PisTiledBuild(PisVox* pisV, PisTiled* tiled);
+void DestroyPisTiled(PisTiled tiled);
+
+#endif
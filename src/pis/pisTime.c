@@ -0,0 +1,11 @@
+#include "pisTime.h"
+
+#include <time.h>
+
+double PisTimeSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,7 @@
+#ifndef PIS_TIME_H
+#define PIS_TIME_H
+
+// Monotonic wall clock in seconds, for measuring load and decode throughput
+double PisTimeSeconds(void);
+
+#endif
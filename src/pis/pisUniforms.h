@@ -0,0 +1,32 @@
+#ifndef PIS_UNIFORMS_H
+#define PIS_UNIFORMS_H
+
+#include <stdint.h>
+
+#include "pisVoxReader.h"
+
+#include "cglm/cglm.h"
+
+// The camera and scene constants of a frame, voxel.comp reads them as binding 3. Kept apart from
+// engine.h so the CPU tracer builds without Vulkan and SDL.
+typedef struct UniformBufferObject {
+    vec3 position;  float _pad1;
+    vec3 forward;   float _pad2;
+    vec3 right;     float _pad3;
+    vec3 up;
+
+    float fov;
+    float time;
+
+    // 0 traces the dense voxel grid, otherwise the instances of a .vox scene
+    uint32_t instanceCount;
+    // PisVoxelLayout of the voxel grid
+    uint32_t voxelLayout;
+    // PisDebugView
+    uint32_t debugView;
+
+    // Size of the dense voxel grid, or the bounds of all instances
+    Size worldSize;
+} UniformBufferObject;
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef PIS_VOX_FORMAT_H
+#define PIS_VOX_FORMAT_H
+
+#include <stdint.h>
+
+/*
+ * PISV 001: header, Size, one run stream over the whole X*Y*Z array, "MATL", 256 materials.
+ *
+ * PISV 002: header, Size, brick size, brick count, "MATL", 256 materials,
+ *           brick table, brick payloads.
+ *           Bricks are ordered x fastest, then y, then z. Edge bricks are clipped to the
+ *           volume, so their payload only holds the voxels that are inside of it.
+ *           Inside a brick voxels are ordered x fastest as well.
+ *
+ * Everything is stored little endian.
+ */
+
+#define PISV_MAGIC_V1 "PISV 001"
+#define PISV_MAGIC_V2 "PISV 002"
+#define PISV_HEADER_SIZE 8
+#define PISV_MATERIALS_TAG "MATL"
+
+#define PISV_RUN_SIZE 3
+#define PISV_MAX_RUN 0xFFFF
+
+#define PISV_BRICK_SIZE 32
+#define PISV_BRICK_ENTRY_SIZE 16
+#define PISV_V2_HEADER_SIZE (PISV_HEADER_SIZE + 12 + 4 + 4)
+
+typedef enum PisvBrickCompression {
+    PISV_BRICK_UNIFORM = 0,     // Every voxel is the entry value, there is no payload
+    PISV_BRICK_RAW = 1,         // Voxels stored as is
+    PISV_BRICK_RLE = 2,         // (uint16 count, uint8 byte) runs
+} PisvBrickCompression;
+
+typedef struct PisvBrickEntry {
+    uint64_t offset;            // From the start of the file
+    uint32_t size;              // Payload size in bytes
+    uint8_t compression;
+    uint8_t value;              // Fill byte of uniform bricks
+    uint16_t reserved;
+} PisvBrickEntry;
+
+static inline uint32_t PisvReadU32(const uint8_t* src)
+{
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+static inline uint64_t PisvReadU64(const uint8_t* src)
+{
+    return (uint64_t)PisvReadU32(src) | ((uint64_t)PisvReadU32(src + 4) << 32);
+}
+
+static inline void PisvWriteU32(uint8_t* dst, uint32_t value)
+{
+    dst[0] = (uint8_t)(value);
+    dst[1] = (uint8_t)(value >> 8);
+    dst[2] = (uint8_t)(value >> 16);
+    dst[3] = (uint8_t)(value >> 24);
+}
+
+static inline void PisvWriteU64(uint8_t* dst, uint64_t value)
+{
+    PisvWriteU32(dst, (uint32_t)value);
+    PisvWriteU32(dst + 4, (uint32_t)(value >> 32));
+}
+
+static inline PisvBrickEntry PisvReadBrickEntry(const uint8_t* src)
+{
+    PisvBrickEntry entry = {
+        .offset = PisvReadU64(src),
+        .size = PisvReadU32(src + 8),
+        .compression = src[12],
+        .value = src[13],
+        .reserved = 0,
+    };
+
+    return entry;
+}
+
+static inline void PisvWriteBrickEntry(uint8_t* dst, PisvBrickEntry entry)
+{
+    PisvWriteU64(dst, entry.offset);
+    PisvWriteU32(dst + 8, entry.size);
+    dst[12] = entry.compression;
+    dst[13] = entry.value;
+    dst[14] = 0;
+    dst[15] = 0;
+}
+
+#endif
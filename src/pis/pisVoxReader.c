@@ -1,79 +1,633 @@
+// madvise is not part of C99, glibc only declares it with _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+
 #include "pisVoxReader.h"
+#include "pisVoxFormat.h"
+#include "pisTime.h"
+#include "pisJobs.h"
+
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Smallest amount of voxels worth handing to another thread
+#define MIN_SPAN_SIZE (256 * 1024)
+
+typedef struct RunSpan {
+    const uint8_t* src;
+    size_t dstOffset;
+} RunSpan;
+
+typedef struct SpanDecode {
+    const uint8_t* srcEnd;
+    uint8_t* voxels;
+    size_t arraySize;
+    RunSpan* spans;
+    uint32_t spanCount;
+    int failed;
+} SpanDecode;
+
+typedef struct BrickDecode {
+    const uint8_t* file;
+    size_t fileSize;
+    const uint8_t* table;
+    uint32_t brickSize;
+    Size size;          // Of the whole volume in the file
+    Size bricks;        // Brick grid of the whole volume
+    Size origin;        // Region being decoded
+    Size regionEnd;
+    Size firstBrick;    // Brick grid overlapping the region
+    Size brickRange;
+    PisVox* pisV;
+    int failed;
+} BrickDecode;
+
+/* =================================Helper functions================================ */
+// NULL when the file can not be mapped
+const uint8_t* MapVoxFile(char* fileName, size_t* fileSize);
+const uint8_t* DecodeRuns(const uint8_t* src, const uint8_t* srcEnd, uint8_t* dst, size_t dstSize);
+int DecodeBrick(const uint8_t* file, size_t fileSize, PisvBrickEntry entry, Size extent,
+                uint8_t* dst, size_t rowStride, size_t sliceStride);
+
+int ReadV1(const uint8_t* file, size_t fileSize, uint32_t threadCount, PisVox* pisV);
+int ReadV2(const uint8_t* file, size_t fileSize, uint32_t threadCount, PisVox* pisV, Size origin, Size extent);
+void ReadMaterials(const uint8_t* src, const uint8_t* fileEnd, PisVox* pisV);
+
+void DecodeSpanJob(void* userData, uint32_t jobIndex);
+void DecodeBrickJob(void* userData, uint32_t jobIndex);
+/* ================================================================================ */
 
 PisVox PisVoxReadFromFile(char* fileName)
 {
     PisVox pisV;
 
-    // Open file
-    FILE* fptr = fopen(fileName, "rb");
-    if(fptr == NULL)
+    if(PisVoxLoadFromFile(fileName, PisGetCoreCount(), &pisV) != 0)
+        exit(-1);
+
+    return pisV;
+}
+
+int PisVoxLoadFromFile(char* fileName, uint32_t threadCount, PisVox* pisV)
+{
+    memset(pisV, 0, sizeof(PisVox));
+
+    double begin = PisTimeSeconds();
+
+    // Map the whole file, voxels are decoded straight out of the mapping
+    size_t fileSize = 0;
+    const uint8_t* file = MapVoxFile(fileName, &fileSize);
+    if(file == NULL)
+        return -1;
+
+    // Read header to check if this is a PisV file and version check
+    int result = -1;
+    if(fileSize >= PISV_HEADER_SIZE && strncmp((const char*)file, PISV_MAGIC_V1, PISV_HEADER_SIZE) == 0)
     {
-        fprintf(stderr, "Failed to read file: %s\n", fileName);
+        result = ReadV1(file, fileSize, threadCount, pisV);
+    }
+    else if(fileSize >= PISV_HEADER_SIZE && strncmp((const char*)file, PISV_MAGIC_V2, PISV_HEADER_SIZE) == 0)
+    {
+        Size origin = {0, 0, 0};
+        result = ReadV2(file, fileSize, threadCount, pisV, origin, (Size){UINT32_MAX, UINT32_MAX, UINT32_MAX});
+    }
+    else
+    {
+        fprintf(stderr, "Wrong file type: %s\n", fileName);
+        munmap((void*)file, fileSize);
+        return -1;
+    }
+
+    munmap((void*)file, fileSize);
+
+    if(result != 0)
+    {
+        fprintf(stderr, "Data not read right, voxel data is corrupt: %s\n", fileName);
+        DestroyPisVox(*pisV);
+        memset(pisV, 0, sizeof(PisVox));
+        return -1;
+    }
+
+    // Tools print their own reports to stdout, pisbench prints JSON there
+#ifdef DEBUG
+    double seconds = PisTimeSeconds() - begin;
+    size_t arraySize = (size_t)pisV->size.x * pisV->size.y * pisV->size.z;
+    printf("Loaded %s (%ux%ux%u) in %.2f ms, %.1f MB/s decoded on %u threads\n", fileName,
+           pisV->size.x, pisV->size.y, pisV->size.z, seconds * 1000.0,
+           (double)arraySize / (seconds > 0.0 ? seconds : 1e-9) / (1024.0 * 1024.0), threadCount);
+#else
+    (void)begin;
+#endif
+
+    return 0;
+}
+
+PisVox PisVoxReadRegionFromFile(char* fileName, Size origin, Size extent)
+{
+    PisVox pisV = {0};
+
+    size_t fileSize = 0;
+    const uint8_t* file = MapVoxFile(fileName, &fileSize);
+    if(file == NULL)
         exit(-1);
+
+    uint32_t threadCount = PisGetCoreCount();
+
+    int result = -1;
+    if(fileSize >= PISV_HEADER_SIZE && strncmp((const char*)file, PISV_MAGIC_V2, PISV_HEADER_SIZE) == 0)
+    {
+        // Only the bricks overlapping the region are decoded
+        result = ReadV2(file, fileSize, threadCount, &pisV, origin, extent);
     }
+    else if(fileSize >= PISV_HEADER_SIZE && strncmp((const char*)file, PISV_MAGIC_V1, PISV_HEADER_SIZE) == 0)
+    {
+        // Version 1 is a single stream, so decode everything and crop
+        PisVox full = {0};
+        result = ReadV1(file, fileSize, threadCount, &full);
 
-    // Read header to check if this is a PisV file and version check
-    char header[8];
-    fread(&header, 1, 8, fptr);
+        if(result == 0 && origin.x < full.size.x && origin.y < full.size.y && origin.z < full.size.z)
+        {
+            pisV.size.x = extent.x < full.size.x - origin.x ? extent.x : full.size.x - origin.x;
+            pisV.size.y = extent.y < full.size.y - origin.y ? extent.y : full.size.y - origin.y;
+            pisV.size.z = extent.z < full.size.z - origin.z ? extent.z : full.size.z - origin.z;
+            memcpy(pisV.materials, full.materials, sizeof(pisV.materials));
+
+            pisV.voxels = malloc((size_t)pisV.size.x * pisV.size.y * pisV.size.z);
+            for(uint32_t z = 0; z < pisV.size.z && pisV.voxels != NULL; z++)
+            {
+                for(uint32_t y = 0; y < pisV.size.y; y++)
+                {
+                    size_t srcIndex = origin.x + (size_t)(origin.y + y) * full.size.x
+                                    + (size_t)(origin.z + z) * full.size.x * full.size.y;
+                    memcpy(&pisV.voxels[((size_t)z * pisV.size.y + y) * pisV.size.x],
+                           &full.voxels[srcIndex], pisV.size.x);
+                }
+            }
 
-    if(strncmp(header, "PISV 001", 8) != 0)
+            result = pisV.voxels != NULL ? 0 : -1;
+        }
+        else
+        {
+            result = -1;
+        }
+
+        DestroyPisVox(full);
+    }
+    else
     {
         fprintf(stderr, "Wrong file type\n");
-        fclose(fptr);
-        fptr = NULL;
+    }
+
+    munmap((void*)file, fileSize);
+
+    if(result != 0)
+    {
+        fprintf(stderr, "Failed to read region of: %s\n", fileName);
+        DestroyPisVox(pisV);
         exit(-1);
     }
 
+    return pisV;
+}
+
+void DestroyPisVox(PisVox pisV)
+{
+    free(pisV.voxels);
+    pisV.voxels = NULL;
+}
+
+// Decodes the span of runs between two pre-scanned boundaries
+void DecodeSpanJob(void* userData, uint32_t jobIndex)
+{
+    SpanDecode* decode = userData;
+
+    RunSpan span = decode->spans[jobIndex];
+    size_t spanEnd = jobIndex + 1 < decode->spanCount ? decode->spans[jobIndex + 1].dstOffset : decode->arraySize;
+
+    if(DecodeRuns(span.src, decode->srcEnd, decode->voxels + span.dstOffset, spanEnd - span.dstOffset) == NULL)
+        __atomic_store_n(&decode->failed, 1, __ATOMIC_RELAXED);
+}
+
+int ReadV1(const uint8_t* file, size_t fileSize, uint32_t threadCount, PisVox* pisV)
+{
+    const uint8_t* fileEnd = file + fileSize;
+
+    if(fileSize < PISV_HEADER_SIZE + 12)
+        return -1;
+
     // Read the dimensions of the voxel world
-    fread(&pisV.size, sizeof(Size), 1, fptr);
+    const uint8_t* src = file + PISV_HEADER_SIZE;
+    pisV->size.x = PisvReadU32(src + 0);
+    pisV->size.y = PisvReadU32(src + 4);
+    pisV->size.z = PisvReadU32(src + 8);
+    src += 12;
 
     // Calculate the array size X*Y*Z
-    uint32_t arraySize = pisV.size.x * pisV.size.y * pisV.size.z;
+    size_t arraySize = (size_t)pisV->size.x * pisV->size.y * pisV->size.z;
 
-    // Read the byte count and add bytes
-    uint32_t dataPtr = 0;
-    pisV.voxels = malloc(arraySize);
-    while(dataPtr < arraySize)
+    pisV->voxels = malloc(arraySize);
+    if(pisV->voxels == NULL)
     {
-        uint16_t byteCount = 0;
-        fread(&byteCount, 2, 1, fptr);
-        if(byteCount == 0)
+        fprintf(stderr, "Failed to allocate %zu bytes of voxel data\n", arraySize);
+        return -1;
+    }
+
+    // The stream itself has no seek points, so walk the run counts once to find run boundaries
+    // that split it into roughly equal spans. This only reads 2 bytes per run and writes nothing.
+    size_t spanTarget = arraySize / ((size_t)threadCount * 4);
+    if(spanTarget < MIN_SPAN_SIZE)
+        spanTarget = MIN_SPAN_SIZE;
+
+    uint32_t maxSpans = (uint32_t)(arraySize / spanTarget) + 2;
+    RunSpan* spans = malloc(sizeof(RunSpan) * maxSpans);
+    if(spans == NULL)
+        return -1;
+
+    uint32_t spanCount = 1;
+    spans[0] = (RunSpan){ src, 0 };
+
+    size_t total = 0;
+    while(total < arraySize)
+    {
+        if(fileEnd - src < PISV_RUN_SIZE)
         {
-            fprintf(stderr, "Data not read right, 0 before end of file\n");
-            free(pisV.voxels);
-            pisV.voxels = NULL;
-            fclose(fptr);
-            fptr = NULL;
-            exit(-1);
+            free(spans);
+            return -1;
         }
 
-        uint8_t byte = 0;
-        fread(&byte, 1, 1, fptr);
-        for(uint32_t i = 0; i < byteCount; i++)
+        size_t byteCount = (size_t)src[0] | ((size_t)src[1] << 8);
+        if(byteCount == 0 || byteCount > arraySize - total)
         {
-            pisV.voxels[dataPtr + i] = byte;
+            free(spans);
+            return -1;
         }
 
-        dataPtr += byteCount;
+        if(total - spans[spanCount - 1].dstOffset >= spanTarget && spanCount < maxSpans)
+            spans[spanCount++] = (RunSpan){ src, total };
+
+        total += byteCount;
+        src += PISV_RUN_SIZE;
     }
 
+    // Every span decodes straight into its part of the final allocation
+    SpanDecode decode = {
+        .srcEnd = src,
+        .voxels = pisV->voxels,
+        .arraySize = arraySize,
+        .spans = spans,
+        .spanCount = spanCount,
+        .failed = 0,
+    };
+
+    PisJobsRun(DecodeSpanJob, &decode, spanCount, threadCount);
+
+    free(spans);
+
+    if(decode.failed)
+        return -1;
+
     // Read materials tag
-    char materialsTag[4];
-    fread(&materialsTag, 1, 4, fptr);
+    ReadMaterials(src, fileEnd, pisV);
+
+    return 0;
+}
 
-    fread(pisV.materials, sizeof(Material), 256, fptr);
+// Decodes one brick of the region, jobs are numbered over the bricks overlapping it
+void DecodeBrickJob(void* userData, uint32_t jobIndex)
+{
+    BrickDecode* decode = userData;
+    PisVox* pisV = decode->pisV;
+    uint32_t brickSize = decode->brickSize;
 
-    fclose(fptr);
+    uint32_t bx = decode->firstBrick.x + jobIndex % decode->brickRange.x;
+    uint32_t by = decode->firstBrick.y + (jobIndex / decode->brickRange.x) % decode->brickRange.y;
+    uint32_t bz = decode->firstBrick.z + jobIndex / (decode->brickRange.x * decode->brickRange.y);
 
-    return pisV;
+    uint32_t brickIndex = bx + by * decode->bricks.x + bz * decode->bricks.x * decode->bricks.y;
+    PisvBrickEntry entry = PisvReadBrickEntry(decode->table + (size_t)brickIndex * PISV_BRICK_ENTRY_SIZE);
+
+    Size origin = decode->origin;
+    Size regionEnd = decode->regionEnd;
+    Size brickOrigin = { bx * brickSize, by * brickSize, bz * brickSize };
+    Size brickExtent = {
+        decode->size.x - brickOrigin.x < brickSize ? decode->size.x - brickOrigin.x : brickSize,
+        decode->size.y - brickOrigin.y < brickSize ? decode->size.y - brickOrigin.y : brickSize,
+        decode->size.z - brickOrigin.z < brickSize ? decode->size.z - brickOrigin.z : brickSize,
+    };
+
+    size_t rowStride = pisV->size.x;
+    size_t sliceStride = (size_t)pisV->size.x * pisV->size.y;
+
+    bool inside = brickOrigin.x >= origin.x && brickOrigin.x + brickExtent.x <= regionEnd.x
+               && brickOrigin.y >= origin.y && brickOrigin.y + brickExtent.y <= regionEnd.y
+               && brickOrigin.z >= origin.z && brickOrigin.z + brickExtent.z <= regionEnd.z;
+
+    if(inside)
+    {
+        // Whole brick is wanted, decode straight into the volume
+        uint8_t* dst = &pisV->voxels[(brickOrigin.x - origin.x)
+                                     + (brickOrigin.y - origin.y) * rowStride
+                                     + (brickOrigin.z - origin.z) * sliceStride];
+
+        if(DecodeBrick(decode->file, decode->fileSize, entry, brickExtent, dst, rowStride, sliceStride) != 0)
+            __atomic_store_n(&decode->failed, 1, __ATOMIC_RELAXED);
+
+        return;
+    }
+
+    // Brick straddles the region edge, decode it on the side and copy the overlap
+    uint8_t* scratch = malloc((size_t)brickExtent.x * brickExtent.y * brickExtent.z);
+
+    if(scratch == NULL
+    || DecodeBrick(decode->file, decode->fileSize, entry, brickExtent, scratch, brickExtent.x, (size_t)brickExtent.x * brickExtent.y) != 0)
+    {
+        __atomic_store_n(&decode->failed, 1, __ATOMIC_RELAXED);
+        free(scratch);
+        return;
+    }
+
+    uint32_t x0 = brickOrigin.x > origin.x ? brickOrigin.x : origin.x;
+    uint32_t y0 = brickOrigin.y > origin.y ? brickOrigin.y : origin.y;
+    uint32_t z0 = brickOrigin.z > origin.z ? brickOrigin.z : origin.z;
+    uint32_t x1 = brickOrigin.x + brickExtent.x < regionEnd.x ? brickOrigin.x + brickExtent.x : regionEnd.x;
+    uint32_t y1 = brickOrigin.y + brickExtent.y < regionEnd.y ? brickOrigin.y + brickExtent.y : regionEnd.y;
+    uint32_t z1 = brickOrigin.z + brickExtent.z < regionEnd.z ? brickOrigin.z + brickExtent.z : regionEnd.z;
+
+    for(uint32_t z = z0; z < z1; z++)
+    {
+        for(uint32_t y = y0; y < y1; y++)
+        {
+            const uint8_t* srcRow = &scratch[(x0 - brickOrigin.x)
+                                             + (size_t)(y - brickOrigin.y) * brickExtent.x
+                                             + (size_t)(z - brickOrigin.z) * brickExtent.x * brickExtent.y];
+            memcpy(&pisV->voxels[(x0 - origin.x) + (y - origin.y) * rowStride + (z - origin.z) * sliceStride],
+                   srcRow, x1 - x0);
+        }
+    }
+
+    free(scratch);
 }
 
-void DestroyPisVox(PisVox pisV)
+int ReadV2(const uint8_t* file, size_t fileSize, uint32_t threadCount, PisVox* pisV, Size origin, Size extent)
 {
-    free(pisV.voxels);
-    pisV.voxels = NULL;
+    if(fileSize < PISV_V2_HEADER_SIZE)
+        return -1;
+
+    const uint8_t* fileEnd = file + fileSize;
+    const uint8_t* src = file + PISV_HEADER_SIZE;
+
+    Size size = { PisvReadU32(src + 0), PisvReadU32(src + 4), PisvReadU32(src + 8) };
+    uint32_t brickSize = PisvReadU32(src + 12);
+    uint32_t brickCount = PisvReadU32(src + 16);
+    src += 20;
+
+    if(brickSize == 0)
+        return -1;
+
+    Size bricks = {
+        (size.x + brickSize - 1) / brickSize,
+        (size.y + brickSize - 1) / brickSize,
+        (size.z + brickSize - 1) / brickSize,
+    };
+
+    if((uint64_t)bricks.x * bricks.y * bricks.z != brickCount)
+        return -1;
+
+    // The materials sit in front of the brick table, so they can be read without touching any brick
+    if((size_t)(fileEnd - src) < 4 + sizeof(pisV->materials))
+        return -1;
+
+    ReadMaterials(src, fileEnd, pisV);
+    src += 4 + sizeof(pisV->materials);
+
+    const uint8_t* table = src;
+    if((size_t)(fileEnd - table) < (size_t)brickCount * PISV_BRICK_ENTRY_SIZE)
+        return -1;
+
+    // Clip the requested region to the volume
+    if(origin.x >= size.x || origin.y >= size.y || origin.z >= size.z)
+        return -1;
+
+    pisV->size.x = extent.x < size.x - origin.x ? extent.x : size.x - origin.x;
+    pisV->size.y = extent.y < size.y - origin.y ? extent.y : size.y - origin.y;
+    pisV->size.z = extent.z < size.z - origin.z ? extent.z : size.z - origin.z;
+
+    if(pisV->size.x == 0 || pisV->size.y == 0 || pisV->size.z == 0)
+        return -1;
+
+    size_t arraySize = (size_t)pisV->size.x * pisV->size.y * pisV->size.z;
+    pisV->voxels = malloc(arraySize);
+    if(pisV->voxels == NULL)
+    {
+        fprintf(stderr, "Failed to allocate %zu bytes of voxel data\n", arraySize);
+        return -1;
+    }
+
+    BrickDecode decode = {
+        .file = file,
+        .fileSize = fileSize,
+        .table = table,
+        .brickSize = brickSize,
+        .size = size,
+        .bricks = bricks,
+        .origin = origin,
+        .regionEnd = { origin.x + pisV->size.x, origin.y + pisV->size.y, origin.z + pisV->size.z },
+        .pisV = pisV,
+        .failed = 0,
+    };
+
+    decode.firstBrick = (Size){ origin.x / brickSize, origin.y / brickSize, origin.z / brickSize };
+    decode.brickRange = (Size){
+        (decode.regionEnd.x - 1) / brickSize - decode.firstBrick.x + 1,
+        (decode.regionEnd.y - 1) / brickSize - decode.firstBrick.y + 1,
+        (decode.regionEnd.z - 1) / brickSize - decode.firstBrick.z + 1,
+    };
+
+    // Bricks never overlap, so every worker writes its bricks straight into the final volume
+    uint32_t jobCount = decode.brickRange.x * decode.brickRange.y * decode.brickRange.z;
+    PisJobsRun(DecodeBrickJob, &decode, jobCount, threadCount);
+
+    return decode.failed ? -1 : 0;
+}
+void ReadMaterials(const uint8_t* src, const uint8_t* fileEnd, PisVox* pisV)
+{
+    memset(pisV->materials, 0, sizeof(pisV->materials));
+
+    if((size_t)(fileEnd - src) >= 4 + sizeof(pisV->materials))
+        memcpy(pisV->materials, src + 4, sizeof(pisV->materials));
+    else
+        fprintf(stderr, "No materials found\n");
+}
+
+const uint8_t* MapVoxFile(char* fileName, size_t* fileSize)
+{
+    // Open file
+    int fd = open(fileName, O_RDONLY);
+    if(fd == -1)
+    {
+        fprintf(stderr, "Failed to read file: %s\n", fileName);
+        return NULL;
+    }
+
+    struct stat sb;
+    if(fstat(fd, &sb) == -1 || sb.st_size == 0)
+    {
+        fprintf(stderr, "Failed to stat file: %s\n", fileName);
+        close(fd);
+        return NULL;
+    }
+
+    void* file = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping keeps its own reference to the file
+    close(fd);
+
+    if(file == MAP_FAILED)
+    {
+        fprintf(stderr, "Failed to map file: %s\n", fileName);
+        return NULL;
+    }
+
+    // Decode workers touch the whole file at once, so fault it in up front
+    madvise(file, (size_t)sb.st_size, MADV_WILLNEED);
+
+    *fileSize = (size_t)sb.st_size;
+    return file;
+}
+
+// Decodes (uint16 count, uint8 byte) runs until dstSize bytes are written.
+// Returns the first byte after the last run, or NULL if the stream is corrupt.
+const uint8_t* DecodeRuns(const uint8_t* src, const uint8_t* srcEnd, uint8_t* dst, size_t dstSize)
+{
+    size_t dataPtr = 0;
+
+    while(dataPtr < dstSize)
+    {
+        if(srcEnd - src < PISV_RUN_SIZE)
+            return NULL;
+
+        uint32_t byteCount = (uint32_t)src[0] | ((uint32_t)src[1] << 8);
+        uint8_t byte = src[2];
+        src += PISV_RUN_SIZE;
+
+        if(byteCount == 0 || byteCount > dstSize - dataPtr)
+            return NULL;
+
+        size_t remaining = dstSize - dataPtr;
+
+        // Short runs are the common case on detailed surfaces, so instead of calling memset
+        // for a handful of bytes write a whole splatted word. Bytes past the run are
+        // overwritten again by the runs that follow.
+        if(byteCount <= 8 && remaining >= 8)
+        {
+            uint64_t splat = byte * 0x0101010101010101ull;
+            memcpy(dst + dataPtr, &splat, 8);
+        }
+        else if(byteCount <= 16 && remaining >= 16)
+        {
+            uint64_t splat = byte * 0x0101010101010101ull;
+            memcpy(dst + dataPtr, &splat, 8);
+            memcpy(dst + dataPtr + 8, &splat, 8);
+        }
+        else
+        {
+            memset(dst + dataPtr, byte, byteCount);
+        }
+
+        dataPtr += byteCount;
+    }
+
+    return src;
+}
+
+// Decodes a single brick into dst, which points at the brick origin inside a volume with
+// the given strides. Rows of a brick are not contiguous in the volume, so runs are split
+// at row ends and nothing is ever written outside of the brick.
+int DecodeBrick(const uint8_t* file, size_t fileSize, PisvBrickEntry entry, Size extent,
+                uint8_t* dst, size_t rowStride, size_t sliceStride)
+{
+    size_t brickVoxels = (size_t)extent.x * extent.y * extent.z;
+
+    if(entry.compression == PISV_BRICK_UNIFORM)
+    {
+        for(uint32_t z = 0; z < extent.z; z++)
+            for(uint32_t y = 0; y < extent.y; y++)
+                memset(dst + z * sliceStride + y * rowStride, entry.value, extent.x);
+
+        return 0;
+    }
+
+    if(entry.offset > fileSize || entry.size > fileSize - entry.offset)
+        return -1;
+
+    const uint8_t* src = file + entry.offset;
+    const uint8_t* srcEnd = src + entry.size;
+
+    if(entry.compression == PISV_BRICK_RAW)
+    {
+        if(entry.size != brickVoxels)
+            return -1;
+
+        for(uint32_t z = 0; z < extent.z; z++)
+        {
+            for(uint32_t y = 0; y < extent.y; y++)
+            {
+                memcpy(dst + z * sliceStride + y * rowStride, src, extent.x);
+                src += extent.x;
+            }
+        }
+
+        return 0;
+    }
+
+    if(entry.compression != PISV_BRICK_RLE)
+        return -1;
+
+    uint32_t x = 0, y = 0, z = 0;
+    uint8_t* row = dst;
+    size_t written = 0;
+
+    while(written < brickVoxels)
+    {
+        if(srcEnd - src < PISV_RUN_SIZE)
+            return -1;
+
+        uint32_t byteCount = (uint32_t)src[0] | ((uint32_t)src[1] << 8);
+        uint8_t byte = src[2];
+        src += PISV_RUN_SIZE;
+
+        if(byteCount == 0 || byteCount > brickVoxels - written)
+            return -1;
+
+        written += byteCount;
+
+        while(byteCount > 0)
+        {
+            uint32_t count = byteCount < extent.x - x ? byteCount : extent.x - x;
+            memset(row + x, byte, count);
+
+            x += count;
+            byteCount -= count;
+
+            if(x == extent.x)
+            {
+                x = 0;
+                if(++y == extent.y)
+                {
+                    y = 0;
+                    z++;
+                }
+
+                row = dst + z * sliceStride + y * rowStride;
+            }
+        }
+    }
+
+    return 0;
 }
@@ -27,6 +27,11 @@ typedef struct PisVox {
 } PisVox;
 
 PisVox PisVoxReadFromFile(char* fileName);
+// Same as PisVoxReadFromFile, but returns -1 instead of exiting when the file can not be read.
+// Decodes on threadCount threads, callers that already read files in parallel pass 1.
+int PisVoxLoadFromFile(char* fileName, uint32_t threadCount, PisVox* pisV);
+// Reads only the voxels inside origin..origin+extent, clipped to the volume
+PisVox PisVoxReadRegionFromFile(char* fileName, Size origin, Size extent);
 void DestroyPisVox(PisVox pisV);
 
 #endif
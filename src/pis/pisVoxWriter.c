@@ -0,0 +1,222 @@
+#include "pisVoxWriter.h"
+#include "pisVoxFormat.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WRITE_BUFFER_SIZE (64 * 1024)
+
+/* =================================Helper functions================================ */
+int WriteHeader(PisVox* pisV, FILE* fptr, const char* magic);
+int WriteMaterials(PisVox* pisV, FILE* fptr);
+int WriteV1(PisVox* pisV, FILE* fptr);
+int WriteV2(PisVox* pisV, FILE* fptr);
+/* ================================================================================ */
+
+int PisVoxWriteToFile(PisVox* pisV, char* fileName, uint32_t version)
+{
+    if(version != 1 && version != 2)
+    {
+        fprintf(stderr, "Unknown pisv version: %u\n", version);
+        return -1;
+    }
+
+    FILE* fptr = fopen(fileName, "wb");
+    if(fptr == NULL)
+    {
+        fprintf(stderr, "Failed to open file for writing: %s\n", fileName);
+        return -1;
+    }
+
+    int result = version == 1 ? WriteV1(pisV, fptr) : WriteV2(pisV, fptr);
+
+    if(fclose(fptr) != 0)
+        result = -1;
+
+    if(result != 0)
+        fprintf(stderr, "Failed to write file: %s\n", fileName);
+
+    return result;
+}
+
+size_t PisVoxEncodeRuns(const uint8_t* src, size_t count, uint8_t* dst)
+{
+    size_t written = 0;
+    size_t i = 0;
+
+    while(i < count)
+    {
+        uint8_t byte = src[i];
+        size_t run = 1;
+
+        while(i + run < count && run < PISV_MAX_RUN && src[i + run] == byte)
+            run++;
+
+        dst[written + 0] = (uint8_t)(run);
+        dst[written + 1] = (uint8_t)(run >> 8);
+        dst[written + 2] = byte;
+        written += PISV_RUN_SIZE;
+
+        i += run;
+    }
+
+    return written;
+}
+
+int WriteHeader(PisVox* pisV, FILE* fptr, const char* magic)
+{
+    uint8_t header[PISV_HEADER_SIZE + 12];
+    memcpy(header, magic, PISV_HEADER_SIZE);
+    PisvWriteU32(header + 8, pisV->size.x);
+    PisvWriteU32(header + 12, pisV->size.y);
+    PisvWriteU32(header + 16, pisV->size.z);
+
+    return fwrite(header, 1, sizeof(header), fptr) == sizeof(header) ? 0 : -1;
+}
+
+int WriteMaterials(PisVox* pisV, FILE* fptr)
+{
+    if(fwrite(PISV_MATERIALS_TAG, 1, 4, fptr) != 4)
+        return -1;
+
+    return fwrite(pisV->materials, sizeof(Material), 256, fptr) == 256 ? 0 : -1;
+}
+
+int WriteV1(PisVox* pisV, FILE* fptr)
+{
+    if(WriteHeader(pisV, fptr, PISV_MAGIC_V1) != 0)
+        return -1;
+
+    size_t arraySize = (size_t)pisV->size.x * pisV->size.y * pisV->size.z;
+
+    // Encode in slabs so the whole stream never has to be in memory at once.
+    // Runs are cut at slab edges, which costs at most one extra run per slab.
+    size_t slab = WRITE_BUFFER_SIZE;
+    uint8_t* runs = malloc(slab * PISV_RUN_SIZE);
+    if(runs == NULL)
+        return -1;
+
+    for(size_t i = 0; i < arraySize; i += slab)
+    {
+        size_t count = arraySize - i < slab ? arraySize - i : slab;
+        size_t size = PisVoxEncodeRuns(&pisV->voxels[i], count, runs);
+
+        if(fwrite(runs, 1, size, fptr) != size)
+        {
+            free(runs);
+            return -1;
+        }
+    }
+
+    free(runs);
+
+    return WriteMaterials(pisV, fptr);
+}
+
+int WriteV2(PisVox* pisV, FILE* fptr)
+{
+    uint32_t brickSize = PISV_BRICK_SIZE;
+    Size bricks = {
+        (pisV->size.x + brickSize - 1) / brickSize,
+        (pisV->size.y + brickSize - 1) / brickSize,
+        (pisV->size.z + brickSize - 1) / brickSize,
+    };
+    uint32_t brickCount = bricks.x * bricks.y * bricks.z;
+
+    if(WriteHeader(pisV, fptr, PISV_MAGIC_V2) != 0)
+        return -1;
+
+    uint8_t brickHeader[8];
+    PisvWriteU32(brickHeader, brickSize);
+    PisvWriteU32(brickHeader + 4, brickCount);
+    if(fwrite(brickHeader, 1, sizeof(brickHeader), fptr) != sizeof(brickHeader))
+        return -1;
+
+    if(WriteMaterials(pisV, fptr) != 0)
+        return -1;
+
+    // Payloads follow the table, so the table is filled in while they are written
+    uint64_t tableOffset = PISV_V2_HEADER_SIZE + 4 + sizeof(pisV->materials);
+    uint64_t payloadOffset = tableOffset + (uint64_t)brickCount * PISV_BRICK_ENTRY_SIZE;
+
+    size_t brickVoxels = (size_t)brickSize * brickSize * brickSize;
+    uint8_t* table = calloc(brickCount, PISV_BRICK_ENTRY_SIZE);
+    uint8_t* brick = malloc(brickVoxels);
+    uint8_t* runs = malloc(brickVoxels * PISV_RUN_SIZE);
+
+    int result = (table != NULL && brick != NULL && runs != NULL) ? 0 : -1;
+
+    if(result == 0 && fseek(fptr, (long)payloadOffset, SEEK_SET) != 0)
+        result = -1;
+
+    size_t rowStride = pisV->size.x;
+    size_t sliceStride = (size_t)pisV->size.x * pisV->size.y;
+
+    for(uint32_t brickIndex = 0; brickIndex < brickCount && result == 0; brickIndex++)
+    {
+        uint32_t bx = brickIndex % bricks.x;
+        uint32_t by = (brickIndex / bricks.x) % bricks.y;
+        uint32_t bz = brickIndex / (bricks.x * bricks.y);
+
+        Size origin = { bx * brickSize, by * brickSize, bz * brickSize };
+        Size extent = {
+            pisV->size.x - origin.x < brickSize ? pisV->size.x - origin.x : brickSize,
+            pisV->size.y - origin.y < brickSize ? pisV->size.y - origin.y : brickSize,
+            pisV->size.z - origin.z < brickSize ? pisV->size.z - origin.z : brickSize,
+        };
+
+        // Gather the brick into a contiguous block
+        size_t count = 0;
+        for(uint32_t z = 0; z < extent.z; z++)
+        {
+            for(uint32_t y = 0; y < extent.y; y++)
+            {
+                memcpy(&brick[count], &pisV->voxels[origin.x + (origin.y + y) * rowStride + (origin.z + z) * sliceStride], extent.x);
+                count += extent.x;
+            }
+        }
+
+        bool uniform = true;
+        for(size_t i = 1; i < count && uniform; i++)
+            uniform = brick[i] == brick[0];
+
+        PisvBrickEntry entry = {
+            .offset = payloadOffset,
+            .size = 0,
+            .compression = PISV_BRICK_UNIFORM,
+            .value = brick[0],
+        };
+
+        if(!uniform)
+        {
+            // Keep whichever of runs and raw bytes is smaller
+            size_t runSize = PisVoxEncodeRuns(brick, count, runs);
+            const uint8_t* payload = runSize < count ? runs : brick;
+
+            entry.compression = runSize < count ? PISV_BRICK_RLE : PISV_BRICK_RAW;
+            entry.size = (uint32_t)(runSize < count ? runSize : count);
+
+            if(fwrite(payload, 1, entry.size, fptr) != entry.size)
+                result = -1;
+
+            payloadOffset += entry.size;
+        }
+
+        PisvWriteBrickEntry(&table[(size_t)brickIndex * PISV_BRICK_ENTRY_SIZE], entry);
+    }
+
+    if(result == 0 && fseek(fptr, (long)tableOffset, SEEK_SET) != 0)
+        result = -1;
+
+    if(result == 0 && fwrite(table, PISV_BRICK_ENTRY_SIZE, brickCount, fptr) != brickCount)
+        result = -1;
+
+    free(table);
+    free(brick);
+    free(runs);
+
+    return result;
+}
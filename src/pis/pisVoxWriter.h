@@ -0,0 +1,17 @@
+#ifndef PIS_VOX_WRITER_H
+#define PIS_VOX_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pisVoxReader.h"
+
+// Writes the volume as "PISV 001" (version 1) or bricked "PISV 002" (version 2).
+// Returns 0 on success.
+int PisVoxWriteToFile(PisVox* pisV, char* fileName, uint32_t version);
+
+// Run length encodes count bytes of src into dst, which needs room for count * 3 bytes.
+// Returns the encoded size.
+size_t PisVoxEncodeRuns(const uint8_t* src, size_t count, uint8_t* dst);
+
+#endif
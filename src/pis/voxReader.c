@@ -0,0 +1,975 @@
+#include "voxReader.h"
+#include "pisTime.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Voxels are streamed out of XYZI chunks in batches of this many
+#define XYZI_BATCH 4096
+
+// Deepest scene graph we follow, anything deeper is most likely a cycle
+#define MAX_NODE_DEPTH 64
+
+// Groups can list the same child many times, so the instance count is not bounded by the file size
+#define MAX_INSTANCES (1 << 16)
+
+// Smallest node chunk, a header and an nGRP with an empty dict and no children
+#define MIN_NODE_CHUNK_SIZE 24
+
+// Translations of a single nTRN, MAX_NODE_DEPTH of them still add up to less than INT32_MAX
+#define MAX_NODE_TRANSLATION (1 << 24)
+
+// Edge of the scene bounds, larger scenes are rejected before any instance is placed
+#define MAX_SCENE_SIZE (1 << 16)
+
+typedef struct VoxChunk {
+    char id[4];
+    uint32_t contentSize;
+    uint32_t childrenSize;
+} VoxChunk;
+
+// Integer affine transform on voxel indices: p = r * v + t
+typedef struct VoxTransform {
+    int32_t r[3][3];
+    int32_t t[3];
+} VoxTransform;
+
+typedef enum VoxNodeType {
+    VOX_NODE_NONE = 0,
+    VOX_NODE_TRANSFORM,
+    VOX_NODE_GROUP,
+    VOX_NODE_SHAPE,
+} VoxNodeType;
+
+typedef struct VoxNode {
+    VoxNodeType type;
+    bool hidden;
+    // Set while CollectInstances is below this node
+    bool onPath;
+
+    // nTRN
+    VoxTransform transform;
+    int32_t child;
+
+    // nGRP
+    int32_t* children;
+    uint32_t childCount;
+
+    // nSHP
+    int32_t model;
+} VoxNode;
+
+typedef struct VoxDict {
+    char translation[64];
+    char rotation[8];
+    bool hidden;
+} VoxDict;
+
+typedef struct VoxCursor {
+    const uint8_t* ptr;
+    const uint8_t* end;
+    bool failed;
+} VoxCursor;
+
+typedef struct VoxFile {
+    FILE* fptr;
+    PisVoxScene* scene;
+
+    // Size of the model whose XYZI chunk comes next, in MagicaVoxel orientation
+    uint32_t pendingSize[3];
+    bool hasPendingSize;
+    uint32_t modelCapacity;
+
+    // Model sizes in MagicaVoxel orientation, needed for the pivot of every instance
+    uint32_t (*voxSizes)[3];
+
+    VoxNode* nodes;
+    uint32_t nodeCapacity;
+    // Node ids are dense, so no id is larger than the node chunks MAIN has room for
+    uint32_t maxNodeCount;
+    bool hasNodes;
+
+    uint32_t instanceCapacity;
+    VoxTransform* instanceTransforms;
+
+    bool hasPalette;
+} VoxFile;
+
+// MagicaVoxel (z up) to engine (y up): (x, y, z) -> (x, z, -y)
+static const int32_t VOX_TO_ENGINE[3][3] = {
+    { 1, 0,  0 },
+    { 0, 0,  1 },
+    { 0, -1, 0 },
+};
+
+/* =================================Helper functions================================ */
+int ReadMainChunk(VoxFile* vox);
+int ReadChildChunks(VoxFile* vox, uint32_t childrenSize);
+
+int ReadChunkHeader(FILE* fptr, VoxChunk* chunk);
+int ReadSizeChunk(VoxFile* vox, VoxChunk chunk);
+int ReadXYZIChunk(VoxFile* vox, VoxChunk chunk);
+int ReadRGBAChunk(VoxFile* vox, VoxChunk chunk);
+int ReadNodeChunk(VoxFile* vox, VoxChunk chunk);
+
+int CollectInstances(VoxFile* vox, int32_t nodeId, VoxTransform parent, uint32_t depth);
+int AddInstance(VoxFile* vox, uint32_t model, VoxTransform transform);
+int PlaceInstances(VoxFile* vox);
+void DeduplicateModels(PisVoxScene* scene);
+
+int32_t CursorReadInt(VoxCursor* cursor);
+void CursorReadDict(VoxCursor* cursor, VoxDict* dict);
+VoxTransform TransformIdentity(void);
+VoxTransform TransformCompose(VoxTransform a, VoxTransform b);
+VoxTransform TransformFromRotation(uint8_t rotation);
+/* ================================================================================ */
+
+static inline uint32_t ReadLE32(const uint8_t* src)
+{
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+PisVox PisVoxReadVoxFile(char* fileName)
+{
+    double begin = PisTimeSeconds();
+
+    PisVoxScene scene = PisVoxSceneReadVoxFile(fileName);
+
+    PisVox pisV;
+    int result = PisVoxSceneFlatten(&scene, &pisV);
+    DestroyPisVoxScene(scene);
+
+    if(result != 0)
+        exit(-1);
+
+#ifdef DEBUG
+    printf("Flattened %s into %ux%ux%u in %.2f ms\n", fileName,
+           pisV.size.x, pisV.size.y, pisV.size.z, (PisTimeSeconds() - begin) * 1000.0);
+#else
+    (void)begin;
+#endif
+
+    return pisV;
+}
+
+PisVoxScene PisVoxSceneReadVoxFile(char* fileName)
+{
+    PisVoxScene scene;
+
+    if(PisVoxSceneLoadVoxFile(fileName, &scene) != 0)
+        exit(-1);
+
+    return scene;
+}
+
+int PisVoxSceneLoadVoxFile(char* fileName, PisVoxScene* scene)
+{
+    memset(scene, 0, sizeof(PisVoxScene));
+
+    double begin = PisTimeSeconds();
+
+    // Open file
+    FILE* fptr = fopen(fileName, "rb");
+    if(fptr == NULL)
+    {
+        fprintf(stderr, "Failed to read file: %s\n", fileName);
+        return -1;
+    }
+
+    // Read file header and version
+    uint8_t header[8];
+    if(fread(header, 1, 8, fptr) != 8 || memcmp(header, "VOX ", 4) != 0)
+    {
+        fprintf(stderr, "Wrong file type: %s\n", fileName);
+        fclose(fptr);
+        return -1;
+    }
+
+    VoxFile vox = {
+        .fptr = fptr,
+        .scene = scene,
+    };
+
+    // Read the main chunk and its children
+    int result = ReadMainChunk(&vox);
+
+    fclose(fptr);
+
+    if(result == 0 && scene->modelCount > 0)
+    {
+        if(vox.hasNodes)
+        {
+            result = CollectInstances(&vox, 0, TransformIdentity(), 0);
+        }
+        else
+        {
+            // Files without a scene graph just put every model at the origin
+            for(uint32_t i = 0; i < scene->modelCount && result == 0; i++)
+                result = AddInstance(&vox, i, TransformIdentity());
+        }
+    }
+
+    if(result == 0 && scene->instanceCount > 0)
+        result = PlaceInstances(&vox);
+
+    if(result == 0 && scene->instanceCount > 0)
+        DeduplicateModels(scene);
+
+    for(uint32_t i = 0; i < vox.nodeCapacity; i++)
+        free(vox.nodes[i].children);
+
+    free(vox.nodes);
+    free(vox.voxSizes);
+    free(vox.instanceTransforms);
+
+    if(result != 0 || scene->instanceCount == 0)
+    {
+        fprintf(stderr, "Data not read right, vox file is corrupt: %s\n", fileName);
+        DestroyPisVoxScene(*scene);
+        memset(scene, 0, sizeof(PisVoxScene));
+        return -1;
+    }
+
+    if(!vox.hasPalette)
+        PisVoxDefaultPalette(scene->materials);
+
+#ifdef DEBUG
+    printf("Loaded %s (%ux%ux%u, vox version %u): %u models, %u instances in %.2f ms\n", fileName,
+           scene->size.x, scene->size.y, scene->size.z, ReadLE32(header + 4),
+           scene->modelCount, scene->instanceCount, (PisTimeSeconds() - begin) * 1000.0);
+#else
+    (void)begin;
+#endif
+
+    return 0;
+}
+
+int PisVoxSceneFlatten(PisVoxScene* scene, PisVox* pisV)
+{
+    memset(pisV, 0, sizeof(PisVox));
+    pisV->size = scene->size;
+    memcpy(pisV->materials, scene->materials, sizeof(pisV->materials));
+
+    size_t arraySize = (size_t)pisV->size.x * pisV->size.y * pisV->size.z;
+    pisV->voxels = calloc(arraySize, 1);
+    if(pisV->voxels == NULL)
+    {
+        fprintf(stderr, "Failed to allocate %zu bytes of voxel data\n", arraySize);
+        memset(pisV, 0, sizeof(PisVox));
+        return -1;
+    }
+
+    for(uint32_t i = 0; i < scene->instanceCount; i++)
+    {
+        PisVoxInstance* instance = &scene->instances[i];
+        PisVoxModel* model = &scene->models[instance->model];
+
+        for(uint32_t z = 0; z < model->size.z; z++)
+        for(uint32_t y = 0; y < model->size.y; y++)
+        for(uint32_t x = 0; x < model->size.x; x++)
+        {
+            uint8_t voxel = model->voxels[x + (size_t)y * model->size.x + (size_t)z * model->size.x * model->size.y];
+            if(voxel == 0)
+                continue;
+
+            int32_t m[3] = { (int32_t)x, (int32_t)y, (int32_t)z };
+            int32_t p[3];
+            for(uint32_t row = 0; row < 3; row++)
+            {
+                p[row] = instance->translation[row];
+                for(uint32_t col = 0; col < 3; col++)
+                    p[row] += instance->rotation[row][col] * m[col];
+            }
+
+            pisV->voxels[p[0] + (size_t)p[1] * pisV->size.x + (size_t)p[2] * pisV->size.x * pisV->size.y] = voxel;
+        }
+    }
+
+    return 0;
+}
+
+void DestroyPisVoxScene(PisVoxScene scene)
+{
+    for(uint32_t i = 0; i < scene.modelCount; i++)
+        free(scene.models[i].voxels);
+
+    free(scene.models);
+    free(scene.instances);
+}
+
+int ReadMainChunk(VoxFile* vox)
+{
+    VoxChunk chunk;
+    if(ReadChunkHeader(vox->fptr, &chunk) != 0 || memcmp(chunk.id, "MAIN", 4) != 0)
+        return -1;
+
+    // MAIN has no content of its own, but skip it in case a later version adds some
+    if(chunk.contentSize != 0 && fseek(vox->fptr, chunk.contentSize, SEEK_CUR) != 0)
+        return -1;
+
+    vox->maxNodeCount = chunk.childrenSize / MIN_NODE_CHUNK_SIZE;
+
+    return ReadChildChunks(vox, chunk.childrenSize);
+}
+
+int ReadChildChunks(VoxFile* vox, uint32_t childrenSize)
+{
+    uint64_t read = 0;
+
+    while(read < childrenSize)
+    {
+        VoxChunk chunk;
+        if(ReadChunkHeader(vox->fptr, &chunk) != 0)
+            return -1;
+
+        uint64_t chunkSize = 12 + (uint64_t)chunk.contentSize + chunk.childrenSize;
+        if(chunkSize > childrenSize - read)
+            return -1;
+
+        int result = 0;
+        bool consumed = true;
+
+        if(memcmp(chunk.id, "SIZE", 4) == 0)
+            result = ReadSizeChunk(vox, chunk);
+        else if(memcmp(chunk.id, "XYZI", 4) == 0)
+            result = ReadXYZIChunk(vox, chunk);
+        else if(memcmp(chunk.id, "RGBA", 4) == 0)
+            result = ReadRGBAChunk(vox, chunk);
+        else if(memcmp(chunk.id, "nTRN", 4) == 0 || memcmp(chunk.id, "nGRP", 4) == 0 || memcmp(chunk.id, "nSHP", 4) == 0)
+            result = ReadNodeChunk(vox, chunk);
+        else
+            consumed = false;
+
+        if(result != 0)
+            return -1;
+
+        // Everything we do not understand (and any children) is skipped without reading it
+        uint64_t skip = (consumed ? 0 : chunk.contentSize) + (uint64_t)chunk.childrenSize;
+        if(skip != 0 && fseek(vox->fptr, (long)skip, SEEK_CUR) != 0)
+            return -1;
+
+        read += chunkSize;
+    }
+
+    return 0;
+}
+
+int ReadChunkHeader(FILE* fptr, VoxChunk* chunk)
+{
+    uint8_t header[12];
+    if(fread(header, 1, 12, fptr) != 12)
+        return -1;
+
+    memcpy(chunk->id, header, 4);
+    chunk->contentSize = ReadLE32(header + 4);
+    chunk->childrenSize = ReadLE32(header + 8);
+
+    return 0;
+}
+
+int ReadSizeChunk(VoxFile* vox, VoxChunk chunk)
+{
+    uint8_t content[12];
+    if(chunk.contentSize != 12 || fread(content, 1, 12, vox->fptr) != 12)
+        return -1;
+
+    vox->pendingSize[0] = ReadLE32(content + 0);
+    vox->pendingSize[1] = ReadLE32(content + 4);
+    vox->pendingSize[2] = ReadLE32(content + 8);
+
+    if(vox->pendingSize[0] == 0 || vox->pendingSize[1] == 0 || vox->pendingSize[2] == 0
+    || vox->pendingSize[0] > 256 || vox->pendingSize[1] > 256 || vox->pendingSize[2] > 256)
+        return -1;
+
+    vox->hasPendingSize = true;
+
+    return 0;
+}
+
+int ReadXYZIChunk(VoxFile* vox, VoxChunk chunk)
+{
+    PisVoxScene* scene = vox->scene;
+
+    uint8_t countBytes[4];
+    if(!vox->hasPendingSize || chunk.contentSize < 4 || fread(countBytes, 1, 4, vox->fptr) != 4)
+        return -1;
+
+    uint32_t voxelCount = ReadLE32(countBytes);
+    if((uint64_t)voxelCount * 4 > chunk.contentSize - 4)
+        return -1;
+
+    if(scene->modelCount == vox->modelCapacity)
+    {
+        // The old arrays stay in place on failure, the caller frees them with the rest of the scene
+        uint32_t capacity = vox->modelCapacity ? vox->modelCapacity * 2 : 4;
+
+        PisVoxModel* models = realloc(scene->models, sizeof(PisVoxModel) * capacity);
+        if(models == NULL)
+            return -1;
+        scene->models = models;
+
+        uint32_t (*voxSizes)[3] = realloc(vox->voxSizes, sizeof(*vox->voxSizes) * capacity);
+        if(voxSizes == NULL)
+            return -1;
+        vox->voxSizes = voxSizes;
+
+        vox->modelCapacity = capacity;
+    }
+
+    // Turn the z up model into a y up volume
+    uint32_t* voxSize = vox->pendingSize;
+    PisVoxModel* model = &scene->models[scene->modelCount];
+    model->size = (Size){ voxSize[0], voxSize[2], voxSize[1] };
+    model->voxels = calloc((size_t)model->size.x * model->size.y * model->size.z, 1);
+    if(model->voxels == NULL)
+        return -1;
+
+    memcpy(vox->voxSizes[scene->modelCount], voxSize, sizeof(*vox->voxSizes));
+    scene->modelCount++;
+    vox->hasPendingSize = false;
+
+    uint8_t batch[XYZI_BATCH * 4];
+
+    for(uint32_t done = 0; done < voxelCount;)
+    {
+        uint32_t count = voxelCount - done < XYZI_BATCH ? voxelCount - done : XYZI_BATCH;
+        if(fread(batch, 4, count, vox->fptr) != count)
+            return -1;
+
+        // XYZI is sparse, so write every voxel straight into its place in the volume
+        for(uint32_t i = 0; i < count; i++)
+        {
+            uint32_t x = batch[i * 4 + 0];
+            uint32_t y = batch[i * 4 + 1];
+            uint32_t z = batch[i * 4 + 2];
+            uint8_t colorIndex = batch[i * 4 + 3];
+
+            if(x >= voxSize[0] || y >= voxSize[1] || z >= voxSize[2])
+                continue;
+
+            size_t index = x + (size_t)z * model->size.x + (size_t)(voxSize[1] - 1 - y) * model->size.x * model->size.y;
+            model->voxels[index] = colorIndex;
+        }
+
+        done += count;
+    }
+
+    // Skip any trailing bytes
+    uint32_t skip = chunk.contentSize - 4 - voxelCount * 4;
+    if(skip != 0 && fseek(vox->fptr, skip, SEEK_CUR) != 0)
+        return -1;
+
+    return 0;
+}
+
+int ReadRGBAChunk(VoxFile* vox, VoxChunk chunk)
+{
+    // Color i of the chunk belongs to color index i + 1, the shader looks colors up with index - 1
+    if(chunk.contentSize != sizeof(vox->scene->materials)
+    || fread(vox->scene->materials, sizeof(Material), 256, vox->fptr) != 256)
+        return -1;
+
+    vox->hasPalette = true;
+
+    return 0;
+}
+
+int ReadNodeChunk(VoxFile* vox, VoxChunk chunk)
+{
+    // Nodes are small, read the whole content and parse it from memory
+    uint8_t* content = malloc(chunk.contentSize ? chunk.contentSize : 1);
+    if(content == NULL || fread(content, 1, chunk.contentSize, vox->fptr) != chunk.contentSize)
+    {
+        free(content);
+        return -1;
+    }
+
+    VoxCursor cursor = { content, content + chunk.contentSize, false };
+
+    int32_t nodeId = CursorReadInt(&cursor);
+    VoxDict attributes;
+    CursorReadDict(&cursor, &attributes);
+
+    if(cursor.failed || nodeId < 0 || (uint32_t)nodeId >= vox->maxNodeCount)
+    {
+        free(content);
+        return -1;
+    }
+
+    if((uint32_t)nodeId >= vox->nodeCapacity)
+    {
+        uint32_t capacity = vox->nodeCapacity ? vox->nodeCapacity : 16;
+        while(capacity <= (uint32_t)nodeId)
+            capacity *= 2;
+
+        VoxNode* nodes = realloc(vox->nodes, sizeof(VoxNode) * capacity);
+        if(nodes == NULL)
+        {
+            free(content);
+            return -1;
+        }
+
+        memset(&nodes[vox->nodeCapacity], 0, sizeof(VoxNode) * (capacity - vox->nodeCapacity));
+        vox->nodes = nodes;
+        vox->nodeCapacity = capacity;
+    }
+
+    VoxNode* node = &vox->nodes[nodeId];
+    free(node->children);
+    memset(node, 0, sizeof(VoxNode));
+    node->hidden = attributes.hidden;
+
+    if(memcmp(chunk.id, "nTRN", 4) == 0)
+    {
+        node->type = VOX_NODE_TRANSFORM;
+        node->child = CursorReadInt(&cursor);
+        CursorReadInt(&cursor);                 // Reserved
+        CursorReadInt(&cursor);                 // Layer
+        int32_t frameCount = CursorReadInt(&cursor);
+
+        // Animation is not supported, the first frame is the transform
+        VoxDict frame = {0};
+        if(frameCount > 0)
+            CursorReadDict(&cursor, &frame);
+
+        node->transform = TransformFromRotation(frame.rotation[0] ? (uint8_t)atoi(frame.rotation) : 4);
+
+        if(frame.translation[0])
+        {
+            char* next = frame.translation;
+            for(uint32_t i = 0; i < 3; i++)
+            {
+                long translation = strtol(next, &next, 10);
+                if(translation < -MAX_NODE_TRANSLATION || translation > MAX_NODE_TRANSLATION)
+                    cursor.failed = true;
+                else
+                    node->transform.t[i] = (int32_t)translation;
+            }
+        }
+    }
+    else if(memcmp(chunk.id, "nGRP", 4) == 0)
+    {
+        node->type = VOX_NODE_GROUP;
+        int32_t childCount = CursorReadInt(&cursor);
+
+        if(childCount < 0 || (size_t)childCount * 4 > (size_t)(cursor.end - cursor.ptr))
+            cursor.failed = true;
+
+        if(!cursor.failed && childCount > 0)
+        {
+            node->children = malloc(sizeof(int32_t) * childCount);
+            node->childCount = node->children ? (uint32_t)childCount : 0;
+
+            for(uint32_t i = 0; i < node->childCount; i++)
+                node->children[i] = CursorReadInt(&cursor);
+        }
+    }
+    else
+    {
+        node->type = VOX_NODE_SHAPE;
+        int32_t modelCount = CursorReadInt(&cursor);
+
+        // Animation is not supported, the first model is the shape
+        node->model = modelCount > 0 ? CursorReadInt(&cursor) : -1;
+    }
+
+    free(content);
+
+    if(cursor.failed)
+        return -1;
+
+    vox->hasNodes = true;
+
+    return 0;
+}
+
+int CollectInstances(VoxFile* vox, int32_t nodeId, VoxTransform parent, uint32_t depth)
+{
+    if(nodeId < 0 || (uint32_t)nodeId >= vox->nodeCapacity)
+        return 0;
+
+    if(depth > MAX_NODE_DEPTH)
+    {
+        fprintf(stderr, "Vox scene graph is deeper than %u nodes\n", MAX_NODE_DEPTH);
+        return -1;
+    }
+
+    VoxNode* node = &vox->nodes[nodeId];
+
+    if(node->hidden)
+        return 0;
+
+    // A node below itself would repeat forever
+    if(node->onPath)
+        return -1;
+
+    int result = 0;
+    node->onPath = true;
+
+    switch(node->type)
+    {
+        case VOX_NODE_TRANSFORM:
+            result = CollectInstances(vox, node->child, TransformCompose(parent, node->transform), depth + 1);
+            break;
+
+        case VOX_NODE_GROUP:
+            for(uint32_t i = 0; i < node->childCount && result == 0; i++)
+                result = CollectInstances(vox, node->children[i], parent, depth + 1);
+            break;
+
+        case VOX_NODE_SHAPE:
+            if(node->model >= 0 && (uint32_t)node->model < vox->scene->modelCount)
+            {
+                // MagicaVoxel translates the center of a model, not its corner
+                VoxTransform pivot = TransformIdentity();
+                for(uint32_t i = 0; i < 3; i++)
+                    pivot.t[i] = -(int32_t)(vox->voxSizes[node->model][i] / 2);
+
+                result = AddInstance(vox, (uint32_t)node->model, TransformCompose(parent, pivot));
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    node->onPath = false;
+
+    return result;
+}
+
+int AddInstance(VoxFile* vox, uint32_t model, VoxTransform transform)
+{
+    PisVoxScene* scene = vox->scene;
+
+    if(scene->instanceCount >= MAX_INSTANCES)
+    {
+        fprintf(stderr, "Vox file has more than %u instances\n", MAX_INSTANCES);
+        return -1;
+    }
+
+    if(scene->instanceCount == vox->instanceCapacity)
+    {
+        uint32_t capacity = vox->instanceCapacity ? vox->instanceCapacity * 2 : 4;
+
+        PisVoxInstance* instances = realloc(scene->instances, sizeof(PisVoxInstance) * capacity);
+        if(instances == NULL)
+            return -1;
+        scene->instances = instances;
+
+        VoxTransform* transforms = realloc(vox->instanceTransforms, sizeof(VoxTransform) * capacity);
+        if(transforms == NULL)
+            return -1;
+        vox->instanceTransforms = transforms;
+
+        vox->instanceCapacity = capacity;
+    }
+
+    scene->instances[scene->instanceCount].model = model;
+    vox->instanceTransforms[scene->instanceCount] = transform;
+    scene->instanceCount++;
+
+    return 0;
+}
+
+// Turns the MagicaVoxel world-from-model transforms into engine space and moves the scene so it
+// starts at 0. Returns -1 when the scene is larger than MAX_SCENE_SIZE.
+int PlaceInstances(VoxFile* vox)
+{
+    PisVoxScene* scene = vox->scene;
+
+    VoxTransform toEngine = {0};
+    VoxTransform fromEngine = {0};
+    for(uint32_t row = 0; row < 3; row++)
+    {
+        for(uint32_t col = 0; col < 3; col++)
+        {
+            toEngine.r[row][col] = VOX_TO_ENGINE[row][col];
+            fromEngine.r[row][col] = VOX_TO_ENGINE[col][row];
+        }
+    }
+
+    int32_t sceneMin[3] = { INT32_MAX, INT32_MAX, INT32_MAX };
+    int32_t sceneMax[3] = { INT32_MIN, INT32_MIN, INT32_MIN };
+
+    for(uint32_t i = 0; i < scene->instanceCount; i++)
+    {
+        PisVoxInstance* instance = &scene->instances[i];
+        uint32_t* voxSize = vox->voxSizes[instance->model];
+
+        // Model voxels are stored as m = toEngine * v + (0, 0, sizeY - 1)
+        VoxTransform modelToVox = fromEngine;
+        modelToVox.t[0] = 0;
+        modelToVox.t[1] = (int32_t)voxSize[1] - 1;
+        modelToVox.t[2] = 0;
+
+        VoxTransform transform = TransformCompose(toEngine, TransformCompose(vox->instanceTransforms[i], modelToVox));
+
+        for(uint32_t row = 0; row < 3; row++)
+        {
+            instance->translation[row] = transform.t[row];
+            for(uint32_t col = 0; col < 3; col++)
+                instance->rotation[row][col] = (int8_t)transform.r[row][col];
+        }
+
+        // Bounds of the instance are spanned by the first and last voxel of its model
+        Size size = scene->models[instance->model].size;
+        int32_t last[3] = { (int32_t)size.x - 1, (int32_t)size.y - 1, (int32_t)size.z - 1 };
+
+        for(uint32_t row = 0; row < 3; row++)
+        {
+            int32_t a = transform.t[row];
+            int32_t b = transform.t[row];
+            for(uint32_t col = 0; col < 3; col++)
+                b += transform.r[row][col] * last[col];
+
+            int32_t lo = a < b ? a : b;
+            int32_t hi = a < b ? b : a;
+            sceneMin[row] = lo < sceneMin[row] ? lo : sceneMin[row];
+            sceneMax[row] = hi > sceneMax[row] ? hi : sceneMax[row];
+        }
+    }
+
+    // The bounds can be far apart even though every translation is in range
+    int64_t extent[3];
+    for(uint32_t row = 0; row < 3; row++)
+    {
+        extent[row] = (int64_t)sceneMax[row] - sceneMin[row] + 1;
+        if(extent[row] > MAX_SCENE_SIZE)
+        {
+            fprintf(stderr, "Vox scene is %lld voxels wide, at most %u are supported\n", (long long)extent[row], MAX_SCENE_SIZE);
+            return -1;
+        }
+    }
+
+    for(uint32_t i = 0; i < scene->instanceCount; i++)
+        for(uint32_t row = 0; row < 3; row++)
+            scene->instances[i].translation[row] -= sceneMin[row];
+
+    scene->size.x = (uint32_t)extent[0];
+    scene->size.y = (uint32_t)extent[1];
+    scene->size.z = (uint32_t)extent[2];
+
+    return 0;
+}
+
+// Shares models between instances when they hold the exact same voxels and drops models
+// no instance uses
+void DeduplicateModels(PisVoxScene* scene)
+{
+    uint32_t* remap = malloc(sizeof(uint32_t) * scene->modelCount);
+    uint64_t* hashes = malloc(sizeof(uint64_t) * scene->modelCount);
+    bool* used = calloc(scene->modelCount, sizeof(bool));
+
+    if(remap == NULL || hashes == NULL || used == NULL)
+    {
+        free(remap);
+        free(hashes);
+        free(used);
+        return;
+    }
+
+    for(uint32_t i = 0; i < scene->instanceCount; i++)
+        used[scene->instances[i].model] = true;
+
+    uint32_t uniqueCount = 0;
+
+    for(uint32_t i = 0; i < scene->modelCount; i++)
+    {
+        PisVoxModel model = scene->models[i];
+        size_t arraySize = (size_t)model.size.x * model.size.y * model.size.z;
+
+        if(!used[i])
+        {
+            free(model.voxels);
+            remap[i] = UINT32_MAX;
+            continue;
+        }
+
+        // FNV-1a over the voxels
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for(size_t v = 0; v < arraySize; v++)
+            hash = (hash ^ model.voxels[v]) * 0x100000001b3ull;
+
+        remap[i] = uniqueCount;
+
+        for(uint32_t j = 0; j < uniqueCount; j++)
+        {
+            PisVoxModel other = scene->models[j];
+
+            if(hashes[j] == hash && other.size.x == model.size.x && other.size.y == model.size.y
+            && other.size.z == model.size.z && memcmp(other.voxels, model.voxels, arraySize) == 0)
+            {
+                remap[i] = j;
+                break;
+            }
+        }
+
+        if(remap[i] == uniqueCount)
+        {
+            hashes[uniqueCount] = hash;
+            scene->models[uniqueCount++] = model;
+        }
+        else
+        {
+            free(model.voxels);
+        }
+    }
+
+    for(uint32_t i = 0; i < scene->instanceCount; i++)
+        scene->instances[i].model = remap[scene->instances[i].model];
+
+    scene->modelCount = uniqueCount;
+
+    free(remap);
+    free(hashes);
+    free(used);
+}
+
+// A 6x6x6 color cube without black, followed by ramps of red, green, blue and gray
+void PisVoxDefaultPalette(Material* materials)
+{
+    static const uint8_t cube[6] = { 0xff, 0xcc, 0x99, 0x66, 0x33, 0x00 };
+    static const uint8_t ramp[10] = { 0xee, 0xdd, 0xbb, 0xaa, 0x88, 0x77, 0x55, 0x44, 0x22, 0x11 };
+
+    uint32_t index = 0;
+
+    for(uint32_t r = 0; r < 6; r++)
+        for(uint32_t g = 0; g < 6; g++)
+            for(uint32_t b = 0; b < 6 && index < 215; b++)
+                materials[index++].color = (Color){ cube[r], cube[g], cube[b], 0xff };
+
+    for(uint32_t channel = 0; channel < 4; channel++)
+    {
+        for(uint32_t i = 0; i < 10; i++)
+        {
+            Color color = { 0, 0, 0, 0xff };
+            if(channel == 0 || channel == 3) color.r = ramp[i];
+            if(channel == 1 || channel == 3) color.g = ramp[i];
+            if(channel == 2 || channel == 3) color.b = ramp[i];
+
+            materials[index++].color = color;
+        }
+    }
+
+    materials[255].color = (Color){ 0, 0, 0, 0 };
+}
+
+int32_t CursorReadInt(VoxCursor* cursor)
+{
+    if(cursor->end - cursor->ptr < 4)
+    {
+        cursor->failed = true;
+        return 0;
+    }
+
+    int32_t value = (int32_t)ReadLE32(cursor->ptr);
+    cursor->ptr += 4;
+
+    return value;
+}
+
+// Reads a DICT and keeps the few attributes the loader understands
+void CursorReadDict(VoxCursor* cursor, VoxDict* dict)
+{
+    memset(dict, 0, sizeof(VoxDict));
+
+    int32_t pairCount = CursorReadInt(cursor);
+
+    for(int32_t i = 0; i < pairCount && !cursor->failed; i++)
+    {
+        const char* strings[2];
+        int32_t lengths[2];
+
+        for(uint32_t s = 0; s < 2; s++)
+        {
+            lengths[s] = CursorReadInt(cursor);
+            if(cursor->failed || lengths[s] < 0 || lengths[s] > cursor->end - cursor->ptr)
+            {
+                cursor->failed = true;
+                return;
+            }
+
+            strings[s] = (const char*)cursor->ptr;
+            cursor->ptr += lengths[s];
+        }
+
+        char* target = NULL;
+        size_t targetSize = 0;
+
+        if(lengths[0] == 2 && memcmp(strings[0], "_t", 2) == 0)
+        {
+            target = dict->translation;
+            targetSize = sizeof(dict->translation);
+        }
+        else if(lengths[0] == 2 && memcmp(strings[0], "_r", 2) == 0)
+        {
+            target = dict->rotation;
+            targetSize = sizeof(dict->rotation);
+        }
+        else if(lengths[0] == 7 && memcmp(strings[0], "_hidden", 7) == 0)
+        {
+            dict->hidden = lengths[1] > 0 && strings[1][0] == '1';
+        }
+
+        if(target != NULL && (size_t)lengths[1] < targetSize)
+        {
+            memcpy(target, strings[1], lengths[1]);
+            target[lengths[1]] = '\0';
+        }
+    }
+}
+
+VoxTransform TransformIdentity(void)
+{
+    VoxTransform transform = {0};
+    transform.r[0][0] = 1;
+    transform.r[1][1] = 1;
+    transform.r[2][2] = 1;
+
+    return transform;
+}
+
+// Returns a after b: a.r * (b.r * v + b.t) + a.t
+VoxTransform TransformCompose(VoxTransform a, VoxTransform b)
+{
+    VoxTransform result = {0};
+
+    for(uint32_t row = 0; row < 3; row++)
+    {
+        result.t[row] = a.t[row];
+
+        for(uint32_t col = 0; col < 3; col++)
+        {
+            result.t[row] += a.r[row][col] * b.t[col];
+
+            for(uint32_t k = 0; k < 3; k++)
+                result.r[row][col] += a.r[row][k] * b.r[k][col];
+        }
+    }
+
+    return result;
+}
+
+// ROTN byte: bits 0-1 and 2-3 hold the column of the non zero entry in the first and second
+// row, bits 4-6 whether the entry of the first, second and third row is negative
+VoxTransform TransformFromRotation(uint8_t rotation)
+{
+    uint32_t first = rotation & 3;
+    uint32_t second = (rotation >> 2) & 3;
+
+    if(first > 2 || second > 2 || first == second)
+        return TransformIdentity();
+
+    uint32_t third = 3 - first - second;
+
+    VoxTransform transform = {0};
+    transform.r[0][first] = (rotation & (1 << 4)) ? -1 : 1;
+    transform.r[1][second] = (rotation & (1 << 5)) ? -1 : 1;
+    transform.r[2][third] = (rotation & (1 << 6)) ? -1 : 1;
+
+    return transform;
+}
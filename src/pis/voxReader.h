@@ -0,0 +1,57 @@
+#ifndef VOX_READER_H
+#define VOX_READER_H
+
+#include <stdint.h>
+
+#include "pisVoxReader.h"
+
+// A model volume, laid out the same way as PisVox.voxels
+typedef struct PisVoxModel {
+    Size size;
+    uint8_t* voxels;
+} PisVoxModel;
+
+// Places a model in the scene. Maps a model voxel index m to a scene voxel index:
+// scene = rotation * m + translation. The rotation is always a signed permutation.
+typedef struct PisVoxInstance {
+    uint32_t model;
+    int8_t rotation[3][3];
+    int32_t translation[3];
+} PisVoxInstance;
+
+// Models and the instances placing them, everything in y up scene voxel space with
+// the scene starting at 0 and spanning size
+typedef struct PisVoxScene {
+    Size size;
+
+    PisVoxModel* models;
+    uint32_t modelCount;
+
+    PisVoxInstance* instances;
+    uint32_t instanceCount;
+
+    Material materials[256];
+} PisVoxScene;
+
+// Reads a MagicaVoxel .vox file into a PisVox volume, with every instance of the scene
+// graph flattened into it.
+// MagicaVoxel is z up, the volume is turned to y up: (x, y, z) -> (x, z, sizeY - 1 - y).
+PisVox PisVoxReadVoxFile(char* fileName);
+
+// Reads a MagicaVoxel .vox file and keeps the scene graph (nTRN/nGRP/nSHP) as instances of
+// shared models. Models that are referenced more than once, or that hold the exact same
+// voxels, are stored once.
+PisVoxScene PisVoxSceneReadVoxFile(char* fileName);
+
+// Same as PisVoxSceneReadVoxFile, but returns -1 instead of exiting when the file can not be read
+int PisVoxSceneLoadVoxFile(char* fileName, PisVoxScene* scene);
+
+// Bakes every instance into one dense volume of scene.size, returns -1 when it can not be allocated
+int PisVoxSceneFlatten(PisVoxScene* scene, PisVox* pisV);
+
+void DestroyPisVoxScene(PisVoxScene scene);
+
+// Fills materials with the MagicaVoxel default palette, used by files without an RGBA chunk
+void PisVoxDefaultPalette(Material* materials);
+
+#endif
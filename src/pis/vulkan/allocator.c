@@ -0,0 +1,366 @@
+#include "allocator.h"
+#include "buffers.h"
+#include "pisdef.h"
+
+#include "vulkan/vulkan_core.h"
+
+typedef struct FreeRange {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+} FreeRange;
+
+struct MemoryBlock {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    VkDeviceSize used;
+    void* mapped;
+    uint32_t memoryType;
+
+    // Only used by one allocation that was too large to share a block
+    bool dedicated;
+    uint32_t allocationCount;
+
+    // Sorted by offset, neighbouring ranges are always merged
+    FreeRange* freeRanges;
+    uint32_t freeCount;
+    uint32_t freeCapacity;
+
+    MemoryBlock* next;
+};
+
+/* =================================Helper functions================================ */
+MemoryBlock* CreateMemoryBlock(Allocator* allocator, uint32_t memoryType, VkDeviceSize size, bool dedicated);
+void DestroyMemoryBlock(Allocator* allocator, MemoryBlock* block);
+int TakeFromBlock(MemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset);
+int ReturnToBlock(MemoryBlock* block, VkDeviceSize offset, VkDeviceSize size);
+int InsertFreeRange(MemoryBlock* block, uint32_t index, FreeRange range);
+void RemoveFreeRange(MemoryBlock* block, uint32_t index);
+VkDeviceSize BlockSizeForType(Allocator* allocator, uint32_t memoryType);
+VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment);
+/* ================================================================================ */
+
+void CreateAllocator(VkDevice device, VkPhysicalDevice pDevice, Allocator* allocator)
+{
+    memset(allocator, 0, sizeof(Allocator));
+
+    allocator->device = device;
+    allocator->physicalDevice = pDevice;
+
+    vkGetPhysicalDeviceMemoryProperties(pDevice, &allocator->memoryProperties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(pDevice, &properties);
+
+    allocator->bufferImageGranularity = properties.limits.bufferImageGranularity;
+    allocator->maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+}
+
+void DestroyAllocator(Allocator* allocator)
+{
+    if(allocator->allocationCount != 0)
+        fprintf(stderr, "Destroying allocator with %u allocations still alive\n", allocator->allocationCount);
+
+    for(uint32_t type = 0; type < VK_MAX_MEMORY_TYPES; type++)
+    {
+        MemoryBlock* block = allocator->blocks[type];
+        while(block != NULL)
+        {
+            MemoryBlock* next = block->next;
+            DestroyMemoryBlock(allocator, block);
+            block = next;
+        }
+
+        allocator->blocks[type] = NULL;
+    }
+}
+
+int AllocateMemory(Allocator* allocator, VkMemoryRequirements requirements,
+                   VkMemoryPropertyFlags properties, Allocation* allocation)
+{
+    memset(allocation, 0, sizeof(Allocation));
+
+    uint32_t memoryType = FindMemoryType(allocator->physicalDevice, requirements.memoryTypeBits, properties);
+
+    // Buffers and optimal images may not share a granularity page, keeping every allocation on
+    // its own pages is simpler than tracking which kind of resource sits next to which
+    VkDeviceSize granularity = allocator->bufferImageGranularity > 1 ? allocator->bufferImageGranularity : 1;
+    VkDeviceSize alignment = requirements.alignment > granularity ? requirements.alignment : granularity;
+    VkDeviceSize size = AlignUp(requirements.size, granularity);
+
+    VkDeviceSize blockSize = BlockSizeForType(allocator, memoryType);
+
+    MemoryBlock* block = NULL;
+    VkDeviceSize offset = 0;
+
+    if(size > blockSize / 2)
+    {
+        // Large resources get their own memory instead of eating most of a block
+        block = CreateMemoryBlock(allocator, memoryType, size, true);
+    }
+    else
+    {
+        for(block = allocator->blocks[memoryType]; block != NULL; block = block->next)
+        {
+            if(!block->dedicated && TakeFromBlock(block, size, alignment, &offset) == 0)
+                break;
+        }
+
+        if(block == NULL)
+        {
+            block = CreateMemoryBlock(allocator, memoryType, blockSize, false);
+            if(block != NULL && TakeFromBlock(block, size, alignment, &offset) != 0)
+                return -1;
+        }
+    }
+
+    if(block == NULL)
+        return -1;
+
+    block->used += size;
+    block->allocationCount++;
+    allocator->allocationCount++;
+
+    allocation->memory = block->memory;
+    allocation->offset = offset;
+    allocation->size = size;
+    allocation->mapped = block->mapped ? (uint8_t*)block->mapped + offset : NULL;
+    allocation->block = block;
+
+    return 0;
+}
+
+void FreeMemory(Allocator* allocator, Allocation* allocation)
+{
+    MemoryBlock* block = allocation->block;
+    if(block == NULL)
+        return;
+
+    block->used -= allocation->size;
+    block->allocationCount--;
+    allocator->allocationCount--;
+
+    if(!block->dedicated && ReturnToBlock(block, allocation->offset, allocation->size) != 0)
+        fprintf(stderr, "Failed to return %llu bytes to a memory block, they are lost until shutdown\n",
+                (unsigned long long)allocation->size);
+
+    // Dedicated blocks always go, shared blocks only when there is another one of their type
+    // to fall back on, so a resource that is recreated does not reallocate its block every time
+    bool lastShared = !block->dedicated && allocator->blocks[block->memoryType] == block && block->next == NULL;
+
+    if(block->allocationCount == 0 && !lastShared)
+    {
+        MemoryBlock** link = &allocator->blocks[block->memoryType];
+        while(*link != block)
+            link = &(*link)->next;
+
+        *link = block->next;
+        DestroyMemoryBlock(allocator, block);
+    }
+
+    memset(allocation, 0, sizeof(Allocation));
+}
+
+void PrintAllocatorStats(Allocator* allocator)
+{
+    printf("Device memory: %u allocations in %u vkAllocateMemory calls (limit %u)\n",
+           allocator->allocationCount, allocator->deviceAllocationCount, allocator->maxAllocationCount);
+
+    for(uint32_t type = 0; type < allocator->memoryProperties.memoryTypeCount; type++)
+    {
+        if(allocator->blocks[type] == NULL)
+            continue;
+
+        uint32_t blockCount = 0;
+        uint32_t allocationCount = 0;
+        uint32_t freeCount = 0;
+        VkDeviceSize reserved = 0;
+        VkDeviceSize used = 0;
+        VkDeviceSize largestFree = 0;
+        VkDeviceSize totalFree = 0;
+
+        for(MemoryBlock* block = allocator->blocks[type]; block != NULL; block = block->next)
+        {
+            blockCount++;
+            allocationCount += block->allocationCount;
+            reserved += block->size;
+            used += block->used;
+
+            for(uint32_t i = 0; i < block->freeCount; i++)
+            {
+                freeCount++;
+                totalFree += block->freeRanges[i].size;
+                largestFree = block->freeRanges[i].size > largestFree ? block->freeRanges[i].size : largestFree;
+            }
+        }
+
+        VkMemoryPropertyFlags flags = allocator->memoryProperties.memoryTypes[type].propertyFlags;
+
+        // Fragmentation: how much of the free space is not in the largest free range
+        printf("  type %2u (%s%s%s): %u blocks, %.2f of %.2f MB used by %u allocations, "
+               "%u free ranges, largest %.2f MB, %.0f%% fragmented\n", type,
+               (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ? "device local " : "",
+               (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) ? "host visible " : "",
+               (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) ? "coherent" : "",
+               blockCount, used / (1024.0 * 1024.0), reserved / (1024.0 * 1024.0), allocationCount,
+               freeCount, largestFree / (1024.0 * 1024.0),
+               totalFree ? 100.0 * (double)(totalFree - largestFree) / (double)totalFree : 0.0);
+    }
+}
+
+MemoryBlock* CreateMemoryBlock(Allocator* allocator, uint32_t memoryType, VkDeviceSize size, bool dedicated)
+{
+    MemoryBlock* block = calloc(1, sizeof(MemoryBlock));
+    if(block == NULL)
+        return NULL;
+
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = size,
+        .memoryTypeIndex = memoryType,
+    };
+
+    if(vkAllocateMemory(allocator->device, &allocInfo, NULL, &block->memory) != VK_SUCCESS)
+    {
+        fprintf(stderr, "Failed to allocate a %.2f MB memory block of type %u\n", size / (1024.0 * 1024.0), memoryType);
+        free(block);
+        return NULL;
+    }
+
+    allocator->deviceAllocationCount++;
+
+    block->size = size;
+    block->memoryType = memoryType;
+    block->dedicated = dedicated;
+
+    // Host visible blocks are mapped once for their whole life, vkMapMemory can only map a
+    // memory object once, so allocations could not be mapped on their own anyway
+    if(allocator->memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        VK_CHECK(vkMapMemory(allocator->device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped));
+
+    if(!dedicated && InsertFreeRange(block, 0, (FreeRange){ 0, size }) != 0)
+    {
+        DestroyMemoryBlock(allocator, block);
+        return NULL;
+    }
+
+    block->next = allocator->blocks[memoryType];
+    allocator->blocks[memoryType] = block;
+
+    return block;
+}
+
+void DestroyMemoryBlock(Allocator* allocator, MemoryBlock* block)
+{
+    if(block->mapped != NULL)
+        vkUnmapMemory(allocator->device, block->memory);
+
+    vkFreeMemory(allocator->device, block->memory, NULL);
+    allocator->deviceAllocationCount--;
+
+    free(block->freeRanges);
+    free(block);
+}
+
+// First fit over the free ranges
+int TakeFromBlock(MemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset)
+{
+    for(uint32_t i = 0; i < block->freeCount; i++)
+    {
+        FreeRange range = block->freeRanges[i];
+
+        VkDeviceSize start = AlignUp(range.offset, alignment);
+        VkDeviceSize end = range.offset + range.size;
+
+        if(start > end || end - start < size)
+            continue;
+
+        // Whatever is left in front of and behind the allocation stays free
+        FreeRange before = { range.offset, start - range.offset };
+        FreeRange after = { start + size, end - (start + size) };
+
+        RemoveFreeRange(block, i);
+
+        if(after.size != 0 && InsertFreeRange(block, i, after) != 0)
+            return -1;
+
+        if(before.size != 0 && InsertFreeRange(block, i, before) != 0)
+            return -1;
+
+        *offset = start;
+        return 0;
+    }
+
+    return -1;
+}
+
+int ReturnToBlock(MemoryBlock* block, VkDeviceSize offset, VkDeviceSize size)
+{
+    uint32_t index = 0;
+    while(index < block->freeCount && block->freeRanges[index].offset < offset)
+        index++;
+
+    FreeRange range = { offset, size };
+
+    // Merge with the free range in front
+    if(index > 0 && block->freeRanges[index - 1].offset + block->freeRanges[index - 1].size == offset)
+    {
+        index--;
+        range.offset = block->freeRanges[index].offset;
+        range.size += block->freeRanges[index].size;
+        RemoveFreeRange(block, index);
+    }
+
+    // And the one behind
+    if(index < block->freeCount && range.offset + range.size == block->freeRanges[index].offset)
+    {
+        range.size += block->freeRanges[index].size;
+        RemoveFreeRange(block, index);
+    }
+
+    return InsertFreeRange(block, index, range);
+}
+
+int InsertFreeRange(MemoryBlock* block, uint32_t index, FreeRange range)
+{
+    if(block->freeCount == block->freeCapacity)
+    {
+        uint32_t capacity = block->freeCapacity ? block->freeCapacity * 2 : 16;
+        FreeRange* ranges = realloc(block->freeRanges, sizeof(FreeRange) * capacity);
+        if(ranges == NULL)
+            return -1;
+
+        block->freeRanges = ranges;
+        block->freeCapacity = capacity;
+    }
+
+    memmove(&block->freeRanges[index + 1], &block->freeRanges[index], sizeof(FreeRange) * (block->freeCount - index));
+    block->freeRanges[index] = range;
+    block->freeCount++;
+
+    return 0;
+}
+
+void RemoveFreeRange(MemoryBlock* block, uint32_t index)
+{
+    memmove(&block->freeRanges[index], &block->freeRanges[index + 1], sizeof(FreeRange) * (block->freeCount - index - 1));
+    block->freeCount--;
+}
+
+// Small heaps (like the 256 MB of host visible device memory many gpus have) get smaller
+// blocks, so one block does not take all of it
+VkDeviceSize BlockSizeForType(Allocator* allocator, uint32_t memoryType)
+{
+    uint32_t heap = allocator->memoryProperties.memoryTypes[memoryType].heapIndex;
+    VkDeviceSize heapSize = allocator->memoryProperties.memoryHeaps[heap].size;
+
+    VkDeviceSize blockSize = ALLOCATOR_BLOCK_SIZE;
+    while(blockSize > 1024 * 1024 && blockSize > heapSize / 8)
+        blockSize /= 2;
+
+    return blockSize;
+}
+
+VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
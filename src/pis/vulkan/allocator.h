@@ -0,0 +1,53 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "volk.h"
+#include "vulkan/vulkan_core.h"
+
+// Device memory is allocated in blocks of this size and handed out in pieces
+#define ALLOCATOR_BLOCK_SIZE (64ull * 1024 * 1024)
+
+typedef struct MemoryBlock MemoryBlock;
+
+// A piece of a memory block. Host visible memory stays mapped, mapped points at offset.
+typedef struct Allocation {
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    void* mapped;
+    MemoryBlock* block;
+} Allocation;
+
+typedef struct Allocator {
+    VkDevice device;
+    VkPhysicalDevice physicalDevice;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    VkDeviceSize bufferImageGranularity;
+    uint32_t maxAllocationCount;
+
+    // Blocks per memory type
+    MemoryBlock* blocks[VK_MAX_MEMORY_TYPES];
+
+    uint32_t deviceAllocationCount;
+    uint32_t allocationCount;
+} Allocator;
+
+void CreateAllocator(VkDevice device, VkPhysicalDevice pDevice, Allocator* allocator);
+
+// Frees every block, allocations that are still alive are reported
+void DestroyAllocator(Allocator* allocator);
+
+// Finds room for requirements in a memory type with properties, allocating a new block when
+// none of the existing ones has space. Returns 0 on success.
+int AllocateMemory(Allocator* allocator, VkMemoryRequirements requirements,
+                   VkMemoryPropertyFlags properties, Allocation* allocation);
+
+void FreeMemory(Allocator* allocator, Allocation* allocation);
+
+// Prints blocks, used and free bytes and fragmentation per memory type
+void PrintAllocatorStats(Allocator* allocator);
+
+#endif
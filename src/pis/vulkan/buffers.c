@@ -1,9 +1,14 @@
 #include "buffers.h"
 
+#include "command_buffer.h"
 #include "pisdef.h"
 #include "vulkan/vulkan_core.h"
 
-int CreateBuffer(VkDevice device, VkPhysicalDevice pDevice,
+/* =================================Helper functions================================ */
+bool IsUnifiedMemoryDevice(VkPhysicalDevice pDevice);
+/* ================================================================================ */
+
+int CreateBuffer(VkDevice device, Allocator* allocator,
                  VkDeviceSize size, VkBufferUsageFlags usage,
                  VkMemoryPropertyFlags properties, Buffer* buffer)
 {
@@ -14,26 +19,50 @@ int CreateBuffer(VkDevice device, VkPhysicalDevice pDevice,
 		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
 	};
 
-    buffer->size = size;
+	memset(buffer, 0, sizeof(Buffer));
+	buffer->size = size;
 
-    VK_CHECK(vkCreateBuffer(device, &bufferInfo, NULL, &buffer->buffer));
+	if(vkCreateBuffer(device, &bufferInfo, NULL, &buffer->buffer) != VK_SUCCESS)
+	{
+		fprintf(stderr, "Failed to create a buffer of %llu bytes\n", (unsigned long long)size);
+		memset(buffer, 0, sizeof(Buffer));
+		return -1;
+	}
 
 	VkMemoryRequirements memRequirements;
 	vkGetBufferMemoryRequirements(device, buffer->buffer, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {
-		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		.allocationSize = memRequirements.size,
-		.memoryTypeIndex = FindMemoryType(pDevice, memRequirements.memoryTypeBits, properties)
-	};
+	if(AllocateMemory(allocator, memRequirements, properties, &buffer->allocation) != 0)
+	{
+		fprintf(stderr, "Failed to allocate %llu bytes of buffer memory\n", (unsigned long long)size);
+		vkDestroyBuffer(device, buffer->buffer, NULL);
+		memset(buffer, 0, sizeof(Buffer));
+		return -1;
+	}
 
-	VK_CHECK(vkAllocateMemory(device, &allocInfo, NULL, &buffer->memory));
+	if(vkBindBufferMemory(device, buffer->buffer, buffer->allocation.memory, buffer->allocation.offset) != VK_SUCCESS)
+	{
+		fprintf(stderr, "Failed to bind buffer memory\n");
+		DestroyBuffer(device, allocator, buffer);
+		return -1;
+	}
 
-	VK_CHECK(vkBindBufferMemory(device, buffer->buffer, buffer->memory, 0));
+	// Host visible memory is always mapped by the allocator
+	buffer->ptr = buffer->allocation.mapped;
 
 	return 0;
 }
 
+void DestroyBuffer(VkDevice device, Allocator* allocator, Buffer* buffer)
+{
+	if(buffer->buffer == VK_NULL_HANDLE)
+		return;
+
+	vkDestroyBuffer(device, buffer->buffer, NULL);
+	FreeMemory(allocator, &buffer->allocation);
+	memset(buffer, 0, sizeof(Buffer));
+}
+
 uint32_t FindMemoryType(VkPhysicalDevice pDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties)
 {
 	VkPhysicalDeviceMemoryProperties memProperties;
@@ -53,44 +82,97 @@ uint32_t FindMemoryType(VkPhysicalDevice pDevice, uint32_t typeFilter, VkMemoryP
 
 int CopyBuffer(VkDevice device, VkCommandPool commandPool, VkQueue queue, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
 {
-	VkCommandBufferAllocateInfo allocInfo = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandPool = commandPool,
-		.commandBufferCount = 1
-	};
-
-
-	VkCommandBuffer commandBuffer;
-	VK_CHECK(vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer));
-
-	VkCommandBufferBeginInfo beginInfo = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
-	};
+	return CopyBufferRegion(device, commandPool, queue, srcBuffer, dstBuffer, 0, size);
+}
 
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+int CopyBufferRegion(VkDevice device, VkCommandPool commandPool, VkQueue queue, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size)
+{
+	VkCommandBuffer commandBuffer = BeginSingleTimeCommands(device, commandPool);
 
 	VkBufferCopy copyRegion = {
 		.srcOffset = 0,
-		.dstOffset = 0,
+		.dstOffset = dstOffset,
 		.size = size
 	};
 
 	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
-	vkEndCommandBuffer(commandBuffer);
-
-	VkSubmitInfo submitInfo = {
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &commandBuffer
+	// Make the copy visible to whatever reads the buffer in later submissions
+	VkMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT
 	};
 
-	vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(queue);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+	                     0, 1, &barrier, 0, NULL, 0, NULL);
+
+	EndSingleTimeCommands(commandBuffer, device, commandPool, queue);
+
+	return 0;
+}
+
+void* StartBufferUpload(VkDevice device, Allocator* allocator, VkDeviceSize size, VkBufferUsageFlags usage,
+                        bool allowDirect, Buffer* buffer, Buffer* staging)
+{
+	memset(staging, 0, sizeof(Buffer));
+
+	// Device local memory the cpu can see is as fast as it gets, write straight into it
+	if(allowDirect && IsUnifiedMemoryDevice(allocator->physicalDevice))
+	{
+		if(CreateBuffer(device, allocator, size, usage,
+		                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer) != 0)
+			exit(-1);
+
+		return buffer->ptr;
+	}
+
+	if(CreateBuffer(device, allocator, size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer) != 0)
+		exit(-1);
+	buffer->ptr = NULL;
+
+	if(CreateBuffer(device, allocator, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging) != 0)
+		exit(-1);
+
+	return staging->ptr;
+}
+
+int FinishBufferUpload(VkDevice device, Allocator* allocator, VkCommandPool commandPool, VkQueue queue, Buffer* buffer, Buffer* staging)
+{
+	if(staging->buffer == VK_NULL_HANDLE)
+	{
+		buffer->ptr = NULL;
+		return 0;
+	}
+
+	CopyBuffer(device, commandPool, queue, staging->buffer, buffer->buffer, buffer->size);
 
-	vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+	DestroyBuffer(device, allocator, staging);
 
 	return 0;
 }
+
+// Integrated gpus (and cpu implementations like lavapipe) share memory with the host and
+// expose device local memory that is also host visible
+bool IsUnifiedMemoryDevice(VkPhysicalDevice pDevice)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(pDevice, &properties);
+
+	if(properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU && properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_CPU)
+		return false;
+
+	VkMemoryPropertyFlags wanted = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	VkPhysicalDeviceMemoryProperties memProperties;
+	vkGetPhysicalDeviceMemoryProperties(pDevice, &memProperties);
+
+	for(uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+	{
+		if((memProperties.memoryTypes[i].propertyFlags & wanted) == wanted)
+			return true;
+	}
+
+	return false;
+}
@@ -1,20 +1,41 @@
 #ifndef BUFFERS_H
 #define BUFFERS_H
 
+#include <stdbool.h>
+
+#include "allocator.h"
 #include "volk.h"
 #include "vulkan/vulkan_core.h"
 
 typedef struct Buffer {
     VkBuffer buffer;
-    VkDeviceMemory memory;
+    Allocation allocation;
     void* ptr;
     VkDeviceSize size;
 } Buffer;
 
-int CreateBuffer(VkDevice device, VkPhysicalDevice pDevice,
+// ptr is set when properties include host visible memory. Returns -1 and leaves buffer empty
+// when the buffer or its memory can not be created.
+int CreateBuffer(VkDevice device, Allocator* allocator,
                  VkDeviceSize size, VkBufferUsageFlags usage,
                  VkMemoryPropertyFlags properties, Buffer* buffer);
 
+void DestroyBuffer(VkDevice device, Allocator* allocator, Buffer* buffer);
+
 uint32_t FindMemoryType(VkPhysicalDevice pDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties);
 
+// Copies size bytes from srcBuffer to dstBuffer and waits until the copy is done
+int CopyBuffer(VkDevice device, VkCommandPool commandPool, VkQueue queue, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+
+// Same, but writes to dstBuffer starting at dstOffset
+int CopyBufferRegion(VkDevice device, VkCommandPool commandPool, VkQueue queue, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size);
+
+// Creates buffer in DEVICE_LOCAL memory and returns where to write its size bytes of contents.
+// That is a staging buffer FinishBufferUpload copies from, or with allowDirect on unified memory
+// devices the buffer itself. Exits when either buffer can not be created.
+void* StartBufferUpload(VkDevice device, Allocator* allocator, VkDeviceSize size, VkBufferUsageFlags usage,
+                        bool allowDirect, Buffer* buffer, Buffer* staging);
+
+int FinishBufferUpload(VkDevice device, Allocator* allocator, VkCommandPool commandPool, VkQueue queue, Buffer* buffer, Buffer* staging);
+
 #endif
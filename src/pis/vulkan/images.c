@@ -5,14 +5,14 @@
 #include "buffers.h"
 
 void CreateImage(VkDevice device,
-                 VkPhysicalDevice pDevice,
+                 Allocator* allocator,
                  VkFormat format,
                  VkImageType imageType,
                  VkImageUsageFlags imageUsage,
                  VkExtent3D extent,
                  VkMemoryPropertyFlags properties,
                  VkImage* image,
-                 VkDeviceMemory* imageMemory)
+                 Allocation* imageMemory)
 {
     VkImageCreateInfo drawImgInfo = ImageCreateInfo(format, imageType, imageUsage, extent);
     VK_CHECK(vkCreateImage(device, &drawImgInfo, NULL, image));
@@ -20,18 +20,12 @@ void CreateImage(VkDevice device,
     VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(device, *image, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memRequirements.size,
-        .memoryTypeIndex = FindMemoryType(pDevice, memRequirements.memoryTypeBits, properties),
-    };
-
-    if (vkAllocateMemory(device, &allocInfo, NULL, imageMemory) != VK_SUCCESS) {
+    if (AllocateMemory(allocator, memRequirements, properties, imageMemory) != 0) {
         fprintf(stderr, "failed to allocate image memory!\n");
         exit(-1);
     }
 
-    vkBindImageMemory(device, *image, *imageMemory, 0);
+    vkBindImageMemory(device, *image, imageMemory->memory, imageMemory->offset);
 }
 
 void TransitionImage(VkCommandBuffer cmd, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout)
@@ -70,6 +64,14 @@ void TransitionImage(VkCommandBuffer cmd, VkImage image, VkImageLayout oldLayout
         srcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
         dstStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
     }
+    else if (oldLayout == VK_IMAGE_LAYOUT_GENERAL &&
+             newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+        // The compute shader has to be done writing before the image is copied out
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        srcStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
     else {
         // Add other transitions as needed
         barrier.srcAccessMask = 0;
@@ -1,6 +1,7 @@
 #ifndef IMAGES_H
 #define IMAGES_H
 
+#include "allocator.h"
 #include "volk.h"
 #include "vulkan/vulkan_core.h"
 
@@ -9,18 +10,18 @@ typedef struct AllocatedImage {
     VkImageView view;
     VkExtent3D extent;
     VkFormat format;
-    VkDeviceMemory memory;
+    Allocation allocation;
 } AllocatedImage;
 
 void CreateImage(VkDevice device,
-                 VkPhysicalDevice pDevice,
+                 Allocator* allocator,
                  VkFormat format,
                  VkImageType imageType,
                  VkImageUsageFlags imageUsage,
                  VkExtent3D extent,
                  VkMemoryPropertyFlags properties,
                  VkImage* image,
-                 VkDeviceMemory* imageMemory);
+                 Allocation* imageMemory);
 
 void TransitionImage(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout);
 
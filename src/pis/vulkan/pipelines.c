@@ -66,9 +66,9 @@ void CreateComputePipelineLayout(VkDevice device, VkDescriptorSetLayout* descrip
                                     layout));
 }
 
-void CreateComputePipeline(VkDevice device, VkPipelineLayout layout, VkPipeline* computePipeline)
+void CreateComputePipeline(VkDevice device, VkPipelineLayout layout, const char* shaderFile, VkPipeline* computePipeline)
 {
-    VkShaderModule computeShaderMod = CreateShaderModule(device, "/Users/nielsbil/Dev/voxel/shaders/shader.spv");
+    VkShaderModule computeShaderMod = CreateShaderModule(device, shaderFile);
 
     VkPipelineShaderStageCreateInfo shaderStage = {0};
     shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -10,6 +10,6 @@ typedef struct Pipeline {
 
 void CreateComputePipelineLayout(VkDevice device, VkDescriptorSetLayout* descriptorLayouts, uint32_t descriptorLayoutCount, VkPipelineLayout* layout);
 
-void CreateComputePipeline(VkDevice device, VkPipelineLayout layout, VkPipeline* computePipeline);
+void CreateComputePipeline(VkDevice device, VkPipelineLayout layout, const char* shaderFile, VkPipeline* computePipeline);
 
 #endif
@@ -125,13 +125,13 @@ void CreateDrawImages(PisEngine* pis, uint32_t width, uint32_t height)
 	drawImageUsages |= VK_IMAGE_USAGE_STORAGE_BIT;
 	drawImageUsages |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-    CreateImage(pis->vk.device, pis->vk.physicalDevice,
+    CreateImage(pis->vk.device, &pis->vk.allocator,
                 pis->vk.drawImage.format,
                 VK_IMAGE_TYPE_2D,
                 drawImageUsages, pis->vk.drawImage.extent,
                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                 &pis->vk.drawImage.image,
-                &pis->vk.drawImage.memory);
+                &pis->vk.drawImage.allocation);
 
     VkImageViewCreateInfo imgViewInfo = ImageViewCreateInfo(pis->vk.drawImage.format, VK_IMAGE_VIEW_TYPE_2D,
                                                             pis->vk.drawImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
@@ -36,7 +36,8 @@ const char* deviceExtentions[] = {
 
 /* =================================Helper functions================================ */
 
-const char** GetExtentionNames(uint32_t* extentionCount);
+const char** GetExtentionNames(bool withSdl, uint32_t* extentionCount);
+uint32_t GetDeviceExtentionNames(PisEngine* pis, const char** names);
 void SelectPhysicalDevice(VkInstance instance, VkPhysicalDevice* pDevice);
 QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice pDevice);
 
@@ -56,7 +57,7 @@ void InitVulkan(PisEngine* pis)
     };
 
     uint32_t extentionCount = 0;
-    const char** extentionNames = GetExtentionNames(&extentionCount);
+    const char** extentionNames = GetExtentionNames(!pis->headless, &extentionCount);
 
     VkInstanceCreateInfo instanceCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
@@ -78,7 +79,6 @@ void InitVulkan(PisEngine* pis)
     instanceCreateInfo.ppEnabledLayerNames = GetValidationLayers();
 #endif
 
-    //TODO: Build memory allocator
     VK_CHECK(vkCreateInstance(&instanceCreateInfo, NULL, &pis->vk.instance));
 
     free(extentionNames);
@@ -90,8 +90,9 @@ void InitVulkan(PisEngine* pis)
     SetupDebugMessenger(pis->vk.instance, &pis->vk.debugMessenger, false);
 #endif
 
-    // Create the vulkan rendering surface with SDL
-    SDL_Vulkan_CreateSurface(pis->window, pis->vk.instance, NULL, &pis->vk.surface);
+    // Create the vulkan rendering surface with SDL, headless frames never leave drawImage
+    if(!pis->headless)
+        SDL_Vulkan_CreateSurface(pis->window, pis->vk.instance, NULL, &pis->vk.surface);
 
     // Pick physical device
     SelectPhysicalDevice(pis->vk.instance, &pis->vk.physicalDevice);
@@ -111,13 +112,16 @@ void InitVulkan(PisEngine* pis)
     features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
     features.pNext = NULL;
     
+    const char* enabledDeviceExtentions[deviceExtentionCount];
+    uint32_t enabledDeviceExtentionCount = GetDeviceExtentionNames(pis, enabledDeviceExtentions);
+
     VkDeviceCreateInfo deviceCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
         .pNext = &features,
         .pQueueCreateInfos = &queueCreateInfo,
         .queueCreateInfoCount = 1,
-		.enabledExtensionCount = deviceExtentionCount,
-		.ppEnabledExtensionNames = deviceExtentions,
+		.enabledExtensionCount = enabledDeviceExtentionCount,
+		.ppEnabledExtensionNames = enabledDeviceExtentions,
         .pEnabledFeatures = NULL,
     };
 
@@ -127,24 +131,37 @@ void InitVulkan(PisEngine* pis)
 
     vkGetDeviceQueue(pis->vk.device, pis->vk.indices.computeFamilyIndex, 0, &pis->vk.computeQueue);
 
-    CreateSwapchain(pis, pis->windowExtent.width, pis->windowExtent.height);
+    // Every buffer and image from here on is sub-allocated from the allocator's blocks
+    CreateAllocator(pis->vk.device, pis->vk.physicalDevice, &pis->vk.allocator);
+
+    if(!pis->headless)
+    {
+        CreateSwapchain(pis, pis->windowExtent.width, pis->windowExtent.height);
+        return;
+    }
+
+    // Without a swapchain there is one frame in flight, its readback buffer is read before the
+    // next frame is recorded
+    pis->vk.swapchainImageCount = 1;
+    pis->vk.swapchainExtent = pis->windowExtent;
 }
 
 
-const char** GetExtentionNames(uint32_t* extentionCount)
+const char** GetExtentionNames(bool withSdl, uint32_t* extentionCount)
 {
-    //Asks the sdl api for all the instance extentions sdl needs
+    //Asks the sdl api for all the instance extentions sdl needs, headless needs no surface
     uint32_t sdlExtensionCount = 0;
-    SDL_Vulkan_GetInstanceExtensions(&sdlExtensionCount);
+    char const* const* sdlExtensions = NULL;
+    if(withSdl)
+        sdlExtensions = SDL_Vulkan_GetInstanceExtensions(&sdlExtensionCount);
     *extentionCount = sdlExtensionCount + instanceExtentionCount;
 
-    char const* const* sdlExtensions = SDL_Vulkan_GetInstanceExtensions(NULL);
-
-    const char** extentions = malloc(*extentionCount * sizeof(const char*));
+    const char** extentions = malloc((*extentionCount + 1) * sizeof(const char*));
 
     //Add sdl extentions to the extentions array
     //Keep room for the additonal extentions of needed at the start of the array
-    memcpy(&extentions[instanceExtentionCount], sdlExtensions, (*extentionCount - instanceExtentionCount) * sizeof(const char*));
+    if(sdlExtensionCount > 0)
+        memcpy(&extentions[instanceExtentionCount], sdlExtensions, sdlExtensionCount * sizeof(const char*));
 
     //If we ask for no additional extentions, return the sdl extentions
     if(instanceExtentionCount == 0)
@@ -216,6 +233,35 @@ QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice pDevice)
     return indices;
 }
 
+// Headless needs no swapchain, and portability subset only exists on portability drivers like
+// MoltenVK, where it has to be enabled
+uint32_t GetDeviceExtentionNames(PisEngine* pis, const char** names)
+{
+	uint32_t availableExtentionCount = 0;
+	vkEnumerateDeviceExtensionProperties(pis->vk.physicalDevice, NULL, &availableExtentionCount, NULL);
+
+	VkExtensionProperties availableExtentions[availableExtentionCount + 1];
+	vkEnumerateDeviceExtensionProperties(pis->vk.physicalDevice, NULL, &availableExtentionCount, availableExtentions);
+
+    uint32_t count = 0;
+	for(uint32_t i = 0; i < deviceExtentionCount; i++)
+	{
+        if(pis->headless && strcmp(deviceExtentions[i], VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0)
+            continue;
+
+        bool available = false;
+		for(uint32_t j = 0; j < availableExtentionCount; j++)
+            available |= strcmp(deviceExtentions[i], availableExtentions[j].extensionName) == 0;
+
+        if(!available && strcmp(deviceExtentions[i], VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME) == 0)
+            continue;
+
+        names[count++] = deviceExtentions[i];
+	}
+
+    return count;
+}
+
 bool CheckDeviceExtentionSupport(VkPhysicalDevice device)
 {
 	//Easy check for device extentions
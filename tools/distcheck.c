@@ -0,0 +1,206 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pis/pisDistance.h"
+#include "pis/pisTime.h"
+#include "pis/pisVoxReader.h"
+#include "pis/voxReader.h"
+
+// Edges of the edited boxes go up to this many voxels
+#define MAX_EDIT_SIZE 32
+
+typedef enum EditKind {
+    // Clears every voxel of the box
+    EDIT_CARVE,
+    // Fills every voxel of the box
+    EDIT_FILL,
+    // Flips single voxels of the box, so the edit has holes
+    EDIT_SCATTER,
+    EDIT_KIND_COUNT,
+} EditKind;
+
+/* =================================Helper functions================================ */
+void PrintUsage(void);
+void RandomEdit(Size size, Size* editMin, Size* editMax);
+void ApplyEdit(PisVox* pisV, EditKind kind, Size editMin, Size editMax);
+bool FindMismatch(PisDistanceField* a, PisDistanceField* b, Size* voxel);
+/* ================================================================================ */
+
+int main(int argc, char** argv)
+{
+    uint32_t editCount = 64;
+    unsigned int seed = 1;
+
+    int arg = 1;
+    for(; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        if(strcmp(argv[arg], "-n") == 0 && arg + 1 < argc)
+        {
+            int edits = atoi(argv[++arg]);
+            editCount = edits > 0 ? (uint32_t)edits : 1;
+        }
+        else if(strcmp(argv[arg], "-s") == 0 && arg + 1 < argc)
+        {
+            seed = (unsigned int)atoi(argv[++arg]);
+        }
+        else
+        {
+            PrintUsage();
+            return -1;
+        }
+    }
+
+    if(arg + 1 != argc)
+    {
+        PrintUsage();
+        return -1;
+    }
+
+    PisVox pisV;
+    const char* extension = strrchr(argv[arg], '.');
+    if(extension != NULL && strcmp(extension, ".vox") == 0)
+    {
+        PisVoxScene scene;
+        if(PisVoxSceneLoadVoxFile(argv[arg], &scene) != 0)
+            return -1;
+
+        int result = PisVoxSceneFlatten(&scene, &pisV);
+        DestroyPisVoxScene(scene);
+
+        if(result != 0)
+            return -1;
+    }
+    else
+    {
+        pisV = PisVoxReadFromFile(argv[arg]);
+    }
+
+    if(pisV.voxels == NULL)
+        return -1;
+
+    PisDistanceField field;
+    if(PisDistanceFieldBuild(&pisV, &field) != 0)
+        return -1;
+
+    srand(seed);
+
+    const char* kindNames[EDIT_KIND_COUNT] = { "carve", "fill", "scatter" };
+    double updateSeconds = 0.0;
+    double buildSeconds = 0.0;
+    uint32_t failed = 0;
+
+    for(uint32_t i = 0; i < editCount; i++)
+    {
+        EditKind kind = (EditKind)(i % EDIT_KIND_COUNT);
+
+        Size editMin, editMax;
+        RandomEdit(pisV.size, &editMin, &editMax);
+        ApplyEdit(&pisV, kind, editMin, editMax);
+
+        double begin = PisTimeSeconds();
+        Size updatedMin, updatedMax;
+        if(PisDistanceFieldUpdate(&pisV, &field, editMin, editMax, &updatedMin, &updatedMax) != 0)
+            return -1;
+        updateSeconds += PisTimeSeconds() - begin;
+
+        // The reference is always built from scratch, the incremental field carries every earlier edit
+        begin = PisTimeSeconds();
+        PisDistanceField reference;
+        if(PisDistanceFieldBuild(&pisV, &reference) != 0)
+            return -1;
+        buildSeconds += PisTimeSeconds() - begin;
+
+        Size voxel;
+        if(FindMismatch(&field, &reference, &voxel))
+        {
+            size_t index = voxel.x + (size_t)voxel.y * pisV.size.x + (size_t)voxel.z * pisV.size.x * pisV.size.y;
+            fprintf(stderr, "Edit %u (%s %u,%u,%u to %u,%u,%u): distance at %u,%u,%u is %u instead of %u\n",
+                    i, kindNames[kind], editMin.x, editMin.y, editMin.z, editMax.x, editMax.y, editMax.z,
+                    voxel.x, voxel.y, voxel.z, field.distance[index], reference.distance[index]);
+            failed++;
+
+            // Keep checking the next edits against the right field
+            memcpy(field.distance, reference.distance, (size_t)pisV.size.x * pisV.size.y * pisV.size.z);
+        }
+
+        DestroyPisDistanceField(reference);
+    }
+
+    printf("%ux%ux%u, %u edits: %u match a full build, update %.3f ms, build %.3f ms on average\n",
+           pisV.size.x, pisV.size.y, pisV.size.z, editCount, editCount - failed,
+           updateSeconds * 1000.0 / editCount, buildSeconds * 1000.0 / editCount);
+
+    DestroyPisDistanceField(field);
+    DestroyPisVox(pisV);
+
+    return failed == 0 ? 0 : -1;
+}
+
+void PrintUsage(void)
+{
+    fprintf(stderr,
+            "Usage: distcheck [-n edits] [-s seed] input\n"
+            "  Edits random boxes of a .vox or .pisv file and checks after every edit that\n"
+            "  PisDistanceFieldUpdate gives the same distances as PisDistanceFieldBuild.\n"
+            "  -n  number of edits, 64 by default\n"
+            "  -s  seed of the edits, 1 by default\n");
+}
+
+void RandomEdit(Size size, Size* editMin, Size* editMax)
+{
+    uint32_t min[3], max[3];
+    uint32_t limits[3] = { size.x, size.y, size.z };
+
+    for(uint32_t axis = 0; axis < 3; axis++)
+    {
+        uint32_t edge = 1 + (uint32_t)rand() % MAX_EDIT_SIZE;
+        edge = edge < limits[axis] ? edge : limits[axis];
+
+        min[axis] = (uint32_t)rand() % (limits[axis] - edge + 1);
+        max[axis] = min[axis] + edge;
+    }
+
+    *editMin = (Size){ min[0], min[1], min[2] };
+    *editMax = (Size){ max[0], max[1], max[2] };
+}
+
+void ApplyEdit(PisVox* pisV, EditKind kind, Size editMin, Size editMax)
+{
+    uint8_t material = (uint8_t)(1 + rand() % 255);
+
+    for(uint32_t z = editMin.z; z < editMax.z; z++)
+    for(uint32_t y = editMin.y; y < editMax.y; y++)
+    for(uint32_t x = editMin.x; x < editMax.x; x++)
+    {
+        uint8_t* voxel = &pisV->voxels[x + (size_t)y * pisV->size.x + (size_t)z * pisV->size.x * pisV->size.y];
+
+        if(kind == EDIT_CARVE)
+            *voxel = 0;
+        else if(kind == EDIT_FILL)
+            *voxel = material;
+        else if(rand() % 4 == 0)
+            *voxel = *voxel != 0 ? 0 : material;
+    }
+}
+
+bool FindMismatch(PisDistanceField* a, PisDistanceField* b, Size* voxel)
+{
+    size_t arraySize = (size_t)a->size.x * a->size.y * a->size.z;
+    if(memcmp(a->distance, b->distance, arraySize) == 0)
+        return false;
+
+    for(size_t i = 0; i < arraySize; i++)
+    {
+        if(a->distance[i] != b->distance[i])
+        {
+            size_t layer = (size_t)a->size.x * a->size.y;
+            *voxel = (Size){ (uint32_t)(i % a->size.x), (uint32_t)(i % layer / a->size.x), (uint32_t)(i / layer) };
+            break;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,336 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pis/pisJobs.h"
+#include "pis/pisTiled.h"
+#include "pis/pisTime.h"
+#include "pis/pisVoxReader.h"
+#include "pis/voxReader.h"
+
+#define RAYS_PER_JOB 1024
+
+typedef enum BenchLayout {
+    BENCH_LINEAR,
+    BENCH_TILED,
+    BENCH_MORTON,
+    BENCH_LAYOUT_COUNT,
+} BenchLayout;
+
+typedef struct BenchRay {
+    float origin[3];
+    float direction[3];
+} BenchRay;
+
+typedef struct BenchVolume {
+    Size size;
+    const uint8_t* voxels[BENCH_LAYOUT_COUNT];
+    Size tileCount;
+} BenchVolume;
+
+typedef struct BenchRun {
+    BenchVolume* volume;
+    BenchLayout layout;
+    BenchRay* rays;
+    uint32_t rayCount;
+    uint64_t* steps;
+    uint64_t* solid;
+} BenchRun;
+
+/* =================================Helper functions================================ */
+void PrintUsage(void);
+uint8_t* BuildMorton(PisVox* pisV);
+uint64_t MortonIndex(uint32_t x, uint32_t y, uint32_t z);
+uint64_t SpreadBits(uint32_t value);
+
+void MakeRays(BenchRay* rays, uint32_t rayCount, Size size, int axis);
+float RandomFloat(void);
+
+void TraceJob(void* userData, uint32_t jobIndex);
+void WalkRay(BenchVolume* volume, BenchLayout layout, const BenchRay* ray, uint64_t* steps, uint64_t* solid);
+/* ================================================================================ */
+
+int main(int argc, char** argv)
+{
+    uint32_t threadCount = PisGetCoreCount();
+    uint32_t rayCount = 1 << 16;
+
+    int arg = 1;
+    for(; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        if(strcmp(argv[arg], "-j") == 0 && arg + 1 < argc)
+        {
+            int threads = atoi(argv[++arg]);
+            threadCount = threads > 0 ? (uint32_t)threads : 1;
+        }
+        else if(strcmp(argv[arg], "-r") == 0 && arg + 1 < argc)
+        {
+            int rays = atoi(argv[++arg]);
+            rayCount = rays > 0 ? (uint32_t)rays : 1;
+        }
+        else
+        {
+            PrintUsage();
+            return -1;
+        }
+    }
+
+    if(arg + 1 != argc)
+    {
+        PrintUsage();
+        return -1;
+    }
+
+    PisVox pisV;
+    const char* extension = strrchr(argv[arg], '.');
+    if(extension != NULL && strcmp(extension, ".vox") == 0)
+    {
+        PisVoxScene scene;
+        if(PisVoxSceneLoadVoxFile(argv[arg], &scene) != 0)
+            return -1;
+
+        int result = PisVoxSceneFlatten(&scene, &pisV);
+        DestroyPisVoxScene(scene);
+
+        if(result != 0)
+            return -1;
+    }
+    else
+    {
+        pisV = PisVoxReadFromFile(argv[arg]);
+    }
+
+    if(pisV.voxels == NULL)
+        return -1;
+
+    PisTiled tiled;
+    if(PisTiledBuild(&pisV, &tiled) != 0)
+        return -1;
+
+    uint8_t* morton = BuildMorton(&pisV);
+    if(morton == NULL)
+        return -1;
+
+    BenchVolume volume = {
+        .size = pisV.size,
+        .voxels = { pisV.voxels, tiled.voxels, morton },
+        .tileCount = tiled.tileCount,
+    };
+
+    BenchRay* rays = malloc(sizeof(BenchRay) * rayCount);
+    uint32_t jobCount = (rayCount + RAYS_PER_JOB - 1) / RAYS_PER_JOB;
+    uint64_t* steps = malloc(sizeof(uint64_t) * jobCount);
+    uint64_t* solid = malloc(sizeof(uint64_t) * jobCount);
+
+    if(rays == NULL || steps == NULL || solid == NULL)
+    {
+        fprintf(stderr, "Failed to allocate %u rays\n", rayCount);
+        return -1;
+    }
+
+    const char* layoutNames[BENCH_LAYOUT_COUNT] = { "linear", "tiled 4^3", "morton" };
+    const char* axisNames[4] = { "+x", "+y", "+z", "random" };
+
+    printf("%ux%ux%u, %u rays per direction on %u threads, million voxel steps per second\n",
+           pisV.size.x, pisV.size.y, pisV.size.z, rayCount, threadCount);
+    printf("%-8s", "");
+    for(uint32_t layout = 0; layout < BENCH_LAYOUT_COUNT; layout++)
+        printf(" %10s", layoutNames[layout]);
+    printf("\n");
+
+    srand(1);
+
+    for(int axis = 0; axis < 4; axis++)
+    {
+        MakeRays(rays, rayCount, pisV.size, axis);
+        printf("%-8s", axisNames[axis]);
+
+        uint64_t expectedSolid = 0;
+        for(uint32_t layout = 0; layout < BENCH_LAYOUT_COUNT; layout++)
+        {
+            BenchRun run = {
+                .volume = &volume,
+                .layout = (BenchLayout)layout,
+                .rays = rays,
+                .rayCount = rayCount,
+                .steps = steps,
+                .solid = solid,
+            };
+
+            double begin = PisTimeSeconds();
+            PisJobsRun(TraceJob, &run, jobCount, threadCount);
+            double seconds = PisTimeSeconds() - begin;
+
+            uint64_t totalSteps = 0, totalSolid = 0;
+            for(uint32_t i = 0; i < jobCount; i++)
+            {
+                totalSteps += steps[i];
+                totalSolid += solid[i];
+            }
+
+            // Every layout walks the same voxels, so they have to agree on what they saw
+            if(layout == 0)
+                expectedSolid = totalSolid;
+            else if(totalSolid != expectedSolid)
+                fprintf(stderr, "\n%s read %llu solid voxels instead of %llu\n", layoutNames[layout],
+                        (unsigned long long)totalSolid, (unsigned long long)expectedSolid);
+
+            printf(" %10.1f", seconds > 0.0 ? totalSteps / seconds / 1e6 : 0.0);
+            fflush(stdout);
+        }
+
+        printf("\n");
+    }
+
+    free(rays);
+    free(steps);
+    free(solid);
+    free(morton);
+    DestroyPisTiled(tiled);
+    DestroyPisVox(pisV);
+
+    return 0;
+}
+
+void PrintUsage(void)
+{
+    fprintf(stderr,
+            "Usage: layoutbench [-j threads] [-r rays] input\n"
+            "  Walks rays through the voxels of a .vox or .pisv file stored linear, in 4^3 tiles and\n"
+            "  in Morton order, for rays along every axis and in random directions. Rays start in a\n"
+            "  random order and do not stop at solid voxels, so only the memory layout differs.\n"
+            "  -j  number of threads, the core count by default\n"
+            "  -r  number of rays per direction, 65536 by default\n");
+}
+
+// Morton order needs a power of two cube, the volume is padded up to one
+uint8_t* BuildMorton(PisVox* pisV)
+{
+    uint32_t largest = pisV->size.x > pisV->size.y ? pisV->size.x : pisV->size.y;
+    largest = largest > pisV->size.z ? largest : pisV->size.z;
+
+    uint32_t side = 1;
+    while(side < largest)
+        side *= 2;
+
+    size_t byteCount = (size_t)side * side * side;
+    uint8_t* morton = calloc(byteCount, 1);
+    if(morton == NULL)
+    {
+        fprintf(stderr, "Failed to allocate %zu bytes for Morton order\n", byteCount);
+        return NULL;
+    }
+
+    for(uint32_t z = 0; z < pisV->size.z; z++)
+        for(uint32_t y = 0; y < pisV->size.y; y++)
+            for(uint32_t x = 0; x < pisV->size.x; x++)
+                morton[MortonIndex(x, y, z)] = pisV->voxels[((size_t)z * pisV->size.y + y) * pisV->size.x + x];
+
+    printf("Morton order pads %ux%ux%u to %u^3, %.2f MB instead of %.2f MB\n", pisV->size.x, pisV->size.y, pisV->size.z,
+           side, byteCount / (1024.0 * 1024.0), (double)pisV->size.x * pisV->size.y * pisV->size.z / (1024.0 * 1024.0));
+
+    return morton;
+}
+
+uint64_t MortonIndex(uint32_t x, uint32_t y, uint32_t z)
+{
+    return SpreadBits(x) | (SpreadBits(y) << 1) | (SpreadBits(z) << 2);
+}
+
+// Puts two zero bits between every bit of the lowest 21
+uint64_t SpreadBits(uint32_t value)
+{
+    uint64_t v = value & 0x1FFFFF;
+    v = (v | v << 32) & 0x1F00000000FFFFull;
+    v = (v | v << 16) & 0x1F0000FF0000FFull;
+    v = (v | v << 8) & 0x100F00F00F00F00Full;
+    v = (v | v << 4) & 0x10C30C30C30C30C3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+
+// Axis rays start on the low face and lean a little, so they still cross the other axes
+void MakeRays(BenchRay* rays, uint32_t rayCount, Size size, int axis)
+{
+    float extent[3] = { (float)size.x, (float)size.y, (float)size.z };
+
+    for(uint32_t i = 0; i < rayCount; i++)
+    {
+        BenchRay* ray = &rays[i];
+
+        for(int a = 0; a < 3; a++)
+        {
+            ray->origin[a] = RandomFloat() * extent[a];
+            ray->direction[a] = axis < 3 ? (RandomFloat() - 0.5f) * 0.2f : RandomFloat() * 2.0f - 1.0f;
+        }
+
+        if(axis < 3)
+        {
+            ray->origin[axis] = 0.0f;
+            ray->direction[axis] = 1.0f;
+        }
+
+        float length = sqrtf(ray->direction[0] * ray->direction[0] + ray->direction[1] * ray->direction[1] + ray->direction[2] * ray->direction[2]);
+        for(int a = 0; a < 3; a++)
+            ray->direction[a] /= length;
+    }
+}
+
+float RandomFloat(void)
+{
+    return (float)rand() / ((float)RAND_MAX + 1.0f);
+}
+
+void TraceJob(void* userData, uint32_t jobIndex)
+{
+    BenchRun* run = userData;
+
+    uint32_t first = jobIndex * RAYS_PER_JOB;
+    uint32_t last = first + RAYS_PER_JOB < run->rayCount ? first + RAYS_PER_JOB : run->rayCount;
+
+    uint64_t steps = 0, solid = 0;
+    for(uint32_t i = first; i < last; i++)
+        WalkRay(run->volume, run->layout, &run->rays[i], &steps, &solid);
+
+    run->steps[jobIndex] = steps;
+    run->solid[jobIndex] = solid;
+}
+
+// The same DDA as voxel.comp, walked until the ray leaves the volume
+void WalkRay(BenchVolume* volume, BenchLayout layout, const BenchRay* ray, uint64_t* steps, uint64_t* solid)
+{
+    int32_t size[3] = { (int32_t)volume->size.x, (int32_t)volume->size.y, (int32_t)volume->size.z };
+    int32_t voxel[3], step[3];
+    float tDelta[3], sideDist[3];
+
+    for(int a = 0; a < 3; a++)
+    {
+        voxel[a] = (int32_t)floorf(ray->origin[a]);
+        step[a] = ray->direction[a] > 0.0f ? 1 : (ray->direction[a] < 0.0f ? -1 : 0);
+        tDelta[a] = ray->direction[a] != 0.0f ? fabsf(1.0f / ray->direction[a]) : 1e30f;
+        sideDist[a] = (step[a] * (voxel[a] - ray->origin[a]) + step[a] * 0.5f + 0.5f) * tDelta[a];
+    }
+
+    const uint8_t* voxels = volume->voxels[layout];
+
+    while(voxel[0] >= 0 && voxel[0] < size[0] && voxel[1] >= 0 && voxel[1] < size[1] && voxel[2] >= 0 && voxel[2] < size[2])
+    {
+        size_t index;
+        if(layout == BENCH_TILED)
+            index = PisTiledIndex(volume->tileCount, (uint32_t)voxel[0], (uint32_t)voxel[1], (uint32_t)voxel[2]);
+        else if(layout == BENCH_MORTON)
+            index = (size_t)MortonIndex((uint32_t)voxel[0], (uint32_t)voxel[1], (uint32_t)voxel[2]);
+        else
+            index = (size_t)voxel[0] + (size_t)voxel[1] * size[0] + (size_t)voxel[2] * size[0] * size[1];
+
+        *solid += voxels[index] != 0;
+        (*steps)++;
+
+        int a = sideDist[0] <= sideDist[1] ? (sideDist[0] <= sideDist[2] ? 0 : 2) : (sideDist[1] <= sideDist[2] ? 1 : 2);
+        sideDist[a] += tDelta[a];
+        voxel[a] += step[a];
+    }
+}
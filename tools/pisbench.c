@@ -0,0 +1,342 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pis/engine.h"
+#include "pis/pisCameraPath.h"
+#include "pis/pisTime.h"
+
+// Keys of the default path around the world
+#define ORBIT_KEYS 9
+
+typedef struct FrameStats {
+    double mean;
+    double p50;
+    double p99;
+} FrameStats;
+
+/* =================================Helper functions================================ */
+void PrintUsage(void);
+int ParseLayout(const char* text, PisVoxelLayout* layout);
+const char* LayoutName(PisVoxelLayout layout);
+FrameStats ComputeStats(double* times, uint32_t count);
+int CompareDoubles(const void* a, const void* b);
+void WriteStats(FILE* file, const char* name, FrameStats stats);
+/* ================================================================================ */
+
+int main(int argc, char** argv)
+{
+    uint32_t frameCount = 240, warmupCount = 10;
+    uint32_t width = 1280, height = 720;
+    const char* cameraFile = NULL;
+    const char* output = NULL;
+    const char* lastFrame = NULL;
+    PisVoxelLayout layout = PIS_VOXEL_LAYOUT_DENSE;
+    bool countRays = false;
+
+    int arg = 1;
+    for(; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        if(strcmp(argv[arg], "-n") == 0 && arg + 1 < argc)
+        {
+            int frames = atoi(argv[++arg]);
+            frameCount = frames > 0 ? (uint32_t)frames : 1;
+        }
+        else if(strcmp(argv[arg], "-w") == 0 && arg + 1 < argc)
+        {
+            int frames = atoi(argv[++arg]);
+            warmupCount = frames > 0 ? (uint32_t)frames : 0;
+        }
+        else if(strcmp(argv[arg], "-s") == 0 && arg + 1 < argc)
+        {
+            // The dispatch covers whole 16x16 groups
+            char tail;
+            if(sscanf(argv[++arg], "%ux%u%c", &width, &height, &tail) != 2 || width < 16 || height < 16)
+            {
+                fprintf(stderr, "Size has to look like 1280x720: %s\n", argv[arg]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[arg], "-c") == 0 && arg + 1 < argc)
+        {
+            cameraFile = argv[++arg];
+        }
+        else if(strcmp(argv[arg], "-l") == 0 && arg + 1 < argc)
+        {
+            if(ParseLayout(argv[++arg], &layout) != 0)
+                return -1;
+        }
+        else if(strcmp(argv[arg], "-o") == 0 && arg + 1 < argc)
+        {
+            output = argv[++arg];
+        }
+        else if(strcmp(argv[arg], "-p") == 0 && arg + 1 < argc)
+        {
+            lastFrame = argv[++arg];
+        }
+        else if(strcmp(argv[arg], "-r") == 0)
+        {
+            countRays = true;
+        }
+        else
+        {
+            PrintUsage();
+            return -1;
+        }
+    }
+
+    if(arg + 1 != argc)
+    {
+        PrintUsage();
+        return -1;
+    }
+
+    PisEngine* pis = calloc(1, sizeof(PisEngine));
+    if(pis == NULL)
+    {
+        fprintf(stderr, "Failed to allocate\n");
+        return -1;
+    }
+
+    if(strlen(argv[arg]) >= sizeof(pis->voxelFile))
+    {
+        fprintf(stderr, "Path is too long: %s\n", argv[arg]);
+        free(pis);
+        return -1;
+    }
+
+    // Headless, so neither present nor vsync nor a compositor end up in the frame times
+    strcpy(pis->voxelFile, argv[arg]);
+    pis->windowExtent.width = width;
+    pis->windowExtent.height = height;
+    pis->voxelLayout = layout;
+    pis->headless = true;
+    pis->debugView = countRays ? PIS_DEBUG_VIEW_STATS : PIS_DEBUG_VIEW_OFF;
+
+    PisEngineInitialize(pis);
+
+    // Every failure from here on goes through cleanup, which also tears the engine down
+    int result = -1;
+    double* frameTimes = NULL;
+    double* gpuTimes = NULL;
+    FILE* file = stdout;
+
+    PisCameraPath path = {0};
+    if(cameraFile != NULL)
+    {
+        PisCameraPath loaded;
+        if(PisCameraPathLoad(cameraFile, &loaded) != 0)
+            goto cleanup;
+        path = loaded;
+    }
+    else
+    {
+        path = PisCameraPathOrbit(pis->voxelData.size, ORBIT_KEYS);
+    }
+
+    frameTimes = malloc(frameCount * sizeof(double));
+    gpuTimes = malloc(frameCount * sizeof(double));
+    if(frameTimes == NULL || gpuTimes == NULL || path.keys == NULL)
+    {
+        fprintf(stderr, "Failed to allocate\n");
+        goto cleanup;
+    }
+
+    // Timestamps measure the GPU itself, without them submit to fence is the closest there is
+    PisGpuTimings* timings = &pis->vk.gpuTimings;
+    double passSums[PIS_GPU_PASS_COUNT] = {0};
+    // Frames whose timestamps were not ready yet add nothing to passSums
+    uint32_t timedFrameCount = 0;
+    // The counts of every measured frame, 64 bits since they add up over the whole run
+    uint64_t primaryRays = 0, primarySteps = 0, cappedRays = 0, skyExits = 0, shadowRays = 0, shadowSteps = 0;
+
+    // Warmup frames replay the start of the path, they fill caches and let the clocks ramp up
+    UniformBufferObject ubo = {0};
+    for(uint32_t i = 0; i < warmupCount + frameCount; i++)
+    {
+        uint32_t frame = i < warmupCount ? 0 : i - warmupCount;
+
+        PisCameraPathSample(&path, frameCount > 1 ? (float)frame / (frameCount - 1) : 0.f, &ubo);
+        // Time as if the path ran at 60 fps, every run sees the same frames
+        ubo.time = frame / 60.f;
+        UpdateUniformBuffer(pis, ubo);
+
+        // Every frame is waited for, so one frame's time never hides in the next
+        uint64_t timedFrames = timings->frameCount;
+        double begin = PisTimeSeconds();
+        PisEngineDraw(pis);
+        double submitted = PisTimeSeconds();
+        PisEngineWaitFrame(pis);
+        double end = PisTimeSeconds();
+
+        if(i < warmupCount)
+            continue;
+
+        frameTimes[frame] = (end - begin) * 1000.0;
+        gpuTimes[frame] = (end - submitted) * 1000.0;
+
+        // PisEngineWaitFrame has just added this frame's timestamps, unless they were not ready
+        if(timings->frameCount > timedFrames)
+        {
+            uint32_t slot = (timings->frameCount - 1) % PIS_GPU_TIMING_WINDOW;
+            gpuTimes[frame] = timings->frameMs[slot];
+            for(uint32_t pass = 0; pass < PIS_GPU_PASS_COUNT; pass++)
+                passSums[pass] += timings->passMs[slot][pass];
+            timedFrameCount++;
+        }
+
+        if(countRays)
+        {
+            primaryRays += pis->rayStats.primaryRays;
+            primarySteps += pis->rayStats.primarySteps;
+            cappedRays += pis->rayStats.cappedRays;
+            skyExits += pis->rayStats.skyExits;
+            shadowRays += pis->rayStats.shadowRays;
+            shadowSteps += pis->rayStats.shadowSteps;
+        }
+    }
+
+    if(lastFrame != NULL && PisEngineSaveFrame(pis, lastFrame) != 0)
+        goto cleanup;
+
+    double gpuSeconds = 0.0;
+    for(uint32_t i = 0; i < frameCount; i++)
+        gpuSeconds += gpuTimes[i] / 1000.0;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(pis->vk.physicalDevice, &properties);
+
+    if(output != NULL && (file = fopen(output, "w")) == NULL)
+    {
+        fprintf(stderr, "Failed to open %s\n", output);
+        file = stdout;
+        goto cleanup;
+    }
+
+    // The layout is the one the engine ended up with, big worlds always become a brickmap
+    fprintf(file, "{\n");
+    fprintf(file, "  \"scene\": \"%s\",\n", pis->voxelFile);
+    fprintf(file, "  \"device\": \"%s\",\n", properties.deviceName);
+    fprintf(file, "  \"layout\": \"%s\",\n", LayoutName(pis->voxelLayout));
+    fprintf(file, "  \"width\": %u,\n", width);
+    fprintf(file, "  \"height\": %u,\n", height);
+    fprintf(file, "  \"frames\": %u,\n", frameCount);
+    fprintf(file, "  \"cameraKeys\": %u,\n", path.keyCount);
+    WriteStats(file, "frameMs", ComputeStats(frameTimes, frameCount));
+    fprintf(file, ",\n");
+    WriteStats(file, "gpuMs", ComputeStats(gpuTimes, frameCount));
+    fprintf(file, ",\n");
+    fprintf(file, "  \"gpuClock\": \"%s\",\n", timings->enabled ? "timestamps" : "fence");
+    if(timings->enabled)
+    {
+        fprintf(file, "  \"passMeanMs\": {");
+        for(uint32_t pass = 0; pass < PIS_GPU_PASS_COUNT; pass++)
+            fprintf(file, "%s \"%s\": %.4f", pass > 0 ? "," : "", PisGpuPassName((PisGpuPass)pass),
+                    timedFrameCount > 0 ? passSums[pass] / timedFrameCount : 0.0);
+        fprintf(file, " },\n");
+    }
+    if(countRays)
+    {
+        fprintf(file, "  \"rays\": { \"meanSteps\": %.2f, \"capped\": %.6f, \"skyExits\": %.6f, \"shadowMeanSteps\": %.2f },\n",
+                primaryRays > 0 ? (double)primarySteps / primaryRays : 0.0,
+                primaryRays > 0 ? (double)cappedRays / primaryRays : 0.0,
+                primaryRays > 0 ? (double)skyExits / primaryRays : 0.0,
+                shadowRays > 0 ? (double)shadowSteps / shadowRays : 0.0);
+    }
+    fprintf(file, "  \"primaryRaysPerSecond\": %.0f\n",
+            gpuSeconds > 0.0 ? (double)width * height * frameCount / gpuSeconds : 0.0);
+    fprintf(file, "}\n");
+
+    result = 0;
+
+cleanup:
+    if(file != stdout)
+        fclose(file);
+
+    free(frameTimes);
+    free(gpuTimes);
+    DestroyPisCameraPath(path);
+
+    PisEngineCleanup(pis);
+    free(pis);
+
+    return result;
+}
+
+void PrintUsage(void)
+{
+    fprintf(stderr,
+            "Usage: pisbench [-n frames] [-w frames] [-s WxH] [-c camera.path] [-l layout] [-o file] [-p file] [-r] input\n"
+            "  Renders a .vox or .pisv file headless along a camera path and reports frame times as JSON\n"
+            "  -n  frames to measure, 240 by default\n"
+            "  -w  warmup frames that are not measured, 10 by default\n"
+            "  -s  frame size, 1280x720 by default\n"
+            "  -c  camera path recorded with P in the viewer, a circle around the world by default\n"
+            "  -l  dense, brickmap, svo, dag, distance, tiled or image, dense by default\n"
+            "  -o  JSON output file, stdout by default\n"
+            "  -p  save the last frame as a PNG\n"
+            "  -r  count traversal steps, capped rays and sky exits, which costs some frame time\n"
+            "  frameMs is PisEngineDraw until the frame's fence signals, gpuMs comes from timestamps around\n"
+            "  the passes, or is submit until the fence when the queue has no timestamps\n");
+}
+
+int ParseLayout(const char* text, PisVoxelLayout* layout)
+{
+    for(uint32_t i = PIS_VOXEL_LAYOUT_DENSE; i <= PIS_VOXEL_LAYOUT_IMAGE; i++)
+    {
+        if(strcmp(text, LayoutName((PisVoxelLayout)i)) == 0)
+        {
+            *layout = (PisVoxelLayout)i;
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "Unknown layout: %s\n", text);
+    return -1;
+}
+
+const char* LayoutName(PisVoxelLayout layout)
+{
+    switch(layout)
+    {
+        case PIS_VOXEL_LAYOUT_DENSE:    return "dense";
+        case PIS_VOXEL_LAYOUT_BRICKMAP: return "brickmap";
+        case PIS_VOXEL_LAYOUT_SVO:      return "svo";
+        case PIS_VOXEL_LAYOUT_DAG:      return "dag";
+        case PIS_VOXEL_LAYOUT_DISTANCE: return "distance";
+        case PIS_VOXEL_LAYOUT_TILED:    return "tiled";
+        case PIS_VOXEL_LAYOUT_IMAGE:    return "image";
+    }
+
+    return "unknown";
+}
+
+FrameStats ComputeStats(double* times, uint32_t count)
+{
+    FrameStats stats = {0};
+
+    double sum = 0.0;
+    for(uint32_t i = 0; i < count; i++)
+        sum += times[i];
+    stats.mean = sum / count;
+
+    // Nearest rank, the p99 of fewer than 100 frames is the slowest frame
+    qsort(times, count, sizeof(double), CompareDoubles);
+    stats.p50 = times[(uint32_t)ceil(0.50 * count) - 1];
+    stats.p99 = times[(uint32_t)ceil(0.99 * count) - 1];
+
+    return stats;
+}
+
+int CompareDoubles(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+void WriteStats(FILE* file, const char* name, FrameStats stats)
+{
+    fprintf(file, "  \"%s\": { \"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f }", name, stats.mean, stats.p50, stats.p99);
+}
@@ -0,0 +1,475 @@
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pis/pisJobs.h"
+#include "pis/pisTime.h"
+#include "pis/pisVoxFormat.h"
+#include "pis/pisVoxReader.h"
+#include "pis/pisVoxWriter.h"
+#include "pis/voxReader.h"
+
+// Run lengths are bucketed by power of two, a run is at most PISV_MAX_RUN long
+#define RUN_BUCKETS 16
+
+typedef struct ConvOptions {
+    uint32_t version;
+    uint32_t threadCount;
+    // Threads each file is decoded on, 1 when several files are converted at the same time
+    uint32_t decodeThreadCount;
+    char* outputDir;
+    Size rawSize;
+    bool hasRawSize;
+    bool verify;
+} ConvOptions;
+
+typedef struct ConvFile {
+    char* input;
+    char output[PATH_MAX];
+    int result;
+
+    Size size;
+    uint64_t solidCount;
+    uint64_t fileSize;
+
+    double loadTime;
+    double encodeTime;
+    double decodeTime;
+    bool matches;
+
+    uint64_t runCount;
+    uint64_t runs[RUN_BUCKETS];
+    uint64_t runVoxels[RUN_BUCKETS];
+
+    uint32_t brickCounts[3];
+} ConvFile;
+
+typedef struct ConvBatch {
+    ConvOptions* options;
+    ConvFile* files;
+} ConvBatch;
+
+/* =================================Helper functions================================ */
+void PrintUsage(void);
+int ParseSize(const char* text, Size* size);
+
+void ConvertJob(void* userData, uint32_t jobIndex);
+int LoadInput(ConvFile* file, ConvOptions* options, PisVox* pisV);
+int LoadRaw(ConvFile* file, ConvOptions* options, PisVox* pisV);
+void MakeOutputName(ConvFile* file, ConvOptions* options);
+void CountRuns(ConvFile* file, PisVox* pisV);
+int CountBricks(ConvFile* file);
+
+void PrintReport(ConvFile* file);
+double MegabytesPerSecond(uint64_t bytes, double seconds);
+/* ================================================================================ */
+
+int main(int argc, char** argv)
+{
+    ConvOptions options = {
+        .version = 2,
+        .threadCount = PisGetCoreCount(),
+        .outputDir = NULL,
+        .hasRawSize = false,
+        .verify = true,
+    };
+
+    int arg = 1;
+    for(; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        if(strcmp(argv[arg], "-v") == 0 && arg + 1 < argc)
+        {
+            options.version = (uint32_t)atoi(argv[++arg]);
+        }
+        else if(strcmp(argv[arg], "-j") == 0 && arg + 1 < argc)
+        {
+            int threads = atoi(argv[++arg]);
+            options.threadCount = threads > 0 ? (uint32_t)threads : 1;
+        }
+        else if(strcmp(argv[arg], "-o") == 0 && arg + 1 < argc)
+        {
+            options.outputDir = argv[++arg];
+        }
+        else if(strcmp(argv[arg], "-s") == 0 && arg + 1 < argc)
+        {
+            if(ParseSize(argv[++arg], &options.rawSize) != 0)
+            {
+                fprintf(stderr, "Raw size has to look like 256x256x256: %s\n", argv[arg]);
+                return -1;
+            }
+
+            options.hasRawSize = true;
+        }
+        else if(strcmp(argv[arg], "-n") == 0)
+        {
+            options.verify = false;
+        }
+        else
+        {
+            PrintUsage();
+            return -1;
+        }
+    }
+
+    if(arg == argc || (options.version != 1 && options.version != 2))
+    {
+        PrintUsage();
+        return -1;
+    }
+
+    uint32_t fileCount = (uint32_t)(argc - arg);
+    ConvFile* files = calloc(fileCount, sizeof(ConvFile));
+    if(files == NULL)
+    {
+        fprintf(stderr, "Failed to allocate\n");
+        return -1;
+    }
+
+    for(uint32_t i = 0; i < fileCount; i++)
+        files[i].input = argv[arg + i];
+
+    // A pool per file inside the pool of files would run cores times cores threads
+    options.decodeThreadCount = options.threadCount > 1 && fileCount > 1 ? 1 : PisGetCoreCount();
+
+    ConvBatch batch = {
+        .options = &options,
+        .files = files,
+    };
+
+    // Files are converted in parallel, the reports are printed in order once all are done
+    double begin = PisTimeSeconds();
+    PisJobsRun(ConvertJob, &batch, fileCount, options.threadCount);
+    double seconds = PisTimeSeconds() - begin;
+
+    uint64_t totalDense = 0;
+    uint64_t totalFile = 0;
+    uint32_t failed = 0;
+
+    printf("\n");
+    for(uint32_t i = 0; i < fileCount; i++)
+    {
+        PrintReport(&files[i]);
+
+        if(files[i].result != 0)
+        {
+            failed++;
+            continue;
+        }
+
+        totalDense += (uint64_t)files[i].size.x * files[i].size.y * files[i].size.z;
+        totalFile += files[i].fileSize;
+    }
+
+    printf("Converted %u of %u files to PISV 00%u on %u threads in %.2f s\n",
+           fileCount - failed, fileCount, options.version, options.threadCount, seconds);
+    printf("  %llu B -> %llu B, ratio %.2f:1, %.1f MB/s overall\n",
+           (unsigned long long)totalDense, (unsigned long long)totalFile,
+           totalFile ? (double)totalDense / (double)totalFile : 0.0, MegabytesPerSecond(totalDense, seconds));
+
+    if(failed != 0)
+    {
+        printf("Failed:\n");
+        for(uint32_t i = 0; i < fileCount; i++)
+        {
+            if(files[i].result != 0)
+                printf("  %s\n", files[i].input);
+        }
+    }
+
+    free(files);
+
+    return failed == 0 ? 0 : -1;
+}
+
+void PrintUsage(void)
+{
+    fprintf(stderr,
+            "Usage: pisconv [-v 1|2] [-j threads] [-o dir] [-s XxYxZ] [-n] input...\n"
+            "  Converts .vox, .pisv and raw voxel arrays into .pisv files\n"
+            "  -v  pisv version to write, 2 (bricked) by default\n"
+            "  -j  number of files converted at the same time, the core count by default\n"
+            "  -o  directory to write to, next to the input by default\n"
+            "  -s  size of raw inputs: one byte per voxel, x fastest, then y, then z\n"
+            "  -n  do not read the output back to check it and measure decoding\n");
+}
+
+int ParseSize(const char* text, Size* size)
+{
+    char tail;
+    if(sscanf(text, "%ux%ux%u%c", &size->x, &size->y, &size->z, &tail) != 3)
+        return -1;
+
+    return (size->x == 0 || size->y == 0 || size->z == 0) ? -1 : 0;
+}
+
+void ConvertJob(void* userData, uint32_t jobIndex)
+{
+    ConvBatch* batch = userData;
+    ConvOptions* options = batch->options;
+    ConvFile* file = &batch->files[jobIndex];
+
+    file->result = -1;
+
+    PisVox pisV = {0};
+
+    double begin = PisTimeSeconds();
+    if(LoadInput(file, options, &pisV) != 0)
+        return;
+    file->loadTime = PisTimeSeconds() - begin;
+
+    file->size = pisV.size;
+    CountRuns(file, &pisV);
+    MakeOutputName(file, options);
+
+    begin = PisTimeSeconds();
+    if(PisVoxWriteToFile(&pisV, file->output, options->version) != 0)
+    {
+        DestroyPisVox(pisV);
+        return;
+    }
+    file->encodeTime = PisTimeSeconds() - begin;
+
+    FILE* fptr = fopen(file->output, "rb");
+    if(fptr != NULL)
+    {
+        fseek(fptr, 0, SEEK_END);
+        file->fileSize = (uint64_t)ftell(fptr);
+        fclose(fptr);
+    }
+
+    if(options->version == 2 && CountBricks(file) != 0)
+        fprintf(stderr, "Failed to read the brick table back: %s\n", file->output);
+
+    if(options->verify)
+    {
+        begin = PisTimeSeconds();
+        PisVox decoded;
+        int decodeResult = PisVoxLoadFromFile(file->output, options->decodeThreadCount, &decoded);
+        file->decodeTime = PisTimeSeconds() - begin;
+
+        size_t arraySize = (size_t)pisV.size.x * pisV.size.y * pisV.size.z;
+        file->matches = decodeResult == 0
+                     && decoded.size.x == pisV.size.x && decoded.size.y == pisV.size.y && decoded.size.z == pisV.size.z
+                     && memcmp(decoded.voxels, pisV.voxels, arraySize) == 0
+                     && memcmp(decoded.materials, pisV.materials, sizeof(pisV.materials)) == 0;
+
+        DestroyPisVox(decoded);
+    }
+
+    DestroyPisVox(pisV);
+
+    file->result = (options->verify && !file->matches) ? -1 : 0;
+}
+
+int LoadInput(ConvFile* file, ConvOptions* options, PisVox* pisV)
+{
+    const char* extension = strrchr(file->input, '.');
+
+    if(extension != NULL && strcmp(extension, ".vox") == 0)
+    {
+        PisVoxScene scene;
+        if(PisVoxSceneLoadVoxFile(file->input, &scene) != 0)
+            return -1;
+
+        int result = PisVoxSceneFlatten(&scene, pisV);
+        DestroyPisVoxScene(scene);
+
+        return result;
+    }
+
+    if(extension != NULL && strcmp(extension, ".pisv") == 0)
+        return PisVoxLoadFromFile(file->input, options->decodeThreadCount, pisV);
+
+    return LoadRaw(file, options, pisV);
+}
+
+int LoadRaw(ConvFile* file, ConvOptions* options, PisVox* pisV)
+{
+    if(!options->hasRawSize)
+    {
+        fprintf(stderr, "Raw input needs a size (-s XxYxZ): %s\n", file->input);
+        return -1;
+    }
+
+    FILE* fptr = fopen(file->input, "rb");
+    if(fptr == NULL)
+    {
+        fprintf(stderr, "Failed to read file: %s\n", file->input);
+        return -1;
+    }
+
+    Size size = options->rawSize;
+    size_t arraySize = (size_t)size.x * size.y * size.z;
+
+    fseek(fptr, 0, SEEK_END);
+    long fileSize = ftell(fptr);
+    fseek(fptr, 0, SEEK_SET);
+
+    if(fileSize < 0 || (size_t)fileSize != arraySize)
+    {
+        fprintf(stderr, "Raw input is %ld bytes, %ux%ux%u needs %zu: %s\n",
+                fileSize, size.x, size.y, size.z, arraySize, file->input);
+        fclose(fptr);
+        return -1;
+    }
+
+    pisV->size = size;
+    pisV->voxels = malloc(arraySize);
+
+    if(pisV->voxels == NULL || fread(pisV->voxels, 1, arraySize, fptr) != arraySize)
+    {
+        fprintf(stderr, "Failed to read file: %s\n", file->input);
+        free(pisV->voxels);
+        pisV->voxels = NULL;
+        fclose(fptr);
+        return -1;
+    }
+
+    fclose(fptr);
+
+    // Raw arrays carry no colors, use the same palette as .vox files without one
+    PisVoxDefaultPalette(pisV->materials);
+
+    return 0;
+}
+
+void MakeOutputName(ConvFile* file, ConvOptions* options)
+{
+    const char* name = strrchr(file->input, '/');
+    name = name ? name + 1 : file->input;
+
+    const char* extension = strrchr(name, '.');
+    int nameLength = extension ? (int)(extension - name) : (int)strlen(name);
+
+    if(options->outputDir != NULL)
+        snprintf(file->output, sizeof(file->output), "%s/%.*s.pisv", options->outputDir, nameLength, name);
+    else
+        snprintf(file->output, sizeof(file->output), "%.*s.pisv", (int)(name - file->input) + nameLength, file->input);
+
+    // Never overwrite the input, re-encoded .pisv files get the version in their name
+    if(strcmp(file->output, file->input) == 0)
+    {
+        size_t length = strlen(file->output) - strlen(".pisv");
+        snprintf(file->output + length, sizeof(file->output) - length, ".v%u.pisv", options->version);
+    }
+}
+
+// Histogram of the runs a PISV 001 stream of the volume would hold
+void CountRuns(ConvFile* file, PisVox* pisV)
+{
+    size_t arraySize = (size_t)pisV->size.x * pisV->size.y * pisV->size.z;
+
+    for(size_t i = 0; i < arraySize;)
+    {
+        uint8_t byte = pisV->voxels[i];
+        size_t run = 1;
+
+        while(i + run < arraySize && run < PISV_MAX_RUN && pisV->voxels[i + run] == byte)
+            run++;
+
+        uint32_t bucket = 0;
+        while(bucket + 1 < RUN_BUCKETS && (run >> (bucket + 1)) != 0)
+            bucket++;
+
+        file->runCount++;
+        file->runs[bucket]++;
+        file->runVoxels[bucket] += run;
+
+        if(byte != 0)
+            file->solidCount += run;
+
+        i += run;
+    }
+}
+
+int CountBricks(ConvFile* file)
+{
+    FILE* fptr = fopen(file->output, "rb");
+    if(fptr == NULL)
+        return -1;
+
+    uint8_t header[PISV_V2_HEADER_SIZE];
+    if(fread(header, 1, sizeof(header), fptr) != sizeof(header))
+    {
+        fclose(fptr);
+        return -1;
+    }
+
+    uint32_t brickCount = PisvReadU32(header + PISV_V2_HEADER_SIZE - 4);
+    long tableOffset = PISV_V2_HEADER_SIZE + 4 + sizeof(Material) * 256;
+
+    uint8_t* table = malloc((size_t)brickCount * PISV_BRICK_ENTRY_SIZE + 1);
+    int result = -1;
+
+    if(table != NULL && fseek(fptr, tableOffset, SEEK_SET) == 0
+    && fread(table, PISV_BRICK_ENTRY_SIZE, brickCount, fptr) == brickCount)
+    {
+        for(uint32_t i = 0; i < brickCount; i++)
+        {
+            PisvBrickEntry entry = PisvReadBrickEntry(&table[(size_t)i * PISV_BRICK_ENTRY_SIZE]);
+            if(entry.compression < 3)
+                file->brickCounts[entry.compression]++;
+        }
+
+        result = 0;
+    }
+
+    free(table);
+    fclose(fptr);
+
+    return result;
+}
+
+void PrintReport(ConvFile* file)
+{
+    if(file->result != 0 && file->fileSize == 0)
+    {
+        printf("%s: failed\n\n", file->input);
+        return;
+    }
+
+    uint64_t denseSize = (uint64_t)file->size.x * file->size.y * file->size.z;
+
+    printf("%s -> %s%s\n", file->input, file->output, file->result != 0 ? " (DOES NOT MATCH INPUT)" : "");
+    printf("  %ux%ux%u, %llu voxels, %llu solid (%.1f%%)\n", file->size.x, file->size.y, file->size.z,
+           (unsigned long long)denseSize, (unsigned long long)file->solidCount,
+           denseSize ? 100.0 * (double)file->solidCount / (double)denseSize : 0.0);
+    printf("  %llu B -> %llu B, ratio %.2f:1\n", (unsigned long long)denseSize, (unsigned long long)file->fileSize,
+           file->fileSize ? (double)denseSize / (double)file->fileSize : 0.0);
+    printf("  load %.2f ms, encode %.2f ms (%.1f MB/s)", file->loadTime * 1000.0,
+           file->encodeTime * 1000.0, MegabytesPerSecond(denseSize, file->encodeTime));
+
+    if(file->decodeTime > 0.0)
+        printf(", decode %.2f ms (%.1f MB/s)", file->decodeTime * 1000.0, MegabytesPerSecond(denseSize, file->decodeTime));
+    printf("\n");
+
+    if(file->brickCounts[0] + file->brickCounts[1] + file->brickCounts[2] != 0)
+        printf("  bricks: %u uniform, %u rle, %u raw\n", file->brickCounts[PISV_BRICK_UNIFORM],
+               file->brickCounts[PISV_BRICK_RLE], file->brickCounts[PISV_BRICK_RAW]);
+
+    printf("  %llu runs, %.1f voxels per run\n", (unsigned long long)file->runCount,
+           file->runCount ? (double)denseSize / (double)file->runCount : 0.0);
+
+    for(uint32_t bucket = 0; bucket < RUN_BUCKETS; bucket++)
+    {
+        if(file->runs[bucket] == 0)
+            continue;
+
+        uint32_t low = 1u << bucket;
+        uint32_t high = bucket + 1 < RUN_BUCKETS ? (1u << (bucket + 1)) - 1 : PISV_MAX_RUN;
+
+        printf("    %5u-%-5u %10llu runs (%5.1f%%) %12llu voxels (%5.1f%%)\n", low, high,
+               (unsigned long long)file->runs[bucket], 100.0 * (double)file->runs[bucket] / (double)file->runCount,
+               (unsigned long long)file->runVoxels[bucket], 100.0 * (double)file->runVoxels[bucket] / (double)denseSize);
+    }
+
+    printf("\n");
+}
+
+double MegabytesPerSecond(uint64_t bytes, double seconds)
+{
+    return (double)bytes / (seconds > 0.0 ? seconds : 1e-9) / (1024.0 * 1024.0);
+}
@@ -0,0 +1,261 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pis/pisCpuTracer.h"
+#include "pis/pisJobs.h"
+#include "pis/pisTime.h"
+#include "pis/pisUniforms.h"
+#include "pis/pisVoxReader.h"
+#include "pis/voxReader.h"
+
+/* =================================Helper functions================================ */
+void PrintUsage(void);
+int ParseFloats(const char* text, float* values, int count);
+int ParseIsa(const char* text, PisCpuIsa* isa);
+int RenderTimed(PisVox* pisV, UniformBufferObject* ubo, uint32_t width, uint32_t height, uint32_t threadCount,
+                PisCpuIsa isa, PisCpuImage* image, double* seconds);
+float ImageDifference(PisCpuImage* a, PisCpuImage* b);
+/* ================================================================================ */
+
+int main(int argc, char** argv)
+{
+    uint32_t threadCount = PisGetCoreCount();
+    uint32_t width = 832, height = 624;
+    const char* output = "render.png";
+
+    // The same start as main.c, in front of the middle of the world
+    float position[3] = { NAN, NAN, NAN };
+    float angles[2] = { 0.0f, 0.0f };
+    float fov = 90.0f;
+
+    PisCpuIsa isa = PisCpuBestIsa();
+    bool compareIsas = false;
+
+    int arg = 1;
+    for(; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        if(strcmp(argv[arg], "-j") == 0 && arg + 1 < argc)
+        {
+            int threads = atoi(argv[++arg]);
+            threadCount = threads > 0 ? (uint32_t)threads : 1;
+        }
+        else if(strcmp(argv[arg], "-s") == 0 && arg + 1 < argc)
+        {
+            char tail;
+            if(sscanf(argv[++arg], "%ux%u%c", &width, &height, &tail) != 2 || width == 0 || height == 0)
+            {
+                fprintf(stderr, "Size has to look like 832x624: %s\n", argv[arg]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[arg], "-p") == 0 && arg + 1 < argc)
+        {
+            if(ParseFloats(argv[++arg], position, 3) != 0)
+            {
+                fprintf(stderr, "Position has to look like 128,128,-2: %s\n", argv[arg]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[arg], "-a") == 0 && arg + 1 < argc)
+        {
+            if(ParseFloats(argv[++arg], angles, 2) != 0)
+            {
+                fprintf(stderr, "Angles have to look like 0.5,-0.2: %s\n", argv[arg]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[arg], "-f") == 0 && arg + 1 < argc)
+        {
+            fov = (float)atof(argv[++arg]);
+        }
+        else if(strcmp(argv[arg], "-o") == 0 && arg + 1 < argc)
+        {
+            output = argv[++arg];
+        }
+        else if(strcmp(argv[arg], "-i") == 0 && arg + 1 < argc)
+        {
+            if(ParseIsa(argv[++arg], &isa) != 0)
+                return -1;
+        }
+        else if(strcmp(argv[arg], "-b") == 0)
+        {
+            compareIsas = true;
+        }
+        else
+        {
+            PrintUsage();
+            return -1;
+        }
+    }
+
+    if(arg + 1 != argc)
+    {
+        PrintUsage();
+        return -1;
+    }
+
+    PisVox pisV;
+    const char* extension = strrchr(argv[arg], '.');
+    if(extension != NULL && strcmp(extension, ".vox") == 0)
+    {
+        PisVoxScene scene;
+        if(PisVoxSceneLoadVoxFile(argv[arg], &scene) != 0)
+            return -1;
+
+        int result = PisVoxSceneFlatten(&scene, &pisV);
+        DestroyPisVoxScene(scene);
+
+        if(result != 0)
+            return -1;
+    }
+    else
+    {
+        pisV = PisVoxReadFromFile(argv[arg]);
+    }
+
+    if(pisV.voxels == NULL)
+        return -1;
+
+    if(isnan(position[0]))
+    {
+        position[0] = pisV.size.x / 2.f;
+        position[1] = pisV.size.y / 2.f;
+        position[2] = -2.f;
+    }
+
+    // The camera main.c builds from the mouse angles
+    UniformBufferObject ubo = {0};
+    glm_vec3_copy(position, ubo.position);
+    ubo.fov = fov;
+
+    float yaw = angles[0], pitch = angles[1];
+    ubo.forward[0] = cos(pitch) * sin(yaw);
+    ubo.forward[1] = sin(pitch);
+    ubo.forward[2] = cos(pitch) * cos(yaw);
+    glm_normalize(ubo.forward);
+
+    glm_cross(ubo.forward, (vec3){0, 1, 0}, ubo.right);
+    glm_normalize(ubo.right);
+
+    glm_cross(ubo.right, ubo.forward, ubo.up);
+
+    PisCpuImage image;
+    double seconds;
+    if(RenderTimed(&pisV, &ubo, width, height, threadCount, isa, &image, &seconds) != 0)
+        return -1;
+
+    // Every other isa this cpu runs against the chosen one, they have to give the same image
+    if(compareIsas)
+    {
+        for(uint32_t other = 0; other < PIS_CPU_ISA_COUNT; other++)
+        {
+            if(other == isa || !PisCpuIsaSupported((PisCpuIsa)other))
+                continue;
+
+            PisCpuImage otherImage;
+            double otherSeconds;
+            if(RenderTimed(&pisV, &ubo, width, height, threadCount, (PisCpuIsa)other, &otherImage, &otherSeconds) != 0)
+                return -1;
+
+            printf("  %s runs %.2fx as fast as %s, largest difference %g\n", PisCpuIsaName((PisCpuIsa)other),
+                   seconds / otherSeconds, PisCpuIsaName(isa), ImageDifference(&image, &otherImage));
+            DestroyPisCpuImage(otherImage);
+        }
+    }
+
+    // PNG unless the name asks for a PPM
+    const char* outputExtension = strrchr(output, '.');
+    int result = outputExtension != NULL && strcmp(outputExtension, ".ppm") == 0 ? PisCpuImageWritePpm(&image, output)
+                                                                                  : PisCpuImageWritePng(&image, output);
+    if(result == 0)
+        printf("Wrote %s\n", output);
+
+    DestroyPisCpuImage(image);
+    DestroyPisVox(pisV);
+
+    return result;
+}
+
+void PrintUsage(void)
+{
+    fprintf(stderr,
+            "Usage: pisrender [-j threads] [-s WxH] [-p x,y,z] [-a yaw,pitch] [-f fov] [-i isa] [-b] [-o file] input\n"
+            "  Renders a .vox or .pisv file on the CPU the way voxel.comp does, into a PNG\n"
+            "  -j  number of threads, the core count by default\n"
+            "  -s  image size, 832x624 by default\n"
+            "  -p  camera position, in front of the middle of the volume by default\n"
+            "  -a  camera yaw and pitch in radians like main.c, 0,0 looks along +z\n"
+            "  -f  field of view in degrees, 90 by default\n"
+            "  -i  scalar, sse2, avx2 or neon, the widest this cpu runs by default\n"
+            "  -b  also render with every other isa this cpu runs and compare speed and image\n"
+            "  -o  output file, render.png by default, a binary PPM when it ends in .ppm\n");
+}
+
+int ParseFloats(const char* text, float* values, int count)
+{
+    for(int i = 0; i < count; i++)
+    {
+        char* end;
+        values[i] = strtof(text, &end);
+        if(end == text)
+            return -1;
+
+        text = end;
+        if(i + 1 < count)
+        {
+            if(*text != ',')
+                return -1;
+            text++;
+        }
+    }
+
+    return *text == '\0' ? 0 : -1;
+}
+
+int ParseIsa(const char* text, PisCpuIsa* isa)
+{
+    for(uint32_t i = 0; i < PIS_CPU_ISA_COUNT; i++)
+    {
+        if(strcmp(text, PisCpuIsaName((PisCpuIsa)i)) != 0)
+            continue;
+
+        if(!PisCpuIsaSupported((PisCpuIsa)i))
+        {
+            fprintf(stderr, "This cpu does not run %s\n", text);
+            return -1;
+        }
+
+        *isa = (PisCpuIsa)i;
+        return 0;
+    }
+
+    fprintf(stderr, "Unknown isa: %s\n", text);
+    return -1;
+}
+
+int RenderTimed(PisVox* pisV, UniformBufferObject* ubo, uint32_t width, uint32_t height, uint32_t threadCount,
+                PisCpuIsa isa, PisCpuImage* image, double* seconds)
+{
+    double begin = PisTimeSeconds();
+    if(PisCpuRender(pisV, ubo, width, height, threadCount, isa, image) != 0)
+        return -1;
+    *seconds = PisTimeSeconds() - begin;
+
+    printf("Rendered %ux%u with %s on %u threads in %.2f ms, %llu rays, %.2f Mrays/s\n", width, height,
+           PisCpuIsaName(isa), threadCount, *seconds * 1000.0, (unsigned long long)image->rayCount,
+           *seconds > 0.0 ? image->rayCount / *seconds / 1e6 : 0.0);
+
+    return 0;
+}
+
+float ImageDifference(PisCpuImage* a, PisCpuImage* b)
+{
+    float largest = 0.0f;
+    for(size_t i = 0; i < (size_t)a->width * a->height * 3; i++)
+        largest = fmaxf(largest, fabsf(a->pixels[i] - b->pixels[i]));
+
+    return largest;
+}